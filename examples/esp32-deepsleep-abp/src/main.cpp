@@ -31,8 +31,9 @@ Lmic LMIC{radio, aes, lmicrand, channelParams};
 
 OsTime nextSend;
 
-// buffer to save current lmic state (size may be reduce)
-const size_t SAVE_BUFFER_SIZE = 200;
+// buffer to save current lmic state, last byte mark a valid state
+const size_t SAVE_BUFFER_SIZE =
+    LmicStateSize<Eu868RegionalChannelParams>::value + 1;
 RTC_DATA_ATTR uint8_t saveState[SAVE_BUFFER_SIZE];
 
 void onEvent(EventType ev) {
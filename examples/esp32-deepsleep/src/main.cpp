@@ -5,6 +5,7 @@
 #include <hal/print_debug.h>
 #include <keyhandler.h>
 #include <lmic.h>
+#include <lmic/statesnapshot.h>
 
 #define DEVICE_TESTESP32
 #include "lorakeys.h"
@@ -28,8 +29,11 @@ LmicEu868 LMIC{radio};
 
 OsTime nextSend;
 
-// buffer to save current lmic state (size may be reduce)
-RTC_DATA_ATTR uint8_t saveState[301];
+// buffer to save current lmic state
+RTC_DATA_ATTR uint8_t
+    saveState[StateSnapshot::storageSize(LmicEu868::STATE_SIZE)];
+SnapshotBuffer snapshotStorage{saveState};
+StateSnapshot snapshot{snapshotStorage, sizeof(saveState)};
 
 void onEvent(EventType ev) {
   switch (ev) {
@@ -59,10 +63,9 @@ void onEvent(EventType ev) {
     }
     // we have transmit
     // save before going to deep sleep.
-    auto store = StoringBuffer{saveState};
-    LMIC.saveState(store);
-    saveState[300] = 51;
-    PRINT_DEBUG(1, F("State save len = %i"), store.length());
+    snapshot.save(LMIC);
+    PRINT_DEBUG(1, F("State save, %i bytes changed"),
+                snapshot.lastWriteCount());
     ESP.deepSleep(TX_INTERVAL.to_us());
     break;
   }
@@ -100,22 +103,24 @@ void setup() {
   SPI.begin();
   // LMIC init
   os_init();
-  LMIC.init();
-  // Reset the MAC state. Session and pending data transfers will be discarded.
-  LMIC.reset();
+  // check version and CRC, nothing restored on first boot.
+  // resume skip radio reset, random seeding and default channels.
+  if (snapshot.resume(LMIC)) {
+    PRINT_DEBUG(1, F("State restored"));
+    // do not restore twice the same counters after a crash.
+    snapshot.invalidate();
+  } else {
+    LMIC.init();
+    // Reset the MAC state. Session and pending data transfers will be
+    // discarded.
+    LMIC.reset();
+  }
   LMIC.setEventCallBack(onEvent);
   SetupLmicKey<appEui, devEui, appKey>::setup(LMIC);
 
   // set clock error to allow good connection.
   LMIC.setClockError(MAX_CLOCK_ERROR * 3 / 100);
   // LMIC.setAntennaPowerAdjustment(-14);
-
-  if (saveState[300] == 51) {
-    auto retrieve = RetrieveBuffer{saveState};
-    LMIC.loadState(retrieve);
-    // PRINT_DEBUG(1, F("State load len = %i"), lbuf);
-    saveState[300] = 0;
-  }
   // Start job (sending automatically starts OTAA too)
   nextSend = os_getTime();
 }
@@ -23,7 +23,7 @@ constexpr uint32_t TX_INTERVAL = 140;
 
 constexpr unsigned int BAUDRATE = 115200;
 
-constexpr uint32_t magic_constant = 0x5157;
+constexpr uint32_t magic_constant = 0x5158;
 uint32_t pauseBatt = 345; // centiVolt
 
 class EEPromStore : public StoringAbtract {
@@ -283,9 +283,16 @@ void setup() {
   digitalWrite(RADIO_XTAL_EN, 1);
 
   SPI.begin();
+  // check if a state was saved before power loss
+  EEPromRestore store;
+  uint32_t magic;
+  store.read(magic);
+  bool const stateSaved = magic == magic_constant;
+
   // LMIC init
   os_init();
-  LMIC.init();
+  // random pool is restored with the state, skip seeding from radio noise
+  LMIC.init(!stateSaved);
   // Reset the MAC state. Session and pending data transfers will be discarded.
   LMIC.reset();
 
@@ -295,11 +302,8 @@ void setup() {
   LMIC.setClockError(MAX_CLOCK_ERROR * 1 / 100);
   // reduce power
   // LMIC.setAntennaPowerAdjustment(-14);
-  // save lmic state if we lost power
-  EEPromRestore store;
-  uint32_t magic;
-  store.read(magic);
-  if (magic == magic_constant) {
+  // restore lmic state if we lost power
+  if (stateSaved) {
     digitalWrite(LED2, LOW);
     PRINT_DEBUG(1, F("Read state from EEPROM"));
 
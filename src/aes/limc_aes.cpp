@@ -111,7 +111,8 @@ void Aes::encrypt(uint8_t *const pdu, const uint8_t len) const {
  */
 void Aes::framePayloadEncryption(const uint8_t port, const uint32_t devaddr,
                                  const uint32_t seqno, const PktDir dndir,
-                                 uint8_t *payload, uint8_t len) const {
+                                 uint8_t *payload, uint8_t len,
+                                 const uint8_t firstBlock) const {
   const auto &key = port == 0 ? nwkSKey : appSKey;
   // Generate
   AesBlock blockAi;
@@ -124,7 +125,7 @@ void Aes::framePayloadEncryption(const uint8_t port, const uint32_t devaddr,
   wlsbf4(blockAi.begin() + 6, devaddr);
   wlsbf4(blockAi.begin() + 10, seqno);
   blockAi[14] = 0;
-  blockAi[15] = 0; // block counter
+  blockAi[15] = firstBlock; // block counter
 
   while (len) {
     // Increment the block index byte
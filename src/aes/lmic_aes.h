@@ -36,9 +36,10 @@ public:
   bool verifyMic(uint32_t devaddr, uint32_t seqno, PktDir dndir,
                  const uint8_t *pdu, uint8_t len) const;
   bool verifyMic0(uint8_t const *pdu, uint8_t len) const;
+  // firstBlock: index of the AES block of payload in the FRMPayload.
   void framePayloadEncryption(uint8_t port, uint32_t devaddr, uint32_t seqno,
-                              PktDir dndir, uint8_t *payload,
-                              uint8_t len) const;
+                              PktDir dndir, uint8_t *payload, uint8_t len,
+                              uint8_t firstBlock = 0) const;
   void encrypt(uint8_t *pdu, uint8_t len) const;
   void sessKeys(uint16_t devnonce, uint8_t const *artnonce);
   void appendMic(uint32_t devaddr, uint32_t seqno, PktDir dndir, uint8_t *pdu,
@@ -46,6 +47,9 @@ public:
   void appendMic0(uint8_t *pdu, uint8_t len) const;
   void saveState(StoringAbtract &store) const;
   void loadState(RetrieveAbtract &store);
+  static constexpr uint16_t getStateSize() {
+    return sizeof(nwkSKey) + sizeof(appSKey);
+  };
 };
 
 #endif // __aes_h__
\ No newline at end of file
@@ -198,12 +198,14 @@ void CertificationProtocol::echoPayload(uint8_t const *data, uint8_t size) {
   // EchoPayloadAns SHALL be clipped to maximum Regional Parameters allowed
   // uplink frame payload size.
 
-  uint8_t buffer[size + 1];
+  uint8_t const length =
+      std::min<uint8_t>(size + 1, lmic.getMaxTxPayloadLength());
+  uint8_t buffer[length];
   buffer[0] = static_cast<uint8_t>(Response::EchoPayload);
-  for (uint8_t i = 0; i < size; i++) {
-    buffer[i + 1] = data[i] + 1;
+  for (uint8_t i = 1; i < length; i++) {
+    buffer[i] = data[i - 1] + 1;
   }
-  lmic.setTxData2(certificationProtocolPort, buffer, size + 1,
+  lmic.setTxData2(certificationProtocolPort, buffer, length,
                   nextFrameIsConfirmed);
 }
 
@@ -0,0 +1,194 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "deltacodec.h"
+#include "../lmic/lmic_table.h"
+
+namespace {
+// clang-format off
+CONST_TABLE(int8_t, GPS_DELTAS)[] = {
+   0,  0,
+   1,  0,
+  -1,  0,
+   0,  1,
+   0, -1,
+   1,  1,
+   1, -1,
+  -1,  1,
+  -1, -1,
+};
+// clang-format on
+
+DeltaDictionary const *
+checkDictionary(DeltaDictionary const *const dictionary, uint8_t const fields) {
+  return dictionary && dictionary->fields == fields ? dictionary : nullptr;
+}
+} // namespace
+
+DeltaDictionary const GPS_DELTA_DICTIONARY = {
+    RESOLVE_TABLE(GPS_DELTAS), sizeof(RESOLVE_TABLE(GPS_DELTAS)) / 2, 2};
+
+uint8_t varint_write(uint8_t *const buffer, uint8_t const room,
+                     uint32_t value) {
+  uint8_t written = 0;
+  do {
+    if (written == room)
+      return 0;
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    if (value) {
+      byte |= 0x80;
+    }
+    buffer[written++] = byte;
+  } while (value);
+  return written;
+}
+
+uint8_t varint_read(uint8_t const *const buffer, uint8_t const length,
+                    uint32_t &value) {
+  value = 0;
+  for (uint8_t i = 0; i < length && i < VARINT_MAX_LENGTH; i++) {
+    value |= static_cast<uint32_t>(buffer[i] & 0x7F) << (7 * i);
+    if ((buffer[i] & 0x80) == 0)
+      return i + 1;
+  }
+  return 0;
+}
+
+DeltaEncoder::DeltaEncoder(int32_t *const previousBuffer,
+                           uint8_t const nbFields,
+                           DeltaDictionary const *const dict)
+    : previous(previousBuffer), fields(nbFields),
+      dictionary(checkDictionary(dict, nbFields)) {}
+
+void DeltaEncoder::begin(uint8_t *const out, uint8_t const outRoom) {
+  buffer = out;
+  room = outRoom;
+  position = 0;
+  count = 0;
+}
+
+int32_t DeltaEncoder::delta(int32_t const *const values,
+                            uint8_t const field) const {
+  // first record of frame is coded from zero, wrap around on overflow.
+  uint32_t const reference = count ? previous[field] : 0;
+  return static_cast<int32_t>(static_cast<uint32_t>(values[field]) -
+                              reference);
+}
+
+bool DeltaEncoder::findEntry(int32_t const *const values,
+                             uint8_t &index) const {
+  for (uint8_t entry = 0; entry < dictionary->size; entry++) {
+    uint8_t field = 0;
+    while (field < fields &&
+           delta(values, field) ==
+               table_get_s1(dictionary->entries, entry * fields + field)) {
+      field++;
+    }
+    if (field == fields) {
+      index = entry;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DeltaEncoder::add(int32_t const *const values) {
+  if (!buffer)
+    return false;
+
+  uint8_t end = position;
+  uint8_t field = 0;
+  uint8_t index;
+  if (dictionary && findEntry(values, index)) {
+    uint8_t const written = varint_write(buffer + end, room - end, index);
+    if (written == 0)
+      return false;
+    end += written;
+    field = fields;
+  }
+
+  for (; field < fields; field++) {
+    uint32_t value = zigzag_encode(delta(values, field));
+    if (field == 0 && dictionary) {
+      // shifted after dictionary index
+      if (value > UINT32_MAX - dictionary->size)
+        return false;
+      value += dictionary->size;
+    }
+    uint8_t const written = varint_write(buffer + end, room - end, value);
+    if (written == 0)
+      return false;
+    end += written;
+  }
+
+  for (field = 0; field < fields; field++) {
+    previous[field] = values[field];
+  }
+  position = end;
+  count++;
+  return true;
+}
+
+DeltaDecoder::DeltaDecoder(int32_t *const previousBuffer,
+                           uint8_t const nbFields,
+                           DeltaDictionary const *const dict)
+    : previous(previousBuffer), fields(nbFields),
+      dictionary(checkDictionary(dict, nbFields)) {}
+
+void DeltaDecoder::begin(uint8_t const *const frame,
+                         uint8_t const frameLength) {
+  data = frame;
+  length = frameLength;
+  position = 0;
+  malformed = false;
+  for (uint8_t field = 0; field < fields; field++) {
+    previous[field] = 0;
+  }
+}
+
+bool DeltaDecoder::read(uint32_t &value) {
+  uint8_t const readLength =
+      varint_read(data + position, length - position, value);
+  if (readLength == 0) {
+    malformed = true;
+    return false;
+  }
+  position += readLength;
+  return true;
+}
+
+bool DeltaDecoder::next(int32_t *const values) {
+  if (!data || malformed || position >= length)
+    return false;
+
+  uint8_t field = 0;
+  uint32_t value;
+  if (!read(value))
+    return false;
+
+  if (dictionary) {
+    if (value < dictionary->size) {
+      for (; field < fields; field++) {
+        values[field] = static_cast<int32_t>(
+            static_cast<uint32_t>(previous[field]) +
+            table_get_s1(dictionary->entries, value * fields + field));
+      }
+    } else {
+      value -= dictionary->size;
+    }
+  }
+
+  for (; field < fields; field++) {
+    if (field != 0 && !read(value))
+      return false;
+    values[field] = static_cast<int32_t>(static_cast<uint32_t>(previous[field]) +
+                                         zigzag_decode(value));
+  }
+
+  for (field = 0; field < fields; field++) {
+    previous[field] = values[field];
+  }
+  return true;
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef codec_deltacodec_h
+#define codec_deltacodec_h
+
+#include <array>
+#include <stdint.h>
+
+/*
+ * Compact encoding of sensor series before setTxData2.
+ * Each record is a fixed number of int32 fields. In a frame the first record
+ * is coded from zero, next ones as the difference from the previous record.
+ * Each value is zigzag coded (small negative are small positive) and
+ * written as a varint (7 bits by byte, high bit set if more bytes follow).
+ * Every frame decode alone, a lost uplink does not break the next ones.
+ *
+ * With a dictionary, the first varint of a record is either the index of a
+ * dictionary entry equal to the whole delta (one byte by record), or the
+ * zigzag of the first delta plus the dictionary size.
+ *
+ * No heap, no recursion, state is the previous record.
+ */
+
+// Max size of a varint coded uint32_t.
+constexpr uint8_t VARINT_MAX_LENGTH = 5;
+
+constexpr uint32_t zigzag_encode(int32_t const value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+constexpr int32_t zigzag_decode(uint32_t const value) {
+  return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+/**
+ * Write value in buffer, return the number of bytes written or 0 if more
+ * than room bytes are needed.
+ */
+uint8_t varint_write(uint8_t *buffer, uint8_t room, uint32_t value);
+/**
+ * Read a value from buffer, return the number of bytes read or 0 if
+ * truncated or too long.
+ */
+uint8_t varint_read(uint8_t const *buffer, uint8_t length, uint32_t &value);
+
+/**
+ * Table of delta records (size * fields int8_t, CONST_TABLE for AVR).
+ */
+struct DeltaDictionary {
+  int8_t const *entries;
+  uint8_t size;
+  uint8_t fields;
+};
+
+// Dictionary for two fields (latitude, longitude) deltas in units of the
+// application: stationary and one step in the 8 directions.
+extern DeltaDictionary const GPS_DELTA_DICTIONARY;
+
+class DeltaEncoder {
+public:
+  /**
+   * Start a frame in buffer (room bytes available).
+   */
+  void begin(uint8_t *buffer, uint8_t room);
+  /**
+   * Add a record of fields values.
+   * Return false if it does not fit, nothing is written.
+   * With a dictionary the first field delta is limited to +/-(2^31 - size).
+   */
+  bool add(int32_t const *values);
+
+  uint8_t length() const { return position; }
+  uint8_t records() const { return count; }
+
+protected:
+  DeltaEncoder(int32_t *previous, uint8_t fields,
+               DeltaDictionary const *dictionary);
+
+private:
+  int32_t *const previous;
+  uint8_t const fields;
+  DeltaDictionary const *const dictionary;
+  uint8_t *buffer = nullptr;
+  uint8_t room = 0;
+  uint8_t position = 0;
+  uint8_t count = 0;
+
+  int32_t delta(int32_t const *values, uint8_t field) const;
+  bool findEntry(int32_t const *values, uint8_t &index) const;
+};
+
+class DeltaDecoder {
+public:
+  /**
+   * Start decoding a frame.
+   */
+  void begin(uint8_t const *data, uint8_t length);
+  /**
+   * Read next record in values.
+   * Return false at end of frame or on malformed data (see error()).
+   */
+  bool next(int32_t *values);
+  bool error() const { return malformed; }
+
+protected:
+  DeltaDecoder(int32_t *previous, uint8_t fields,
+               DeltaDictionary const *dictionary);
+
+private:
+  int32_t *const previous;
+  uint8_t const fields;
+  DeltaDictionary const *const dictionary;
+  uint8_t const *data = nullptr;
+  uint8_t length = 0;
+  uint8_t position = 0;
+  bool malformed = false;
+
+  bool read(uint32_t &value);
+};
+
+template <uint8_t FIELDS> struct DeltaCodecStorage {
+  std::array<int32_t, FIELDS> previousBuffer = {};
+};
+
+/**
+ * Encoder of records of FIELDS values.
+ */
+template <uint8_t FIELDS>
+class DeltaEncoderBuffer final : private DeltaCodecStorage<FIELDS>,
+                                 public DeltaEncoder {
+  static_assert(FIELDS > 0, "Record need at least one field");
+
+public:
+  explicit DeltaEncoderBuffer(DeltaDictionary const *dictionary = nullptr)
+      : DeltaEncoder(DeltaCodecStorage<FIELDS>::previousBuffer.begin(), FIELDS,
+                     dictionary) {}
+};
+
+/**
+ * Decoder of records of FIELDS values.
+ */
+template <uint8_t FIELDS>
+class DeltaDecoderBuffer final : private DeltaCodecStorage<FIELDS>,
+                                 public DeltaDecoder {
+  static_assert(FIELDS > 0, "Record need at least one field");
+
+public:
+  explicit DeltaDecoderBuffer(DeltaDictionary const *dictionary = nullptr)
+      : DeltaDecoder(DeltaCodecStorage<FIELDS>::previousBuffer.begin(), FIELDS,
+                     dictionary) {}
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "hal_io.h"
 #include "../lmic/lmic.h"
 #include "hal.h"
+#include "hal_trace.h"
 #include <Arduino.h>
 #include <SPI.h>
 #include <algorithm>
@@ -51,17 +52,20 @@ void HalIo::read_buffer(uint8_t const addr, uint8_t *const buf,
 }
 
 void HalIo::beginspi() const {
+  hal_trace_begin_spi();
   SPI.beginTransaction(settings);
   digitalWrite(lmic_pins.nss, 0);
 }
 
 void HalIo::endspi() const {
+  hal_trace_end_spi();
   digitalWrite(lmic_pins.nss, 1);
   SPI.endTransaction();
 }
 
 // perform SPI transaction with radio
 uint8_t HalIo::spi(uint8_t const out) const {
+  hal_trace_spi(out);
   uint8_t res = SPI.transfer(out);
   /*
       Serial.print(">");
@@ -73,6 +77,7 @@ uint8_t HalIo::spi(uint8_t const out) const {
 }
 
 void HalIo::pin_switch_antenna_tx(bool isTx) const {
+  hal_trace_antenna(isTx);
   // val == 1  => tx 1
   if (lmic_pins.prepare_antenna_tx)
     lmic_pins.prepare_antenna_tx(isTx);
@@ -92,14 +97,17 @@ void HalIo::pin_rst(uint8_t val) const {
 }
 
 bool HalIo::io_check() const {
+  bool result = false;
   for (uint8_t i = 0; i < NUM_DIO; ++i) {
     uint8_t newVal = digitalRead(lmic_pins.dio[i]);
     PRINT_DEBUG(2, F("Check DIO%d Value=%d"), i, newVal);
     if (newVal) {
-      return true;
+      result = true;
+      break;
     }
   }
-  return false;
+  hal_trace_io_check(result);
+  return result;
 }
 
 bool HalIo::io_check0() const {
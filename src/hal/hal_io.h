@@ -2,6 +2,7 @@
 #define hal_hal_io_h
 #pragma once
 
+#include "../boardconfig.h"
 #include "../lmic/osticks.h"
 #include <stdint.h>
 
@@ -19,6 +20,30 @@ struct lmic_pinmap {
 // Use this for any unused pins.
 const uint8_t LMIC_UNUSED_PIN = 0xff;
 
+#if LMIC_HAL_IO == LMIC_GENERIC
+/**
+ * Device connected to the SPI bus and DIO pins of the generic HAL.
+ * Used to run the real radio drivers against an emulator.
+ */
+class HalIoDevice {
+public:
+  // NSS low
+  virtual void select() = 0;
+  // NSS high
+  virtual void deselect() = 0;
+  virtual uint8_t transfer(uint8_t outval) = 0;
+  // value of DIO0 (busy for SX126x) or DIO1
+  virtual bool dio(uint8_t index) = 0;
+  // RST pin driven low
+  virtual void reset() = 0;
+};
+
+/**
+ * Connect a device to the generic HAL, nullptr to disconnect.
+ */
+void hal_io_set_device(HalIoDevice *device);
+#endif
+
 class HalIo final {
 public:
   explicit HalIo(lmic_pinmap const &pins);
@@ -4,12 +4,19 @@
 #include "hal_io.h"
 #include "../lmic/lmic.h"
 #include "hal.h"
+#include "hal_trace.h"
 // #include <Arduino.h>
 // #include <SPI.h>
 #include <algorithm>
 #include <hal/print_debug.h>
 
 
+namespace {
+HalIoDevice *device = nullptr;
+}
+
+void hal_io_set_device(HalIoDevice *const new_device) { device = new_device; }
+
 HalIo::HalIo(lmic_pinmap const &pins) : lmic_pins(pins) {}
 
 void HalIo::yield() const {
@@ -50,17 +57,29 @@ void HalIo::read_buffer(uint8_t const addr, uint8_t *const buf,
 }
 
 void HalIo::beginspi() const {
+  hal_trace_begin_spi();
+  if (device) {
+    device->select();
+  }
   // SPI.beginTransaction(settings);
   // digitalWrite(lmic_pins.nss, 0);
 }
 
 void HalIo::endspi() const {
+  hal_trace_end_spi();
+  if (device) {
+    device->deselect();
+  }
   // digitalWrite(lmic_pins.nss, 1);
   // SPI.endTransaction();
 }
 
 // perform SPI transaction with radio
-uint8_t HalIo::spi(uint8_t const /* out */) const {
+uint8_t HalIo::spi(uint8_t const out) const {
+  hal_trace_spi(out);
+  if (device) {
+    return device->transfer(out);
+  }
   // uint8_t res = SPI.transfer(out);
   /*
       Serial.print(">");
@@ -73,6 +92,7 @@ uint8_t HalIo::spi(uint8_t const /* out */) const {
 }
 
 void HalIo::pin_switch_antenna_tx(bool isTx) const {
+  hal_trace_antenna(isTx);
   // val == 1  => tx 1
   if (lmic_pins.prepare_antenna_tx)
     lmic_pins.prepare_antenna_tx(isTx);
@@ -83,6 +103,10 @@ void HalIo::pin_rst(uint8_t val) const {
   if (lmic_pins.rst == LMIC_UNUSED_PIN)
     return;
 
+  if (val == 0 && device) {
+    device->reset();
+  }
+
   if (val == 0 || val == 1) { // drive pin
   //  pinMode(lmic_pins.rst, OUTPUT);
   //  digitalWrite(lmic_pins.rst, val);
@@ -92,6 +116,11 @@ void HalIo::pin_rst(uint8_t val) const {
 }
 
 bool HalIo::io_check() const {
+  if (device) {
+    bool const result = device->dio(0) || device->dio(1);
+    hal_trace_io_check(result);
+    return result;
+  }
   for (uint8_t i = 0; i < NUM_DIO; ++i) {
     // uint8_t newVal = digitalRead(lmic_pins.dio[i]);
     // PRINT_DEBUG(2, F("Check DIO%d Value=%d"), i, newVal);
@@ -103,11 +132,17 @@ bool HalIo::io_check() const {
 }
 
 bool HalIo::io_check0() const {
+  if (device) {
+    return device->dio(0);
+  }
   // return digitalRead(lmic_pins.dio[0]) ? true : false;
   return true;
 }
 
 bool HalIo::io_check1() const {
+  if (device) {
+    return device->dio(1);
+  }
   // return digitalRead(lmic_pins.dio[1]) ? true : false;
   return true;
 }
@@ -0,0 +1,83 @@
+#include "hal_trace.h"
+
+#ifdef LMIC_SPI_TRACE
+
+#include "hal.h"
+#include <array>
+
+namespace {
+std::array<TraceRecord, LMIC_SPI_TRACE_SIZE> ring;
+// index of next record to write
+size_t head = 0;
+size_t count = 0;
+uint32_t dropped = 0;
+
+// transaction in progress
+TraceRecord current;
+bool lastIoCheck = false;
+
+void push(TraceRecord const &record) {
+  ring[head] = record;
+  head = (head + 1) % ring.size();
+  if (count < ring.size()) {
+    count++;
+  } else {
+    dropped++;
+  }
+}
+
+void push(TraceEvent const event, uint16_t const value) {
+  push(TraceRecord{hal_ticks().tick(), value, event, 0});
+}
+
+} // namespace
+
+void hal_trace_begin_spi() {
+  current = TraceRecord{hal_ticks().tick(), 0, TraceEvent::SPI, 0};
+}
+
+void hal_trace_spi(uint8_t const outval) {
+  if (current.value == 0) {
+    current.aux = outval;
+  }
+  current.value++;
+}
+
+void hal_trace_end_spi() { push(current); }
+
+void hal_trace_antenna(bool const isTx) {
+  push(TraceEvent::ANTENNA, isTx ? 1 : 0);
+}
+
+void hal_trace_io_check(bool const value) {
+  // io_check is polled, only keep changes.
+  if (value != lastIoCheck) {
+    lastIoCheck = value;
+    push(TraceEvent::IO_CHECK, value ? 1 : 0);
+  }
+}
+
+void hal_trace_operation(TraceOperation const operation, bool const begin) {
+  push(begin ? TraceEvent::OP_BEGIN : TraceEvent::OP_END,
+       static_cast<uint16_t>(operation));
+}
+
+size_t hal_trace_copy(TraceRecord *const records, size_t const maxCount) {
+  size_t const nb = count < maxCount ? count : maxCount;
+  size_t const first = (head + ring.size() - count) % ring.size();
+  for (size_t i = 0; i < nb; i++) {
+    records[i] = ring[(first + i) % ring.size()];
+  }
+  return nb;
+}
+
+uint32_t hal_trace_dropped() { return dropped; }
+
+void hal_trace_clear() {
+  head = 0;
+  count = 0;
+  dropped = 0;
+  lastIoCheck = false;
+}
+
+#endif
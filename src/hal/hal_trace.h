@@ -0,0 +1,100 @@
+#ifndef hal_hal_trace_h
+#define hal_hal_trace_h
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Optional trace of the radio bus, enabled with LMIC_SPI_TRACE.
+ * HalIo and the radio drivers record compact records in a ring buffer,
+ * hal_trace_analyzer.h decode them on native build.
+ * When LMIC_SPI_TRACE is not defined all functions are empty inline.
+ */
+
+#ifndef LMIC_SPI_TRACE_SIZE
+#define LMIC_SPI_TRACE_SIZE 128
+#endif
+
+enum class TraceEvent : uint8_t {
+  // one SPI transaction (NSS low to NSS high)
+  SPI,
+  // antenna switch
+  ANTENNA,
+  // change of the value returned by io_check
+  IO_CHECK,
+  // start of a radio operation
+  OP_BEGIN,
+  // end of a radio operation
+  OP_END,
+};
+
+enum class TraceOperation : uint8_t {
+  INIT,
+  INIT_RANDOM,
+  TX,
+  RX,
+  // interrupt handling at the end of tx / rx
+  END_TX,
+  END_RX
+};
+
+constexpr uint8_t TRACE_OPERATION_COUNT = 6;
+
+struct TraceRecord {
+  // tick of the event, start of transaction for SPI.
+  uint32_t time;
+  // SPI: number of bytes, ANTENNA: 1 if tx, IO_CHECK: value,
+  // OP_BEGIN/OP_END: operation.
+  uint16_t value;
+  TraceEvent event;
+  // SPI: first byte (register or command).
+  uint8_t aux;
+};
+
+#ifdef LMIC_SPI_TRACE
+
+void hal_trace_begin_spi();
+void hal_trace_spi(uint8_t outval);
+void hal_trace_end_spi();
+void hal_trace_antenna(bool isTx);
+void hal_trace_io_check(bool value);
+void hal_trace_operation(TraceOperation operation, bool begin);
+
+/**
+ * Copy the records, oldest first, return the number of records copied.
+ */
+size_t hal_trace_copy(TraceRecord *records, size_t maxCount);
+// number of records lost because the ring buffer was full.
+uint32_t hal_trace_dropped();
+void hal_trace_clear();
+
+#else
+
+inline void hal_trace_begin_spi() {}
+inline void hal_trace_spi(uint8_t) {}
+inline void hal_trace_end_spi() {}
+inline void hal_trace_antenna(bool) {}
+inline void hal_trace_io_check(bool) {}
+inline void hal_trace_operation(TraceOperation, bool) {}
+
+#endif
+
+/**
+ * Mark a radio operation for the lifetime of the object.
+ */
+class TraceOperationScope {
+public:
+  explicit TraceOperationScope(TraceOperation op) : operation(op) {
+    hal_trace_operation(operation, true);
+  }
+  ~TraceOperationScope() { hal_trace_operation(operation, false); }
+
+  TraceOperationScope(TraceOperationScope const &) = delete;
+  TraceOperationScope &operator=(TraceOperationScope const &) = delete;
+
+private:
+  TraceOperation const operation;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "hal_trace_analyzer.h"
+
+#ifndef ARDUINO
+
+#include <cinttypes>
+
+namespace {
+constexpr uint8_t MAX_NESTING = 4;
+
+struct Running {
+  TraceOperation operation;
+  uint32_t start;
+  uint32_t transactions;
+  uint32_t bytes;
+};
+} // namespace
+
+TraceSummaries hal_trace_summarize(TraceRecord const *const records,
+                                   size_t const count) {
+  TraceSummaries summaries;
+  std::array<Running, MAX_NESTING> stack;
+  uint8_t depth = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    auto const &record = records[i];
+    switch (record.event) {
+    case TraceEvent::OP_BEGIN:
+      if (depth < MAX_NESTING && record.value < TRACE_OPERATION_COUNT) {
+        stack[depth++] = Running{static_cast<TraceOperation>(record.value),
+                                 record.time, 0, 0};
+      }
+      break;
+    case TraceEvent::OP_END:
+      // an end without begin is the tail of an operation lost in the ring.
+      if (depth > 0 && static_cast<uint16_t>(stack[depth - 1].operation) ==
+                           record.value) {
+        auto const &running = stack[--depth];
+        auto &summary = summaries[record.value];
+        summary.calls++;
+        summary.transactions += running.transactions;
+        summary.bytes += running.bytes;
+        summary.wallTime += OsDeltaTime(static_cast<int32_t>(record.time - running.start));
+      }
+      break;
+    case TraceEvent::SPI:
+      if (depth > 0) {
+        stack[depth - 1].transactions++;
+        stack[depth - 1].bytes += record.value;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return summaries;
+}
+
+char const *hal_trace_operation_name(TraceOperation const operation) {
+  switch (operation) {
+  case TraceOperation::INIT:
+    return "init";
+  case TraceOperation::INIT_RANDOM:
+    return "init_random";
+  case TraceOperation::TX:
+    return "tx";
+  case TraceOperation::RX:
+    return "rx";
+  case TraceOperation::END_TX:
+    return "end_tx";
+  case TraceOperation::END_RX:
+    return "end_rx";
+  }
+  return "?";
+}
+
+void hal_trace_print(FILE *const out, TraceSummaries const &summaries) {
+  fprintf(out, "%-12s %6s %8s %8s %10s\n", "operation", "calls", "spi",
+          "bytes", "time(us)");
+  for (uint8_t i = 0; i < TRACE_OPERATION_COUNT; i++) {
+    auto const &summary = summaries[i];
+    fprintf(out, "%-12s %6" PRIu32 " %8" PRIu32 " %8" PRIu32 " %10" PRIi32 "\n",
+            hal_trace_operation_name(static_cast<TraceOperation>(i)),
+            summary.calls, summary.transactions, summary.bytes,
+            summary.wallTime.to_us());
+  }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef hal_hal_trace_analyzer_h
+#define hal_hal_trace_analyzer_h
+#pragma once
+
+#include "hal_trace.h"
+
+#ifndef ARDUINO
+
+#include "../lmic/osticks.h"
+#include <array>
+#include <stdio.h>
+
+/**
+ * Cost of one kind of radio operation on the bus.
+ */
+struct TraceSummary {
+  // number of operation seen (begin and end in the trace).
+  uint32_t calls = 0;
+  // SPI transactions and bytes inside the operations.
+  uint32_t transactions = 0;
+  uint32_t bytes = 0;
+  // time between begin and end of the operations.
+  OsDeltaTime wallTime = OsDeltaTime(0);
+};
+
+using TraceSummaries = std::array<TraceSummary, TRACE_OPERATION_COUNT>;
+
+/**
+ * Compute per operation summaries from a trace, oldest record first.
+ * SPI transactions are counted in the innermost running operation,
+ * records outside any operation are ignored.
+ */
+TraceSummaries hal_trace_summarize(TraceRecord const *records, size_t count);
+
+char const *hal_trace_operation_name(TraceOperation operation);
+
+/**
+ * Print a table of the summaries, one line per operation.
+ */
+void hal_trace_print(FILE *out, TraceSummaries const &summaries);
+
+#endif
+
+#endif
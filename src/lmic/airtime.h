@@ -0,0 +1,102 @@
+/*******************************************************************************
+ * Copyright (c) 2014-2015 IBM Corporation.
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Zurich Research Lab - initial API, implementation and documentation
+ *    Nicolas Graziano - cpp style.
+ *******************************************************************************/
+
+#ifndef _lmic_airtime_h_
+#define _lmic_airtime_h_
+
+#include "lmic_table.h"
+#include "lorabase.h"
+#include "osticks.h"
+
+/**
+ * Time on air of a LoRa frame of plen bytes (PHY payload).
+ * Evaluated at compile time when parameters are constant.
+ */
+constexpr OsDeltaTime lora_airtime(rps_t const rps, uint8_t const plen) {
+  // BW 0,1,2 = 125,250,500kHz
+  const uint8_t bw = rps.bwRaw;
+  // SF 7..12 = SF7..12
+  const uint8_t sf = 7 + rps.sf - SF7;
+  const uint8_t sfx = 4 * sf;
+  const uint8_t optimiseLowSf = (rps.sf >= SF11 ? 8 : 0);
+  const uint8_t q = sfx - optimiseLowSf;
+
+  int16_t tmp = 8 * plen - sfx + 28 + (rps.nocrc ? 0 : 16);
+  if (tmp > 0) {
+    tmp = (tmp + q - 1) / q;
+    tmp *= (rps.crRaw + 5);
+    tmp += 8;
+  } else {
+    tmp = 8;
+  }
+  tmp = (tmp << 2) + /*preamble*/ 49 /* 4 * (8 + 4.25) */;
+  // bw = 125000 = 15625 * 2^3
+  //      250000 = 15625 * 2^4
+  //      500000 = 15625 * 2^5
+  // sf = 7..12
+  //
+  // osticks =  tmp * OSTICKS_PER_SEC * 1<<sf / bw
+  //
+  // 3 => counter reduced divisor 125000/8 => 15625
+  // 2 => counter 2 shift on tmp
+  uint8_t sfx2 = sf - (3 + 2) - bw;
+  uint16_t div = 15625;
+  if (sfx2 > 4) {
+    // prevent 32bit signed int overflow in last step
+    div >>= sfx2 - 4;
+    sfx2 = 4;
+  }
+  // Need 32bit arithmetic for this last step
+  return OsDeltaTime((((int32_t)tmp << sfx2) * OSTICKS_PER_SEC + div / 2) /
+                     div);
+}
+
+// Length of PHY payload grouped in a bucket of the airtime tables.
+constexpr uint8_t AIRTIME_BUCKET_SIZE = 16;
+constexpr uint8_t AIRTIME_BUCKETS = 256 / AIRTIME_BUCKET_SIZE;
+
+/**
+ * Time on air by datarate and length bucket, to plan payload sizes.
+ * Each entry is the airtime of the longest frame of the bucket (upper bound).
+ * Region tables are declared with CONST_TABLE (PROGMEM on AVR):
+ * use at() in constant expressions and get() at run time.
+ */
+template <uint8_t NB_DR> struct AirtimeTable {
+  int32_t ticks[NB_DR][AIRTIME_BUCKETS];
+
+  constexpr OsDeltaTime at(dr_t const dr, uint8_t const plen) const {
+    return OsDeltaTime(ticks[dr][plen / AIRTIME_BUCKET_SIZE]);
+  }
+  OsDeltaTime get(dr_t const dr, uint8_t const plen) const {
+    return OsDeltaTime(table_get_s4(ticks[dr], plen / AIRTIME_BUCKET_SIZE));
+  }
+};
+
+/**
+ * Build the table of uplinks (with CRC) for the rps of each datarate.
+ */
+template <typename... Rps>
+constexpr AirtimeTable<sizeof...(Rps)> make_airtime_table(Rps const... rps) {
+  AirtimeTable<sizeof...(Rps)> table = {};
+  uint8_t const rpsByDr[] = {static_cast<uint8_t>(rps)...};
+  for (uint8_t dr = 0; dr < sizeof...(Rps); dr++) {
+    for (uint8_t bucket = 0; bucket < AIRTIME_BUCKETS; bucket++) {
+      table.ticks[dr][bucket] =
+          lora_airtime(rps_t(rpsByDr[dr]),
+                       bucket * AIRTIME_BUCKET_SIZE + AIRTIME_BUCKET_SIZE - 1)
+              .tick();
+    }
+  }
+  return table;
+}
+
+#endif
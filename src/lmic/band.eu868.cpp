@@ -14,8 +14,46 @@ constexpr uint32_t MAX_BAND2_CENTI = 870000000;
 
 enum { BAND_MILLI = 0, BAND_CENTI = 1, BAND_DECI = 2 };
 
+uint16_t dutyCycle(uint8_t const band) {
+  if (band == BAND_MILLI) {
+    return 1000;
+  } else if (band == BAND_CENTI) {
+    return 100;
+  }
+  // DECI
+  return 10;
+}
+
 } // namespace
 
+#if defined(LMIC_DUTY_CYCLE_WINDOW)
+
+BandsEu868::BandsEu868()
+    : ledgers{DutyCycleLedger(os_getTime()), DutyCycleLedger(os_getTime()),
+              DutyCycleLedger(os_getTime())} {}
+
+void BandsEu868::updateBandAvailability(uint8_t const band,
+                                        OsTime const lastusage,
+                                        OsDeltaTime const duration) {
+  ledgers[band].add(lastusage, duration);
+
+  PRINT_DEBUG(2, F("Band %d used %" PRIi32 " ms in window"), band,
+              ledgers[band].used(lastusage).to_ms());
+}
+
+OsTime BandsEu868::getAvailability(uint8_t const band) const {
+  return ledgers[band].availability(os_getTime(), dutyCycle(band));
+}
+
+void BandsEu868::print_state() const {
+  for (uint8_t band_index = 0; band_index < MAX_BAND; band_index++) {
+    PRINT_DEBUG(2, F("Band %d, available at %" PRIu32 "."), band_index,
+                getAvailability(band_index).tick());
+  }
+}
+
+#else
+
 BandsEu868::BandsEu868() {
   auto now = os_getTime();
   avail.fill(now);  
@@ -24,21 +62,16 @@ BandsEu868::BandsEu868() {
 void BandsEu868::updateBandAvailability(uint8_t const band,
                                         OsTime const lastusage,
                                         OsDeltaTime const duration) {
-  uint16_t cap;
-  if (band == BAND_MILLI) {
-    cap = 1000;
-  } else if (band == BAND_CENTI) {
-    cap = 100;
-  } else {
-    // DECI
-    cap = 10;
-  }
-  avail[band] = lastusage + cap * duration;
+  avail[band] = lastusage + dutyCycle(band) * duration;
 
   PRINT_DEBUG(2, F("Setting  available time for band %d to %" PRIu32 ""), band,
               avail[band].tick());
 }
 
+OsTime BandsEu868::getAvailability(uint8_t const band) const {
+  return avail[band];
+}
+
 void BandsEu868::print_state() const {
 
   for (uint8_t band_index = 0; band_index < MAX_BAND; band_index++) {
@@ -47,6 +80,8 @@ void BandsEu868::print_state() const {
   }
 }
 
+#endif
+
 uint8_t BandsEu868::getBandForFrequency(uint32_t const frequency) const {
 
   if (frequency >= MIN_BAND_DECI && frequency <= MAX_BAND_DECI)
@@ -60,6 +95,22 @@ uint8_t BandsEu868::getBandForFrequency(uint32_t const frequency) const {
 
 #if defined(ENABLE_SAVE_RESTORE)
 
+#if defined(LMIC_DUTY_CYCLE_WINDOW)
+
+void BandsEu868::saveState(StoringAbtract &store) const {
+  for (auto const &ledger : ledgers) {
+    ledger.saveState(store);
+  }
+}
+
+void BandsEu868::loadState(RetrieveAbtract &store) {
+  for (auto &ledger : ledgers) {
+    ledger.loadState(store);
+  }
+}
+
+#else
+
 void BandsEu868::saveState(StoringAbtract &store) const {
 
   std::for_each(begin(avail), end(avail),
@@ -71,8 +122,6 @@ void BandsEu868::loadState(RetrieveAbtract &store) {
                 [&store](OsTime &date) { store.read(date); });
 }
 
-constexpr uint16_t BandsEu868::getStateSize()  {
-  return sizeof(avail);
-}
+#endif
 
 #endif
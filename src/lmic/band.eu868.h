@@ -5,6 +5,7 @@
 
 #include "bands.h"
 #include "bufferpack.h"
+#include "dutycycleledger.h"
 #include "osticks.h"
 #include <array>
 
@@ -14,7 +15,7 @@ public:
   void updateBandAvailability(uint8_t band, OsTime lastusage,
                               OsDeltaTime duration) final;
   void print_state() const;
-  OsTime getAvailability(uint8_t band) const final { return avail[band]; };
+  OsTime getAvailability(uint8_t band) const final;
 
   static constexpr uint8_t MAX_BAND = 3;
   uint8_t getBandForFrequency(uint32_t frequency) const final;
@@ -23,11 +24,21 @@ public:
 
   void saveState(StoringAbtract &store) const final;
   void loadState(RetrieveAbtract &store) final;
-  static constexpr uint16_t getStateSize();
+  static constexpr uint16_t getStateSize() {
+#if defined(LMIC_DUTY_CYCLE_WINDOW)
+    return DutyCycleLedger::getStateSize() * MAX_BAND;
+#else
+    return sizeof(OsTime) * MAX_BAND;
+#endif
+  };
 #endif
 
 private:
+#if defined(LMIC_DUTY_CYCLE_WINDOW)
+  std::array<DutyCycleLedger, MAX_BAND> ledgers;
+#else
   std::array<OsTime,MAX_BAND> avail;
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef _lmic_bitmask_h_
+#define _lmic_bitmask_h_
+
+#include <stdint.h>
+
+// number of bit set in mask
+constexpr uint8_t mask_count(uint16_t const mask) {
+  return static_cast<uint8_t>(__builtin_popcount(mask));
+}
+
+// index of the nth (from 0) bit set in mask, 16 if there is less bits set.
+constexpr uint8_t mask_select(uint16_t mask, uint8_t nth) {
+  for (uint8_t index = 0; mask != 0; index++, mask >>= 1) {
+    if ((mask & 1) != 0) {
+      if (nth == 0) {
+        return index;
+      }
+      nth--;
+    }
+  }
+  return 16;
+}
+
+#endif
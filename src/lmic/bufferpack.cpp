@@ -60,6 +60,8 @@ void StoringBuffer::store(void const *val, size_t const size) {
   current += size;
 }
 
+size_t RetrieveBuffer::length() const { return current - original; }
+
 void RetrieveBuffer::retrieve(void *val, size_t const size) {
   std::memcpy(val, current, size);
   current += size;
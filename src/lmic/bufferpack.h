@@ -37,26 +37,53 @@ uint16_t rmsbf2(const uint8_t *buf);
 //! Write 16-bit quantity into buffer in little endian byte order.
 void wlsbf2(uint8_t *buf, uint16_t value);
 
+/**
+ * Destination of saveState.
+ * When built on a contiguous buffer, write is an inline copy, else each field
+ * go through the virtual store.
+ */
 class StoringAbtract {
 public:
-  template <class T> void write(T const val) { store(&val, sizeof(T)); }
+  template <class T> void write(T const val) {
+    if (current) {
+      std::memcpy(current, &val, sizeof(T));
+      current += sizeof(T);
+    } else {
+      store(&val, sizeof(T));
+    }
+  }
 
 protected:
+  StoringAbtract() = default;
+  explicit StoringAbtract(uint8_t *const buffer) : current(buffer){};
   virtual void store(void const *val, size_t size) = 0;
+
+  uint8_t *current = nullptr;
 };
 
 class RetrieveAbtract {
 public:
-  template <class T> void read(T &val) { retrieve(&val, sizeof(T)); }
+  template <class T> void read(T &val) {
+    if (current) {
+      std::memcpy(&val, current, sizeof(T));
+      current += sizeof(T);
+    } else {
+      retrieve(&val, sizeof(T));
+    }
+  }
 
 protected:
+  RetrieveAbtract() = default;
+  explicit RetrieveAbtract(uint8_t const *const buffer) : current(buffer){};
   virtual void retrieve(void *val, size_t size) = 0;
+
+  uint8_t const *current = nullptr;
 };
 
 class StoringBuffer final : public StoringAbtract {
 public:
   explicit StoringBuffer(uint8_t *const buffer)
-      : original(buffer), current(buffer){};
+      : StoringAbtract(buffer), original(buffer){};
   size_t length() const;
 
 protected:
@@ -64,19 +91,19 @@ protected:
 
 private:
   uint8_t *const original;
-  uint8_t *current;
 };
 
 class RetrieveBuffer final : public RetrieveAbtract {
 public:
-  explicit RetrieveBuffer(uint8_t const *const buffer) : current(buffer){};
+  explicit RetrieveBuffer(uint8_t const *const buffer)
+      : RetrieveAbtract(buffer), original(buffer){};
   size_t length() const;
 
 protected:
   void retrieve(void *val, size_t size) final;
 
 private:
-  uint8_t const *current;
+  uint8_t const *const original;
 };
 
 /**
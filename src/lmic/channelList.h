@@ -2,6 +2,7 @@
 #define channel_list_h
 
 #include "bands.h"
+#include "bitmask.h"
 #include "bufferpack.h"
 #include "lorabase.h"
 #include <array>
@@ -9,14 +10,19 @@
 #include <stdint.h>
 
 struct ChannelDetail {
+public:
+  // two low bits of freq are used to store band (frequency is a multiple of
+  // 100Hz).
+  static constexpr uint32_t BAND_MASK = 0x3;
+
 private:
-  // three low bit of freq is used to store band.
   uint32_t frequency{};
   uint32_t frequencyRX{};
   uint16_t drMap{};
 
 public:
-  constexpr uint32_t getFrequency() const { return frequency; };
+  constexpr uint32_t getFrequency() const { return frequency & ~BAND_MASK; };
+  constexpr uint8_t getBand() const { return frequency & BAND_MASK; };
   constexpr uint32_t getFrequencyRX() const { return frequencyRX; };
   constexpr uint16_t getDrMap() const { return drMap; };
   constexpr bool isConfigured() const { return drMap != 0; }
@@ -24,8 +30,9 @@ public:
     return (drMap & (1 << datarate)) != 0;
   };
   constexpr ChannelDetail() = default;
-  constexpr ChannelDetail(uint32_t aFrequency, uint16_t adrMap)
-      : frequency(aFrequency), frequencyRX(aFrequency), drMap(adrMap){};
+  constexpr ChannelDetail(uint32_t aFrequency, uint16_t adrMap, uint8_t band)
+      : frequency((aFrequency & ~BAND_MASK) | band), frequencyRX(aFrequency),
+        drMap(adrMap){};
 
 #if defined(ENABLE_SAVE_RESTORE)
   void saveState(StoringAbtract &store) const {
@@ -56,15 +63,36 @@ public:
   constexpr static const uint8_t NB_FIXED_CHANNELS =
       sizeof...(defaultChannelFreq);
   constexpr static const uint16_t DEFAULT_CHANNEL_DR_MAP = defaultChannelDrMap;
+  static_assert(BandsType::MAX_BAND <= ChannelDetail::BAND_MASK + 1,
+                "band must fit in low bits of frequency");
 
 private:
   std::array<ChannelDetail, LIMIT_CHANNELS> channels = {};
   uint16_t channelMap = 0;
+  // channels configured in each band
+  std::array<uint16_t, BandsType::MAX_BAND> bandChannels = {};
+  // channels configured at each datarate
+  std::array<uint16_t, 16> drChannels = {};
   BandsType bands;
   bool checkDutyCycle = true;
 
   uint8_t getBand(uint8_t const channel) const {
-    return bands.getBandForFrequency(getFrequency(channel));
+    return channels[channel].getBand();
+  }
+
+  void updateChannelMasks() {
+    bandChannels = {};
+    drChannels = {};
+    for (uint8_t channel = 0; channel < LIMIT_CHANNELS; channel++) {
+      if (channels[channel].isConfigured()) {
+        bandChannels[getBand(channel)] |= 1 << channel;
+      }
+      for (uint8_t dr = 0; dr < drChannels.size(); dr++) {
+        if (channels[channel].isDrActive(dr)) {
+          drChannels[dr] |= 1 << channel;
+        }
+      }
+    }
   }
 
 public:
@@ -96,10 +124,57 @@ public:
 
   constexpr void configure(uint8_t channel, uint32_t const newfreq,
                            uint16_t const drmap) {
-    channels[channel] = ChannelDetail{newfreq, drmap};
+    auto const band = bands.getBandForFrequency(newfreq);
+    channels[channel] = ChannelDetail{newfreq, drmap, band};
+    for (auto &mask : bandChannels) {
+      mask &= ~(1 << channel);
+    }
+    bandChannels[band] |= 1 << channel;
+    for (uint8_t dr = 0; dr < drChannels.size(); dr++) {
+      if (drmap & (1 << dr)) {
+        drChannels[dr] |= 1 << channel;
+      } else {
+        drChannels[dr] &= ~(1 << channel);
+      }
+    }
     channelMap |= 1 << channel;
   }
 
+  // mask of channels enabled at datarate
+  constexpr uint16_t enabledAtDr(dr_t const datarate) const {
+    return drChannels[datarate] & channelMap;
+  }
+
+  // Earliest availability of channels in mask, one lookup per band.
+  // mask is reduced to channels available at the returned time.
+  OsTime earliestAvailability(uint16_t &mask, OsTime const now) const {
+    if (!checkDutyCycle) {
+      return now;
+    }
+    uint16_t ready = 0;
+    uint16_t earliestMask = 0;
+    OsTime earliest = now;
+    for (uint8_t band = 0; band < BandsType::MAX_BAND; band++) {
+      uint16_t const bandMask = mask & bandChannels[band];
+      if (bandMask == 0) {
+        continue;
+      }
+      auto const availability = bands.getAvailability(band);
+      if (availability <= now) {
+        ready |= bandMask;
+      } else if (earliestMask == 0 || availability < earliest) {
+        earliest = availability;
+        earliestMask = bandMask;
+      }
+    }
+    if (ready != 0) {
+      mask = ready;
+      return now;
+    }
+    mask = earliestMask;
+    return earliest;
+  }
+
   constexpr void updateAvailabitility(uint8_t const channel, OsTime const txbeg,
                                       OsDeltaTime const airtime) {
     // Update band specific duty cycle stats
@@ -148,11 +223,15 @@ public:
       channel.loadState(store);
     }
     store.read(channelMap);
+    updateChannelMasks();
   };
 
   static constexpr uint16_t getStateBytes() {
-    return BandsType::getStateSize() +
-           ChannelDetail::getStateSize() * LIMIT_CHANNELS + sizeof(channelMap);
+    return BandsType::getStateSize() + getStateBytesWithoutTimeData();
+  }
+
+  static constexpr uint16_t getStateBytesWithoutTimeData() {
+    return ChannelDetail::getStateSize() * LIMIT_CHANNELS + sizeof(channelMap);
   }
 #endif
 };
@@ -51,6 +51,12 @@ constexpr int debugLevel = 1;
 #define LMIC_MAX_BUFFER_LENGTH 64
 #endif
 
+// Current drawn by the radio in TX in mA, used to estimate the charge of
+// an uplink when planning (around 30 mA for SX1276 at 14 dBm).
+#ifndef LMIC_TX_CURRENT_MA
+#define LMIC_TX_CURRENT_MA 30
+#endif
+
 // Any runtime assertion failures are printed to this serial port (or
 // any other Print object). If this is unset, any failures just silently
 // halt execution.
@@ -0,0 +1,84 @@
+#include "dutycycleledger.h"
+
+namespace {
+// budget of one hour in units
+constexpr uint32_t HOUR_UNITS = 3600 * 1000 / 8;
+} // namespace
+
+DutyCycleLedger::DutyCycleLedger(OsTime const now) : headStart(now) {}
+
+uint8_t DutyCycleLedger::elapsed(OsTime const now) const {
+  auto const delta = (now - headStart).tick();
+  // negative after a wrap of the clock, all buckets are old.
+  if (delta < 0 || delta >= BUCKETS * BUCKET_DURATION.tick())
+    return BUCKETS;
+  return delta / BUCKET_DURATION.tick();
+}
+
+void DutyCycleLedger::add(OsTime const time, OsDeltaTime const airtime) {
+  uint8_t const count = elapsed(time);
+  if (count >= BUCKETS) {
+    buckets.fill(0);
+    head = 0;
+    headStart = time;
+  } else {
+    for (uint8_t i = 0; i < count; i++) {
+      head = (head + 1) % BUCKETS;
+      buckets[head] = 0;
+      headStart += BUCKET_DURATION;
+    }
+  }
+
+  lastUnits = (airtime.tick() + UNIT.tick() - 1) / UNIT.tick();
+  uint32_t const total = buckets[head] + lastUnits;
+  buckets[head] = total > UINT16_MAX ? UINT16_MAX : total;
+}
+
+OsDeltaTime DutyCycleLedger::used(OsTime const now) const {
+  uint8_t const count = elapsed(now);
+  uint32_t units = 0;
+  // bucket of age a is still in the window while a + count < BUCKETS
+  for (uint8_t age = 0; age + count < BUCKETS; age++) {
+    units += buckets[(head + BUCKETS - age) % BUCKETS];
+  }
+  return OsDeltaTime(units * UNIT.tick());
+}
+
+OsTime DutyCycleLedger::availability(OsTime const now,
+                                     uint16_t const dutyCycle) const {
+  uint32_t const budget = HOUR_UNITS / dutyCycle;
+  uint32_t units = lastUnits;
+  for (auto const bucket : buckets) {
+    units += bucket;
+  }
+
+  // wait for the oldest buckets to leave the window, bucket of age a leaves
+  // when BUCKETS - a buckets are elapsed. The edge found does not depend on
+  // now, it is in the past if the budget is already available.
+  OsTime edge = headStart;
+  for (uint8_t left = 1; units > budget && left <= BUCKETS; left++) {
+    units -= buckets[(head + left) % BUCKETS];
+    edge = headStart + OsDeltaTime(left * BUCKET_DURATION.tick());
+  }
+
+  // after a wrap of the clock headStart looks ahead of now.
+  if (elapsed(now) >= BUCKETS && now < edge)
+    return now - OsDeltaTime(BUCKETS * BUCKET_DURATION.tick());
+  return edge;
+}
+
+#if defined(ENABLE_SAVE_RESTORE)
+void DutyCycleLedger::saveState(StoringAbtract &store) const {
+  store.write(buckets);
+  store.write(lastUnits);
+  store.write(head);
+  store.write(headStart);
+}
+
+void DutyCycleLedger::loadState(RetrieveAbtract &store) {
+  store.read(buckets);
+  store.read(lastUnits);
+  store.read(head);
+  store.read(headStart);
+}
+#endif
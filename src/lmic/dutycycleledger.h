@@ -0,0 +1,57 @@
+#ifndef lmic_dutycycleledger_h
+#define lmic_dutycycleledger_h
+
+#include <stdint.h>
+
+#include "bufferpack.h"
+#include "osticks.h"
+#include <array>
+
+/**
+ * Airtime used in a band over a sliding window of one hour, in a ring of
+ * buckets of BUCKET_DURATION.
+ * A transmission is allowed while the airtime of the window plus the last
+ * transmission is in the budget (1/dutyCycle of the window), so bursts are
+ * possible as long as the hourly budget is respected.
+ * A bucket is kept until one window after its end, the window seen by the
+ * ledger is always longer than one hour.
+ */
+class DutyCycleLedger {
+public:
+  static constexpr uint8_t BUCKETS = 13;
+  static constexpr OsDeltaTime BUCKET_DURATION = OsDeltaTime::from_sec(300);
+  // Airtime is counted in units of 8 ms rounded up.
+  static constexpr OsDeltaTime UNIT = OsDeltaTime::from_ms(8);
+
+  explicit DutyCycleLedger(OsTime now);
+
+  void add(OsTime time, OsDeltaTime airtime);
+  // Earliest time a transmission is allowed. When it is already allowed, the
+  // time the budget became available: a time in the past not read from now,
+  // so callers comparing with a captured now agree.
+  OsTime availability(OsTime now, uint16_t dutyCycle) const;
+  // Airtime counted in the window at now.
+  OsDeltaTime used(OsTime now) const;
+
+#if defined(ENABLE_SAVE_RESTORE)
+  void saveState(StoringAbtract &store) const;
+  void loadState(RetrieveAbtract &store);
+  static constexpr uint16_t getStateSize() {
+    return sizeof(buckets) + sizeof(lastUnits) + sizeof(head) +
+           sizeof(headStart);
+  };
+#endif
+
+private:
+  // airtime units by bucket, head is the current bucket.
+  std::array<uint16_t, BUCKETS> buckets = {};
+  // airtime of last transmission, kept as margin for the next one.
+  uint16_t lastUnits = 0;
+  uint8_t head = 0;
+  OsTime headStart;
+
+  // number of buckets elapsed since head start.
+  uint8_t elapsed(OsTime now) const;
+};
+
+#endif
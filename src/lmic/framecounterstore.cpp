@@ -0,0 +1,166 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "framecounterstore.h"
+
+#include "../hal/print_debug.h"
+
+namespace {
+
+namespace offset {
+constexpr uint8_t generation = 0;
+constexpr uint8_t devaddr = 2;
+constexpr uint8_t up = 6;
+constexpr uint8_t dn = 10;
+constexpr uint8_t crc = 14;
+} // namespace offset
+
+uint32_t readU4(SnapshotStorage const &storage, uint16_t const offset) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    value |= static_cast<uint32_t>(storage.read(offset + i)) << (8 * i);
+  }
+  return value;
+}
+
+void putU2(uint8_t *const buffer, uint16_t const value) {
+  buffer[0] = static_cast<uint8_t>(value);
+  buffer[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void putU4(uint8_t *const buffer, uint32_t const value) {
+  putU2(buffer, static_cast<uint16_t>(value));
+  putU2(buffer + 2, static_cast<uint16_t>(value >> 16));
+}
+
+} // namespace
+
+FrameCounterStore::FrameCounterStore(SnapshotStorage &astorage,
+                                     uint16_t const acapacity,
+                                     uint16_t const areserve)
+    : storage(astorage), capacity(acapacity), reserve(areserve) {}
+
+bool FrameCounterStore::readRecord(uint16_t const slot, uint16_t &gen,
+                                   devaddr_t &addr, uint32_t &up,
+                                   uint32_t &dn) const {
+  uint16_t const base = slot * RECORD_SIZE;
+  uint16_t crc = CRC16_INIT;
+  for (uint8_t i = 0; i < offset::crc; i++) {
+    crc = crc16_update(crc, storage.read(base + i));
+  }
+  uint16_t const recordCrc = storage.read(base + offset::crc) |
+                             (storage.read(base + offset::crc + 1) << 8);
+  if (crc != recordCrc) {
+    return false;
+  }
+  gen = storage.read(base + offset::generation) |
+        (storage.read(base + offset::generation + 1) << 8);
+  addr = readU4(storage, base + offset::devaddr);
+  up = readU4(storage, base + offset::up);
+  dn = readU4(storage, base + offset::dn);
+  return true;
+}
+
+void FrameCounterStore::scan() {
+  scanned = true;
+  currentSlot = NO_SLOT;
+  for (uint16_t slot = 0; slot < slotCount(); slot++) {
+    uint16_t gen;
+    devaddr_t addr;
+    uint32_t up;
+    uint32_t dn;
+    if (!readRecord(slot, gen, addr, up, dn)) {
+      continue;
+    }
+    // generation wrap around, newest is ahead of the others.
+    if (currentSlot == NO_SLOT ||
+        static_cast<int16_t>(gen - generation) > 0) {
+      currentSlot = slot;
+      generation = gen;
+      recordDevaddr = addr;
+      upLimit = up;
+      recordDn = dn;
+    }
+  }
+}
+
+void FrameCounterStore::writeRecord(devaddr_t const addr, uint32_t const up,
+                                    uint32_t const dn) {
+  if (slotCount() == 0) {
+    PRINT_DEBUG(1, F("Frame counter storage too small"));
+    return;
+  }
+  uint16_t const slot =
+      currentSlot == NO_SLOT ? 0 : (currentSlot + 1) % slotCount();
+  uint16_t const gen = currentSlot == NO_SLOT ? 0 : generation + 1;
+
+  uint8_t record[RECORD_SIZE];
+  putU2(record + offset::generation, gen);
+  putU4(record + offset::devaddr, addr);
+  putU4(record + offset::up, up);
+  putU4(record + offset::dn, dn);
+  uint16_t crc = CRC16_INIT;
+  for (uint8_t i = 0; i < offset::crc; i++) {
+    crc = crc16_update(crc, record[i]);
+  }
+  putU2(record + offset::crc, crc);
+
+  // CRC last, a partial write leave an invalid record.
+  uint16_t const base = slot * RECORD_SIZE;
+  for (uint8_t i = 0; i < RECORD_SIZE; i++) {
+    storage.write(base + i, record[i]);
+  }
+
+  currentSlot = slot;
+  generation = gen;
+  recordDevaddr = addr;
+  upLimit = up;
+  recordDn = dn;
+  writeCount++;
+  PRINT_DEBUG(2, F("Frame counters reserved up to %" PRIu32 " in slot %d"),
+              up, slot);
+}
+
+bool FrameCounterStore::restore(devaddr_t const devaddr, uint32_t &seqnoUp,
+                                uint32_t &seqnoDn) {
+  if (!scanned) {
+    scan();
+  }
+  if (currentSlot == NO_SLOT || recordDevaddr != devaddr) {
+    return false;
+  }
+  seqnoUp = upLimit;
+  seqnoDn = recordDn;
+  return true;
+}
+
+void FrameCounterStore::update(devaddr_t const devaddr, uint32_t const seqnoUp,
+                               uint32_t const seqnoDn) {
+  if (!scanned) {
+    scan();
+  }
+  if (currentSlot != NO_SLOT && recordDevaddr == devaddr &&
+      seqnoUp <= upLimit) {
+    return;
+  }
+  reserveFrom(devaddr, seqnoUp, seqnoDn);
+}
+
+void FrameCounterStore::startSession(devaddr_t const devaddr,
+                                     uint32_t const seqnoUp,
+                                     uint32_t const seqnoDn) {
+  if (!scanned) {
+    scan();
+  }
+  reserveFrom(devaddr, seqnoUp, seqnoDn);
+}
+
+void FrameCounterStore::reserveFrom(devaddr_t const devaddr,
+                                    uint32_t const seqnoUp,
+                                    uint32_t const seqnoDn) {
+  // counters seqnoUp - 1 to limit - 1 are reserved.
+  uint32_t const limit =
+      seqnoUp > UINT32_MAX - reserve ? UINT32_MAX : seqnoUp - 1 + reserve;
+  writeRecord(devaddr, limit, seqnoDn);
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef _framecounterstore_h_
+#define _framecounterstore_h_
+
+#include "lorabase.h"
+#include "snapshotstorage.h"
+#include <stdint.h>
+
+/**
+ * Persist the frame counters of a session without a write per uplink.
+ *
+ * The store reserves a block of reserve uplink counters: it writes the end
+ * of the block once, then the next uplinks are sent without writing. After a power loss
+ * the uplink counter restart at the end of the reserved block, some
+ * counters are skipped but never reused.
+ * The downlink counter is written with each reservation (class A receive at
+ * most one downlink per uplink, a restored downlink counter is late by at
+ * most reserve frames).
+ *
+ * Records (16 bytes, little endian: generation, devaddr, up limit, down
+ * counter, CRC16) are written in turn in each slot of the storage, the
+ * record with the highest generation and a good CRC is the current one.
+ * A record partially written by a power loss fail the CRC check, the
+ * previous one is used.
+ * Used with Lmic::setFrameCounterStore.
+ */
+class FrameCounterStore {
+public:
+  static constexpr uint8_t RECORD_SIZE = 16;
+
+  FrameCounterStore(SnapshotStorage &storage, uint16_t capacity,
+                    uint16_t reserve = 32);
+
+  /**
+   * Counters saved for the session devaddr.
+   * Return false (counters unchanged) if there is no valid record for it.
+   */
+  bool restore(devaddr_t devaddr, uint32_t &seqnoUp, uint32_t &seqnoDn);
+  /**
+   * Called before sending an uplink with counter seqnoUp - 1, write a new
+   * record if the counter is not in the reserved block.
+   */
+  void update(devaddr_t devaddr, uint32_t seqnoUp, uint32_t seqnoDn);
+  /**
+   * Called when a session start (join accept), write a new record even if
+   * devaddr is the one of the previous session.
+   */
+  void startSession(devaddr_t devaddr, uint32_t seqnoUp, uint32_t seqnoDn);
+
+  uint16_t slotCount() const { return capacity / RECORD_SIZE; };
+  // number of records written since construction.
+  uint16_t recordWriteCount() const { return writeCount; };
+
+private:
+  static constexpr uint16_t NO_SLOT = 0xFFFF;
+
+  SnapshotStorage &storage;
+  uint16_t const capacity;
+  uint16_t const reserve;
+  uint16_t writeCount = 0;
+
+  bool scanned = false;
+  // slot of the current record, NO_SLOT if none.
+  uint16_t currentSlot = NO_SLOT;
+  uint16_t generation = 0;
+  devaddr_t recordDevaddr = 0;
+  uint32_t upLimit = 0;
+  uint32_t recordDn = 0;
+
+  void scan();
+  bool readRecord(uint16_t slot, uint16_t &gen, devaddr_t &addr, uint32_t &up,
+                  uint32_t &dn) const;
+  void writeRecord(devaddr_t addr, uint32_t up, uint32_t dn);
+  void reserveFrom(devaddr_t addr, uint32_t up, uint32_t dn);
+};
+
+#endif
@@ -19,11 +19,20 @@
 #include "lorawanpacket.h"
 #include "radio.h"
 #include <algorithm>
+#include <cstring>
 
 using namespace lorawan;
 
 constexpr uint8_t MINRX_SYMS = 5;
 constexpr uint8_t PAMBL_SYMS = 8;
+// symbols for sync word (4.25) and header after the preamble.
+constexpr uint8_t SYNC_HEADER_SYMS = 13;
+// symbols of preamble needed by the radio to detect it.
+constexpr uint8_t PAMBL_LOCK_SYMS = 4;
+// class C rx duty cycle, number of symbols listened each period.
+constexpr uint8_t RXC_SNIFF_SYMS = 2;
+// time for the radio to go from sleep to rx.
+constexpr OsDeltaTime RXC_SNIFF_WAKEUP = OsDeltaTime::from_us(1000);
 
 static CONST_TABLE(uint8_t, SENSITIVITY)[7][3] = {
     // TODO check where this value come from.
@@ -53,47 +62,6 @@ OsDeltaTime Lmic::timeBySymbol(rps_t rps) {
   return OsDeltaTime::from_us(256 * (1 << (1 + rps.sf - rps.bwRaw)));
 }
 
-OsDeltaTime Lmic::calcAirTime(rps_t rps, uint8_t plen) {
-  // BW 0,1,2 = 125,250,500kHz
-  const uint8_t bw = rps.bwRaw;
-  // SF 7..12 = SF7..12
-  const uint8_t sf = 7 + rps.sf - SF7;
-  const uint8_t sfx = 4 * sf;
-  const uint8_t optimiseLowSf = (rps.sf >= SF11 ? 8 : 0);
-  const uint8_t q = sfx - optimiseLowSf;
-
-  int16_t tmp = 8 * plen - sfx + 28 + (rps.nocrc ? 0 : 16);
-  if (tmp > 0) {
-    tmp = (tmp + q - 1) / q;
-    tmp *= (rps.crRaw + 5);
-    tmp += 8;
-  } else {
-    tmp = 8;
-  }
-  tmp = (tmp << 2) + /*preamble*/ 49 /* 4 * (8 + 4.25) */;
-  // bw = 125000 = 15625 * 2^3
-  //      250000 = 15625 * 2^4
-  //      500000 = 15625 * 2^5
-  // sf = 7..12
-  //
-  // osticks =  tmp * OSTICKS_PER_SEC * 1<<sf / bw
-  //
-  // 3 => counter reduced divisor 125000/8 => 15625
-  // 2 => counter 2 shift on tmp
-  uint8_t sfx2 = sf - (3 + 2) - bw;
-  uint16_t div = 15625;
-  if (sfx2 > 4) {
-    // prevent 32bit signed int overflow in last step
-    div >>= sfx2 - 4;
-    sfx2 = 4;
-  }
-  // Need 32bit arithmetic for this last step
-  OsDeltaTime val =
-      OsDeltaTime((((int32_t)tmp << sfx2) * OSTICKS_PER_SEC + div / 2) / div);
-  PRINT_DEBUG(1, F("Time on air : %i ms"), val.to_ms());
-  return val;
-}
-
 // Adjust DR for TX retries
 //  - indexed by retry count
 //  - return steps to lower DR
@@ -424,6 +392,15 @@ Lmic::SeqNoValidity Lmic::check_seq_no(const uint32_t seqno,
   if (diff == 0)
     return SeqNoValidity::ok;
 
+  // LoRaWAN 1.0.4 removed MAX_FCNT_GAP, only counters in the upper half of
+  // the 16 bit range (older than expected) are rejected.
+  const int32_t maxGap = lorawan_v104 ? INT16_MAX : MAX_FCNT_GAP;
+  if (diff > maxGap) {
+    PRINT_DEBUG(1, F("Packet counter %" PRIu32 " too far from %" PRIu32),
+                seqno, seqnoDn);
+    return SeqNoValidity::invalid;
+  }
+
   if (diff > 0) {
     // skip in sequence number, missed packet
     PRINT_DEBUG(1, F("Current packet receive %" PRIu32 " expected %" PRIu32),
@@ -445,6 +422,7 @@ Lmic::SeqNoValidity Lmic::check_seq_no(const uint32_t seqno,
 // ================================================================================
 // Decoding frames
 bool Lmic::decodeFrame() {
+  auto &rx = rxBuffer();
 
   if (txrxFlags.test(TxRxStatus::DNW1)) {
     PRINT_DEBUG(1, F("Decode Frame RX1"));
@@ -454,30 +432,42 @@ bool Lmic::decodeFrame() {
     PRINT_DEBUG(1, F("Decode Frame RXC"));
   }
 
+  if (txrxFlags.test(TxRxStatus::DNW1) || txrxFlags.test(TxRxStatus::DNW2)) {
+    // RX1 of a poll sent at fast drain datarate is done.
+    restoreFastDrainDr();
+  }
+
   if (dataLen == 0) {
     PRINT_DEBUG(1, F("No downlink data"));
     return false;
   }
 
-  const uint8_t hdr = frame[0];
+  const uint8_t hdr = rx[0];
   const uint8_t ftype = hdr & mhdr::ftype_mask;
   const uint8_t dlen = dataLen;
 
-  if (dlen < mac_payload::offsets::fopts + lengths::MIC ||
-      (hdr & mhdr::major_mask) != mhdr::major_v1 ||
+  // Cheap checks first, only a frame which pass all of them cost a CMAC.
+  if ((hdr & mhdr::major_mask) != mhdr::major_v1 ||
       (ftype != mhdr::ftype_data_down && ftype != mhdr::ftype_data_conf_down)) {
-    // Basic sanity checks failed
     PRINT_DEBUG(1, F("Invalid downlink"));
+    downlinkFilterStats.badHeader++;
     return false;
   }
 
-  const uint32_t addr = rlsbf4(frame.cbegin() + mac_payload::offsets::devAddr);
+  if (dlen < mac_payload::offsets::fopts + lengths::MIC) {
+    PRINT_DEBUG(1, F("Downlink too short"));
+    downlinkFilterStats.badLength++;
+    return false;
+  }
+
+  const uint32_t addr = rlsbf4(rx.cbegin() + mac_payload::offsets::devAddr);
   if (addr != devaddr) {
     PRINT_DEBUG(1, F("Invalid address"));
+    downlinkFilterStats.otherAddress++;
     return false;
   }
 
-  const uint8_t fct = frame[mac_payload::offsets::fctrl];
+  const uint8_t fct = rx[mac_payload::offsets::fctrl];
   const uint8_t olen = fct & FCT_OPTLEN;
   const bool ackup = (fct & FCT_ACK) != 0 ? true : false; // ACK last up frame
   const uint8_t poff = mac_payload::offsets::fopts + olen;
@@ -485,30 +475,35 @@ bool Lmic::decodeFrame() {
 
   if (poff > pend) {
     PRINT_DEBUG(1, F("Invalid data offset"));
+    downlinkFilterStats.badFOpts++;
     return false;
   }
 
-  const uint32_t seqno =
-      read_seqno(frame.cbegin() + mac_payload::offsets::fcnt);
-
-  if (!aes.verifyMic(devaddr, seqno, PktDir::DOWN, frame.cbegin(), dlen)) {
-    PRINT_DEBUG(1, F("Fail to verify aes mic"));
+  if (olen > 0 && txrxFlags.test(TxRxStatus::DNWC)) {
+    PRINT_DEBUG(1, F("Mac command forbiden in class C RX"));
+    downlinkFilterStats.badFOpts++;
     return false;
   }
 
+  const uint32_t seqno =
+      read_seqno(rx.cbegin() + mac_payload::offsets::fcnt);
+
   const auto checkseqnoresult = check_seq_no(seqno, ftype);
-  if (checkseqnoresult == SeqNoValidity::invalid)
+  if (checkseqnoresult == SeqNoValidity::invalid) {
+    downlinkFilterStats.badCounter++;
     return false;
+  }
   const bool replayConf = checkseqnoresult == SeqNoValidity::previous;
 
-  // next number to be expected
-  seqnoDn = seqno + 1;
-
-  if (olen > 0 && txrxFlags.test(TxRxStatus::DNWC)) {
-    PRINT_DEBUG(1, F("Mac command forbiden in class C RX"));
+  if (!aes.verifyMic(devaddr, seqno, PktDir::DOWN, rx.cbegin(), dlen)) {
+    PRINT_DEBUG(1, F("Fail to verify aes mic"));
+    downlinkFilterStats.badMic++;
     return false;
   }
 
+  // next number to be expected
+  seqnoDn = seqno + 1;
+
   // remove sticky FOpts response because we receive a frame.
   pendTxFOptsLen = 0;
 
@@ -516,20 +511,26 @@ bool Lmic::decodeFrame() {
   dnConf = ftype == mhdr::ftype_data_conf_down ? FCT_ACK : 0;
   if (dnConf || (fct & FCT_MORE))
     opmode.set(OpState::POLL);
+  if (!replayConf) {
+    trackFastDrain((fct & FCT_MORE) != 0, pend > poff ? pend - poff - 1 : 0);
+  }
 
-  parseMacCommands(frame.cbegin() + mac_payload::offsets::fopts, olen,
+  parseMacCommands(rx.cbegin() + mac_payload::offsets::fopts, olen,
                    pendTxFOpts.begin(), pendTxFOptsLen);
 
   if (!replayConf) {
     // Handle payload only if not a replay
     if (pend > poff) {
-      const auto port = frame[poff];
+      const auto port = rx[poff];
       dataBeg = poff + 1;
       dataLen = pend - dataBeg;
-      // Decrypt payload - if any
-      aes.framePayloadEncryption(port, devaddr, seqno, PktDir::DOWN,
-                                 frame.begin() + dataBeg, dataLen);
+      dataSeqno = seqno;
+      dataClearLen = 0;
       txrxFlags.set(TxRxStatus::PORT);
+      if (port == 0) {
+        // MAC commands are needed now, application data when read.
+        decryptData(dataLen);
+      }
 
       if (port == 0 && txrxFlags.test(TxRxStatus::DNWC)) {
         PRINT_DEBUG(1, F("Mac command forbiden in class C RX"));
@@ -540,8 +541,11 @@ bool Lmic::decodeFrame() {
         // trash current response and replace with response to MAC command
         pendTxLen = 0;
         pendTxPort = 0;
-        parseMacCommands(frame.cbegin() + dataBeg, dataLen, pendTxData.begin(),
-                         pendTxLen);
+        // leave room for fopts before the response.
+        parseMacCommands(
+            rx.cbegin() + dataBeg, dataLen,
+            pendTxDestination(mac_payload::offsets::fopts + 1 + MAX_LEN_FOPTS),
+            pendTxLen);
         setTxData();
       }
     } else {
@@ -573,6 +577,37 @@ bool Lmic::decodeFrame() {
   return true;
 }
 
+void Lmic::decryptData(uint8_t const count) const {
+  if (!txrxFlags.test(TxRxStatus::PORT) || count <= dataClearLen) {
+    return;
+  }
+  // whole AES blocks, counter mode is decrypted from a block boundary.
+  uint16_t const blocksEnd =
+      (count + AES_BLCK_SIZE - 1) / AES_BLCK_SIZE * AES_BLCK_SIZE;
+  uint8_t const end = std::min<uint16_t>(blocksEnd, dataLen);
+  auto &rx = decryptBuffer();
+  aes.framePayloadEncryption(rx[dataBeg - 1], devaddr, dataSeqno, PktDir::DOWN,
+                             rx.begin() + dataBeg + dataClearLen,
+                             end - dataClearLen, dataClearLen / AES_BLCK_SIZE);
+  dataClearLen = end;
+}
+
+uint8_t DownlinkView::port() const { return lmic.getPort(); }
+
+uint8_t DownlinkView::length() const {
+  return lmic.txrxFlags.test(TxRxStatus::PORT) ? lmic.dataLen : 0;
+}
+
+uint8_t const *DownlinkView::data() const { return peek(length()); }
+
+uint8_t const *DownlinkView::peek(uint8_t const count) const {
+  if (lmic.dataBeg == 0) {
+    return nullptr;
+  }
+  lmic.decryptData(std::min(count, length()));
+  return lmic.rxBuffer().cbegin() + lmic.dataBeg;
+}
+
 // ================================================================================
 // TX/RX transaction support
 
@@ -581,6 +616,7 @@ void Lmic::setupRx1() {
   dataLen = 0;
   auto parameters = channelParams.getRx1Parameter();
   radio.rx(parameters.frequency, parameters.rps, rxsyms, rxtime);
+  setRxDeadlines(parameters.rps);
   wait_end_rx();
 }
 
@@ -589,9 +625,21 @@ void Lmic::setupRx2() {
   dataLen = 0;
   auto parameters = channelParams.getRx2Parameter();
   radio.rx(parameters.frequency, parameters.rps, rxsyms, rxtime);
+  setRxDeadlines(parameters.rps);
   wait_end_rx();
 }
 
+// A preamble sent on time start (rxsyms - PAMBL_SYMS) / 2 symbols after
+// rxtime (see schedRx12) and is detected PAMBL_LOCK_SYMS later, plus half a
+// symbol for the polling of the radio. The part of the window widened for a
+// late clock (setClockError) is not listened.
+void Lmic::setRxDeadlines(rps_t const rps) {
+  const OsDeltaTime hsym = OsDeltaTime(timeBySymbol(rps).tick() / 2);
+  rxPreambleDeadline =
+      rxtime + (rxsyms - PAMBL_SYMS + 2 * PAMBL_LOCK_SYMS + 1) * hsym;
+  rxPreambleSeen = false;
+}
+
 void Lmic::setupRxC() {
   if (!isClassCActive())
     return;
@@ -599,6 +647,21 @@ void Lmic::setupRxC() {
   txrxFlags.reset().set(TxRxStatus::DNWC);
   dataLen = 0;
   auto parameters = channelParams.getRx2Parameter();
+  if (rxcDutyCycle) {
+    // Listen RXC_SNIFF_SYMS symbols, then sleep so that the next listen
+    // still start before the end of a preamble which has started just after
+    // the previous listen.
+    const OsDeltaTime symbol = timeBySymbol(parameters.rps);
+    const OsDeltaTime rxPeriod = RXC_SNIFF_SYMS * symbol;
+    const OsDeltaTime sleepPeriod =
+        (PAMBL_SYMS - 2 * RXC_SNIFF_SYMS) * symbol - RXC_SNIFF_WAKEUP;
+    if (sleepPeriod > OsDeltaTime(0)) {
+      radio.rx_duty_cycle(parameters.frequency, parameters.rps, rxPeriod,
+                          sleepPeriod);
+      return;
+    }
+    // symbol too short to sleep between listen.
+  }
   radio.rx(parameters.frequency, parameters.rps);
 }
 
@@ -695,10 +758,11 @@ void Lmic::processJoinAcceptNoJoinFrame() {
 }
 
 bool Lmic::processJoinAccept() {
+  auto &rx = rxBuffer();
   PRINT_DEBUG(2, F("Process join accept."));
   ASSERT(opmode.test(OpState::TXRXPEND));
 
-  const uint8_t hdr = frame[0];
+  const uint8_t hdr = rx[0];
   const uint8_t dlen = dataLen;
 
   if (dataLen == 0) {
@@ -715,24 +779,26 @@ bool Lmic::processJoinAccept() {
     return false;
   }
 
-  aes.encrypt(frame.begin() + 1, dlen - 1);
-  if (!aes.verifyMic0(frame.cbegin(), dlen)) {
+  aes.encrypt(rx.begin() + 1, dlen - 1);
+  if (!aes.verifyMic0(rx.cbegin(), dlen)) {
     PRINT_DEBUG(1, F("Join Accept BAD MIC"));
 
     // bad mic
     return false;
   }
 
-  devaddr = rlsbf4(frame.cbegin() + join_accept::offset::devAddr);
-  netid = rlsbf4(frame.cbegin() + join_accept::offset::netId) & 0xFFFFFF;
+  devaddr = rlsbf4(rx.cbegin() + join_accept::offset::devAddr);
+  netid = rlsbf4(rx.cbegin() + join_accept::offset::netId) & 0xFFFFFF;
+  channelParams.joinAccepted(radio.get_last_packet_rssi(),
+                             (radio.get_last_packet_snr_x4() + 2) / 4);
 
   if (dlen > join_accept::lengths::total) {
     // some region just ignore cflist.
-    channelParams.handleCFList(frame.cbegin() + join_accept::offset::cfList);
+    channelParams.handleCFList(rx.cbegin() + join_accept::offset::cfList);
   }
 
   // already incremented when JOIN REQ got sent off
-  aes.sessKeys(devNonce - 1, frame.cbegin() + join_accept::offset::appNonce);
+  aes.sessKeys(devNonce - 1, rx.cbegin() + join_accept::offset::appNonce);
 
   ASSERT(opmode.test(OpState::JOINING));
 
@@ -741,12 +807,17 @@ bool Lmic::processJoinAccept() {
 
   txCnt = 0;
   stateJustJoined();
+  if (frameCounterStore) {
+    // a rejoin may give the same devaddr, the counters of the previous
+    // session must not be restored.
+    frameCounterStore->startSession(devaddr, seqnoUp, seqnoDn);
+  }
 
-  const uint8_t dlSettings = frame[join_accept::offset::dlSettings];
+  const uint8_t dlSettings = rx[join_accept::offset::dlSettings];
   channelParams.setRx2DataRate(dlSettings & 0x0F);
   channelParams.setRx1DrOffset((dlSettings >> 4) & 0x7);
 
-  const uint8_t configuredRxDelay = frame[join_accept::offset::rxDelay];
+  const uint8_t configuredRxDelay = rx[join_accept::offset::rxDelay];
   if (configuredRxDelay == 0) {
     rxDelay = OsDeltaTime::from_sec(DELAY_DNW1);
   } else {
@@ -867,30 +938,111 @@ void Lmic::resetAdrCount() {
   }
 }
 
-void Lmic::buildDataFrame() {
+uint32_t Lmic::nextSeqnoUp() const {
+  // in lorawan version 1.0.4 in case of resend
+  // the frame counter is increased.
+  return (txCnt == 0 || lorawan_v104) ? seqnoUp : seqnoUp - 1;
+}
+
+uint8_t Lmic::dataFrameFctrl(uint8_t const foptsLen) const {
+  return dnConf | (adrAckReq != LINK_CHECK_OFF ? FCT_ADREN : 0) |
+         (adrAckReq >= 0 ? FCT_ADRARQ : 0) | foptsLen;
+}
+
+bool Lmic::buildDataFrame() {
+  bool withData;
+#if defined(LMIC_PIPELINED_TX)
+  if (stagedFrameValid()) {
+    PRINT_DEBUG(2, F("Use staged frame"));
+    withData = stagedWithData;
+    commitDataFrame(stagedLength, withData);
+  } else {
+    auto const flen = composeDataFrame(nextSeqnoUp(), withData);
+    commitDataFrame(flen, withData);
+  }
+  frameStaged = false;
+#else
+  auto const flen = composeDataFrame(nextSeqnoUp(), withData);
+  commitDataFrame(flen, withData);
+#endif
+#if defined(LMIC_SINGLE_BUFFER)
+  // payload overwritten by FOpts, nothing left to delay.
+  return true;
+#else
+  return withData || !opmode.test(OpState::TXDATA);
+#endif
+}
+
+uint8_t Lmic::composeDataFrame(uint32_t const current_seq_no, bool &withData) {
 
   uint8_t *pos = frame.begin() + mac_payload::offsets::fopts;
   bool txdata = opmode.test(OpState::TXDATA);
 
+  if (txdata && pendTxInFrame && pendTxSealed) {
+    // retry of confirmed frame, restore clear payload (same counter).
+    aes.framePayloadEncryption(pendTxPort, devaddr, seqnoUp - 1, PktDir::UP,
+                               frame.begin() + pendTxFrameOffset, pendTxLen);
+    pendTxSealed = false;
+  }
+
+  if (txdata && pendTxInFrame) {
+    // Fopts may have changed since reservation, move payload after them.
+    uint8_t const offset = mac_payload::offsets::fopts + pendTxFOptsLen + 1;
+    if (static_cast<size_t>(offset + pendTxLen + lengths::MIC) <=
+        frame.max_size()) {
+      auto const source = frame.begin() + pendTxFrameOffset;
+      if (offset < pendTxFrameOffset) {
+        std::copy(source, source + pendTxLen, frame.begin() + offset);
+      } else if (offset > pendTxFrameOffset) {
+        std::copy_backward(source, source + pendTxLen,
+                           frame.begin() + offset + pendTxLen);
+      }
+      pendTxFrameOffset = offset;
+#if !defined(LMIC_SINGLE_BUFFER)
+    } else {
+      // FOpts grew since the reservation, the frame carry only FOpts: keep
+      // the payload out of the frame for the next uplink.
+      auto const source = frame.begin() + pendTxFrameOffset;
+      std::copy(source, source + pendTxLen, pendTxData.begin());
+      pendTxInFrame = false;
+      pendTxFrameOffset = 0;
+#endif
+    }
+  }
+
   if (!txdata || pendTxPort != 0) {
     // Piggyback MAC options
     std::copy(pendTxFOpts.begin(), pendTxFOpts.begin() + pendTxFOptsLen, pos);
     pos += pendTxFOptsLen;
+  } else if (pendTxInFrame) {
+    // payload is just after the place of fopts, mac commands go before.
+    if (pendTxFrameOffset ==
+        mac_payload::offsets::fopts + pendTxFOptsLen + 1) {
+      std::copy(pendTxFOpts.begin(), pendTxFOpts.begin() + pendTxFOptsLen,
+                pos + 1);
+      pendTxFrameOffset = mac_payload::offsets::fopts + 1;
+      pendTxLen += pendTxFOptsLen;
+    }
+#if !defined(LMIC_SINGLE_BUFFER)
   } else if (pendTxLen + pendTxFOptsLen < pendTxData.size()) {
     // add to current tx frame (it's already mac commands)
     std::copy(pendTxFOpts.begin(), pendTxFOpts.begin() + pendTxFOptsLen,
               pendTxData.begin());
     pendTxLen += pendTxFOptsLen;
+#endif
   }
 
   const uint8_t end = pos - frame.cbegin();
 
   ASSERT(end <= mac_payload::offsets::fopts + 16);
 
-  uint8_t flen = end + (txdata ? 1 + lengths::MIC + pendTxLen : lengths::MIC);
-  if (flen > frame.max_size()) {
+  // 16 bits, payload and FOpts may exceed 255 bytes.
+  uint16_t const length =
+      end + (txdata ? 1 + lengths::MIC + pendTxLen : lengths::MIC);
+  uint8_t flen = length;
+  if (length > frame.max_size()) {
     // Options and payload too big - delay payload
-    PRINT_DEBUG(1, F("buildDataFrame: frame too big %i > %i"), flen,
+    PRINT_DEBUG(1, F("buildDataFrame: frame too big %i > %i"), length,
                 (uint8_t)frame.max_size());
 
     txdata = false;
@@ -899,49 +1051,113 @@ void Lmic::buildDataFrame() {
 
   frame[offsets::MHDR] = mhdr::ftype_data_up | mhdr::major_v1;
   frame[mac_payload::offsets::fctrl] =
-      (dnConf | (adrAckReq != LINK_CHECK_OFF ? FCT_ADREN : 0) |
-       (adrAckReq >= 0 ? FCT_ADRARQ : 0) | (end - mac_payload::offsets::fopts));
+      dataFrameFctrl(end - mac_payload::offsets::fopts);
   wlsbf4(frame.begin() + mac_payload::offsets::devAddr, devaddr);
 
-  // in lorawan version 1.0.4 in case of resend
-  // the frame counter is increased.
-  if (txCnt == 0 || lorawan_v104) {
-    seqnoUp++;
-  }
-  const uint32_t current_seq_no = seqnoUp - 1;
   wlsbf2(frame.begin() + mac_payload::offsets::fcnt, current_seq_no);
 
-  // Clear pending DN confirmation
-  dnConf = 0;
-
   if (txdata) {
     if (pendTxConf) {
       // Confirmed only makes sense if we have a payload (or at least a port)
       frame[offsets::MHDR] = mhdr::ftype_data_conf_up | mhdr::major_v1;
-      if (txCnt == 0)
-        txCnt = 1;
     }
     uint8_t *buffer_pos = frame.begin() + end;
 
     *(buffer_pos++) = pendTxPort;
-    std::copy(begin(pendTxData), begin(pendTxData) + pendTxLen, buffer_pos);
+#if !defined(LMIC_SINGLE_BUFFER)
+    if (!pendTxInFrame) {
+      std::copy(begin(pendTxData), begin(pendTxData) + pendTxLen, buffer_pos);
+    }
+#endif
+    if (txCnt == 0 && !pendTxConf && pendTxPort == 0) {
+      // clear mac commands are needed.
+      keep_sticky_mac_response(buffer_pos, pendTxLen);
+    }
     aes.framePayloadEncryption(pendTxPort, devaddr, current_seq_no, PktDir::UP,
                                buffer_pos, pendTxLen);
+    if (pendTxInFrame) {
+      // Only the single buffer mode keep confirmed data in frame.
+      pendTxSealed = pendTxConf;
+      if (!pendTxSealed) {
+        pendTxInFrame = false;
+        pendTxFrameOffset = 0;
+      }
+    }
   }
   aes.appendMic(devaddr, current_seq_no, PktDir::UP, frame.begin(), flen);
 
-  dataLen = flen;
+  withData = txdata;
+  return flen;
+}
 
-  if (txCnt == 0) {
-    if (txdata && pendTxPort == 0) {
-      keep_sticky_mac_response(pendTxData.begin(), pendTxLen);
-    } else {
-      keep_sticky_mac_response(pendTxFOpts.begin(), pendTxFOptsLen);
-    }
+void Lmic::commitDataFrame(uint8_t const length, bool const withData) {
+  if (txCnt == 0 || lorawan_v104) {
+    seqnoUp++;
+  }
+  if (frameCounterStore) {
+    // persisted before the frame is sent.
+    frameCounterStore->update(devaddr, seqnoUp, seqnoDn);
+  }
+  // Clear pending DN confirmation
+  dnConf = 0;
+  if (withData && pendTxConf && txCnt == 0) {
+    txCnt = 1;
   }
 
-  PRINT_DEBUG(1, F("Build pkt # %" PRIu32), current_seq_no);
+  dataLen = length;
+
+  if (txCnt == 0 && !(withData && pendTxPort == 0)) {
+    keep_sticky_mac_response(pendTxFOpts.begin(), pendTxFOptsLen);
+  }
+
+  PRINT_DEBUG(1, F("Build pkt # %" PRIu32), seqnoUp - 1);
+}
+
+#if defined(LMIC_PIPELINED_TX)
+void Lmic::stageDataFrame() {
+  bool const txdata = opmode.test(OpState::TXDATA);
+  if (stagedFrameValid() || (!txdata && !opmode.test(OpState::POLL))) {
+    return;
+  }
+  // Payload kept in frame is moved and sealed in place, MAC commands on
+  // port 0 are merged in the payload: these frames are built at send time.
+  if (pendTxInFrame || (txdata && pendTxPort == 0)) {
+    return;
+  }
+  stagedSeqno = nextSeqnoUp();
+  stagedLength = composeDataFrame(stagedSeqno, stagedWithData);
+  stagedDr = channelParams.getTxDr();
+  frameStaged = true;
+  PRINT_DEBUG(2, F("Staged frame # %" PRIu32), stagedSeqno);
+}
+
+bool Lmic::stagedFrameValid() const {
+  if (!frameStaged || stagedSeqno != nextSeqnoUp() ||
+      stagedDr != channelParams.getTxDr() ||
+      rlsbf4(frame.cbegin() + mac_payload::offsets::devAddr) != devaddr) {
+    return false;
+  }
+  // MHDR and port of the pending data unchanged (a poll staged before an
+  // uplink taken from the queue).
+  bool const txdata = opmode.test(OpState::TXDATA);
+  uint8_t const mhdr =
+      (txdata && pendTxConf ? mhdr::ftype_data_conf_up : mhdr::ftype_data_up) |
+      mhdr::major_v1;
+  if (stagedWithData != txdata || frame[offsets::MHDR] != mhdr ||
+      (txdata &&
+       frame[mac_payload::offsets::fopts + pendTxFOptsLen] != pendTxPort)) {
+    return false;
+  }
+  // FOpts and FCtrl bits (ADR, ACK) unchanged.
+  uint8_t const fctrl = frame[mac_payload::offsets::fctrl];
+  return (fctrl & 0x0F) == pendTxFOptsLen &&
+         fctrl == dataFrameFctrl(pendTxFOptsLen) &&
+         std::equal(pendTxFOpts.cbegin(),
+                    pendTxFOpts.cbegin() + pendTxFOptsLen,
+                    frame.cbegin() + mac_payload::offsets::fopts);
 }
+#endif
+
 
 // ================================================================================
 //
@@ -950,6 +1166,21 @@ void Lmic::buildDataFrame() {
 // ================================================================================
 
 void Lmic::buildJoinRequest() {
+#if defined(LMIC_SINGLE_BUFFER)
+  // pending data stay in frame, after the join request.
+  if (pendTxInFrame &&
+      pendTxFrameOffset < join_request::lengths::totalWithMic) {
+    if (pendTxLen > frame.size() - join_request::lengths::totalWithMic) {
+      PRINT_DEBUG(1, F("Pending data dropped by join"));
+      opmode.reset(OpState::TXDATA);
+      pendTxInFrame = false;
+    } else {
+      auto const source = frame.begin() + pendTxFrameOffset;
+      std::copy_backward(source, source + pendTxLen, frame.end());
+      pendTxFrameOffset = frame.size() - pendTxLen;
+    }
+  }
+#endif
   // Do not use pendTxData since we might have a pending
   // user level frame in there. Use RX holding area instead.
   frame[join_request::offset::MHDR] = mhdr::ftype_join_req | mhdr::major_v1;
@@ -990,9 +1221,68 @@ bool Lmic::startJoining() {
   return false; // already joined
 }
 
+void Lmic::trackFastDrain(bool const more, uint8_t const length) {
+  if (fastDrainMaxPolls == 0 || (!fastDrainActive && !more))
+    return;
+  auto const now = os_getTime();
+  if (!fastDrainActive) {
+    fastDrainActive = true;
+    fastDrainPolls = 0;
+    fastDrainLast = now;
+    fastDrainStats.drains++;
+  }
+  fastDrainStats.downlinks++;
+  fastDrainStats.bytes += length;
+  fastDrainStats.duration += now - fastDrainLast;
+  fastDrainLast = now;
+  if (!more) {
+    PRINT_DEBUG(1, F("Backlog drained"));
+    fastDrainActive = false;
+  }
+}
+
+void Lmic::selectFastDrainDr(bool const queued) {
+  // only empty uplinks, a payload may not fit at another datarate.
+  if (!fastDrainActive || fastDrainDrSet ||
+      fastDrainPolls >= fastDrainMaxPolls || !opmode.test(OpState::POLL) ||
+      opmode.test(OpState::TXDATA) || queued || adrAckReq != LINK_CHECK_OFF)
+    return;
+  TxPlanOption option;
+  auto const dr = channelParams.getTxDr();
+  auto const now = os_getTime();
+  if (!planCheapestTx(0, now, getTxAvailability(now), option) ||
+      option.dr == dr)
+    return;
+  PRINT_DEBUG(2, F("Fast drain poll at DR%d"), option.dr);
+  fastDrainSavedDr = dr;
+  fastDrainDrSet = true;
+  channelParams.setDrTx(option.dr);
+}
+
+void Lmic::restoreFastDrainDr() {
+  if (fastDrainDrSet) {
+    fastDrainDrSet = false;
+    channelParams.setDrTx(fastDrainSavedDr);
+  }
+}
+
+void Lmic::setFastDrain(uint8_t const maxPolls) {
+  fastDrainMaxPolls = maxPolls;
+  if (maxPolls == 0) {
+    fastDrainActive = false;
+  }
+}
+
 void Lmic::processDnData() {
   opmode.reset(OpState::TXRXPEND);
 
+  // no downlink with frame pending for the last poll, or too many polls.
+  if (fastDrainActive &&
+      (!opmode.test(OpState::POLL) || fastDrainPolls >= fastDrainMaxPolls)) {
+    PRINT_DEBUG(1, F("Fast drain stopped"));
+    fastDrainActive = false;
+  }
+
   if ((txrxFlags.test(TxRxStatus::DNW1) || txrxFlags.test(TxRxStatus::DNW2)) &&
       opmode.test(OpState::LINKDEAD)) {
     opmode.reset(OpState::LINKDEAD);
@@ -1014,8 +1304,9 @@ void Lmic::engineUpdate() {
     return;
   }
 
+  bool const queued = uplinkQueue && !uplinkQueue->empty();
   if (!opmode.test(OpState::JOINING) && !opmode.test(OpState::TXDATA) &&
-      !opmode.test(OpState::POLL)) {
+      !opmode.test(OpState::POLL) && !queued) {
     // No TX pending - no scheduled RX
     return;
   }
@@ -1031,8 +1322,13 @@ void Lmic::engineUpdate() {
 
   const OsTime now = os_getTime();
   OsTime txbeg;
+  bool const nextChannel = opmode.test(OpState::NEXTCHNL);
   // Find next suitable channel and return availability time
-  if (opmode.test(OpState::NEXTCHNL)) {
+  if (nextChannel) {
+    if (!jacc) {
+      // channel is chosen at the datarate of the poll.
+      selectFastDrainDr(queued);
+    }
     txbeg = channelParams.nextTx(now);
     opmode.reset(OpState::NEXTCHNL);
     PRINT_DEBUG(2, F("Airtime available at %" PRIu32 " (channel duty limit)"),
@@ -1057,11 +1353,18 @@ void Lmic::engineUpdate() {
     //  wait for the time to TX
     next_job = Job(&Lmic::runEngineUpdate, txbeg - txRampUp);
     txend = txbeg;
+#if defined(LMIC_PIPELINED_TX)
+    if (!jacc) {
+      // only the radio is left to arm at wake up.
+      stageDataFrame();
+    }
+#endif
     return;
   }
 
   PRINT_DEBUG(1, F("Ready for uplink"));
   // We could send right now!
+  bool dataDelayed = false;
   if (jacc) {
     buildJoinRequest();
   } else {
@@ -1079,11 +1382,41 @@ void Lmic::engineUpdate() {
       next_job = Job(&Lmic::runReset);
       return;
     }
-    buildDataFrame();
+    // take from queue only now to send the most important not expired.
+    if (!opmode.test(OpState::TXDATA) && queued) {
+      // room for the biggest payload in frame.
+      auto const destination =
+          pendTxDestination(frame.size() - MAX_LEN_PAYLOAD);
+      if (uplinkQueue->pop(now, pendTxPort, destination, pendTxLen,
+                           pendTxConf)) {
+        opmode.set(OpState::TXDATA);
+        txCnt = 0;
+      } else if (!opmode.test(OpState::POLL)) {
+        // all queued data expired, channel not used.
+        if (nextChannel) {
+          opmode.set(OpState::NEXTCHNL);
+        }
+        return;
+      }
+    }
+    if (fastDrainDrSet && opmode.test(OpState::TXDATA)) {
+      // data given while waiting for the poll: back to tx datarate.
+      restoreFastDrainDr();
+      opmode.set(OpState::NEXTCHNL);
+      engineUpdate();
+      return;
+    }
+    if (fastDrainActive && !opmode.test(OpState::TXDATA)) {
+      fastDrainPolls++;
+      fastDrainStats.polls++;
+    }
+    dataDelayed = !buildDataFrame();
   }
 
   opmode.reset(OpState::POLL);
-  opmode.reset(OpState::TXDATA);
+  if (!dataDelayed) {
+    opmode.reset(OpState::TXDATA);
+  }
   opmode.set(OpState::TXRXPEND);
   opmode.set(OpState::NEXTCHNL);
 
@@ -1093,6 +1426,7 @@ void Lmic::engineUpdate() {
   txParameter.power += antennaPowerAdjustment;
 
   OsDeltaTime airtime = calcAirTime(txParameter.rps, dataLen);
+  PRINT_DEBUG(1, F("Time on air : %i ms"), airtime.to_ms());
   channelParams.updateTxTimes(airtime);
 
   // if globalDutyRate==0 send available just after transmit.
@@ -1125,20 +1459,46 @@ void Lmic::reset() {
     devNonce = rand.uint16();
   }
   opmode.reset();
+  clearTransientState();
   rxDelay = OsDeltaTime::from_sec(DELAY_DNW1);
   globalDutyAvail = os_getTime();
   channelParams.initDefaultChannels();
 }
 
-void Lmic::init() {
+void Lmic::init(bool const seedRandom) {
   radio.init();
-  rand.init(radio);
+  if (seedRandom) {
+    rand.init(radio);
+  } else {
+    mixRandom();
+  }
   opmode.reset().set(OpState::SHUTDOWN);
 }
 
+void Lmic::seedRandom() { rand.init(radio); }
+
+void Lmic::mixRandom() {
+  // wake up time and one radio noise read, not the slow seed.
+  rand.mix(os_getTime().tick() ^
+           (static_cast<uint32_t>(radio.noise_sample()) << 24));
+}
+
+void Lmic::clearTransientState() {
+  pendTxInFrame = false;
+  pendTxFrameOffset = 0;
+  pendTxSealed = false;
+#if defined(LMIC_PIPELINED_TX)
+  frameStaged = false;
+#endif
+  // a cancelled poll must not leave the drain datarate.
+  restoreFastDrainDr();
+  fastDrainActive = false;
+}
+
 void Lmic::clrTxData() {
   opmode.reset(OpState::TXDATA).reset(OpState::TXRXPEND).reset(OpState::POLL);
   pendTxLen = 0;
+  clearTransientState();
   if (opmode.test(OpState::JOINING)) // do not interfere with JOINING
     return;
   next_job = {};
@@ -1147,6 +1507,9 @@ void Lmic::clrTxData() {
 }
 
 void Lmic::setTxData() {
+#if defined(LMIC_PIPELINED_TX)
+  frameStaged = false;
+#endif
   opmode.set(OpState::TXDATA);
   // cancel any ongoing TX/RX retries
   txCnt = 0;
@@ -1156,10 +1519,195 @@ void Lmic::setTxData() {
 //
 int8_t Lmic::setTxData2(uint8_t port, uint8_t *data, uint8_t dlen,
                         bool confirmed) {
-  if (dlen > pendTxData.max_size())
+  if (dlen > MAX_LEN_PAYLOAD)
+    return -2;
+#if defined(LMIC_SINGLE_BUFFER)
+  if (dlen > MAX_LEN_IN_FRAME_PAYLOAD)
     return -2;
+#endif
+  // at end of frame, room for join request and fopts before.
+  auto const destination = pendTxDestination(frame.size() - dlen);
   if (data)
-    std::copy(data, data + dlen, begin(pendTxData));
+    std::memmove(destination, data, dlen);
+  pendTxConf = confirmed;
+  pendTxPort = port;
+  pendTxLen = dlen;
+  setTxData();
+  return 0;
+}
+
+uint8_t *Lmic::pendTxDestination(uint8_t const offset) {
+  pendTxSealed = false;
+#if defined(LMIC_SINGLE_BUFFER)
+  pendTxInFrame = true;
+  pendTxFrameOffset = offset;
+  return frame.begin() + offset;
+#else
+  (void)offset;
+  pendTxInFrame = false;
+  pendTxFrameOffset = 0;
+  return pendTxData.begin();
+#endif
+}
+
+bool Lmic::isReadyForTxData() const {
+  return devaddr != 0 && !opmode.test(OpState::TXRXPEND) &&
+         !opmode.test(OpState::JOINING) && !opmode.test(OpState::TXDATA) &&
+         !opmode.test(OpState::POLL);
+}
+
+uint8_t Lmic::maxPayloadLength(dr_t const dr) const {
+  uint8_t const frameLength =
+      std::min<size_t>(channelParams.getMaxFrameLength(dr), frame.max_size());
+  // fopts and port before payload
+  uint8_t const header = mac_payload::offsets::fopts + pendTxFOptsLen + 1;
+  if (frameLength < header + lengths::MIC)
+    return 0;
+  return std::min<uint8_t>(frameLength - header - lengths::MIC,
+                           MAX_LEN_PAYLOAD);
+}
+
+uint8_t Lmic::getMaxTxPayloadLength() const {
+#if defined(LMIC_SINGLE_BUFFER)
+  return std::min(maxPayloadLength(channelParams.getTxDr()),
+                  MAX_LEN_IN_FRAME_PAYLOAD);
+#else
+  return maxPayloadLength(channelParams.getTxDr());
+#endif
+}
+
+OsTime Lmic::getTxAvailability() const {
+  return getTxAvailability(os_getTime());
+}
+
+OsTime Lmic::getTxAvailability(OsTime const now) const {
+  auto const availability = channelParams.getTxAvailability(now);
+  return availability < globalDutyAvail ? globalDutyAvail : availability;
+}
+
+bool Lmic::planOption(uint8_t const channel, dr_t const dr,
+                      uint8_t const length, OsTime const now,
+                      TxPlanOption &option) const {
+  if (!channelParams.getChannelAvailability(channel, dr, now, option.frequency,
+                                            option.txTime))
+    return false;
+  if (option.txTime < globalDutyAvail) {
+    option.txTime = globalDutyAvail;
+  }
+  option.dr = dr;
+  option.channel = channel;
+  option.maxPayload = maxPayloadLength(dr);
+  // MHDR, FHDR, port and MIC around payload
+  option.airtime =
+      calcAirTime(channelParams.getRps(dr),
+                  mac_payload::offsets::fopts + pendTxFOptsLen + 1 + length +
+                      lengths::MIC);
+  option.charge = option.airtime.to_ms() * LMIC_TX_CURRENT_MA;
+  return true;
+}
+
+uint8_t Lmic::planTx(uint8_t const length, TxPlanOption *const options,
+                     uint8_t const maxOptions, bool const perChannel) const {
+  auto const now = os_getTime();
+  uint8_t count = 0;
+  for (dr_t dr = 0; dr < 16 && count < maxOptions; dr++) {
+    if (!channelParams.validDR(dr) || maxPayloadLength(dr) < length)
+      continue;
+
+    bool found = false;
+    TxPlanOption candidate;
+    for (uint8_t channel = 0;
+         channel < channelParams.getChannelCount() && count < maxOptions;
+         channel++) {
+      if (!planOption(channel, dr, length, now, candidate))
+        continue;
+      if (perChannel) {
+        options[count++] = candidate;
+      } else if (!found || candidate.txTime < options[count].txTime) {
+        options[count] = candidate;
+        found = true;
+      }
+    }
+    if (found) {
+      count++;
+    }
+  }
+  return count;
+}
+
+bool Lmic::planCheapestTx(uint8_t const length, OsTime const deadline,
+                          TxPlanOption &option) const {
+  return planCheapestTx(length, os_getTime(), deadline, option);
+}
+
+bool Lmic::planCheapestTx(uint8_t const length, OsTime const now,
+                          OsTime const deadline, TxPlanOption &option) const {
+  bool found = false;
+  TxPlanOption candidate;
+  for (dr_t dr = 0; dr < 16; dr++) {
+    if (!channelParams.validDR(dr) || maxPayloadLength(dr) < length)
+      continue;
+    for (uint8_t channel = 0; channel < channelParams.getChannelCount();
+         channel++) {
+      if (!planOption(channel, dr, length, now, candidate) ||
+          deadline < candidate.txTime)
+        continue;
+      if (!found || candidate.airtime < option.airtime ||
+          (candidate.airtime == option.airtime &&
+           candidate.txTime < option.txTime)) {
+        option = candidate;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+uint8_t *Lmic::reserveTxData(uint8_t &maxLength) {
+  if (!isReadyForTxData()) {
+    maxLength = 0;
+    return nullptr;
+  }
+  // payload is after fopts and port
+  pendTxFrameOffset = mac_payload::offsets::fopts + pendTxFOptsLen + 1;
+  pendTxSealed = false;
+  maxLength = std::min<uint8_t>(
+      frame.max_size() - pendTxFrameOffset - lengths::MIC, MAX_LEN_PAYLOAD);
+#if defined(LMIC_SINGLE_BUFFER)
+  maxLength = std::min(maxLength, MAX_LEN_IN_FRAME_PAYLOAD);
+#else
+  // received data are overwritten.
+  dataBeg = 0;
+  dataLen = 0;
+#endif
+  return frame.begin() + pendTxFrameOffset;
+}
+
+int8_t Lmic::commitTxData(uint8_t const port, uint8_t const dlen,
+                          bool const confirmed) {
+  if (pendTxFrameOffset == 0 || port == 0)
+    return -1;
+  if (static_cast<size_t>(pendTxFrameOffset + dlen + lengths::MIC) >
+          frame.max_size() ||
+      dlen > MAX_LEN_PAYLOAD)
+    return -2;
+#if defined(LMIC_SINGLE_BUFFER)
+  if (dlen > MAX_LEN_IN_FRAME_PAYLOAD)
+    return -2;
+#endif
+
+#if defined(LMIC_SINGLE_BUFFER)
+  pendTxInFrame = true;
+#else
+  auto const source = frame.begin() + pendTxFrameOffset;
+  // Confirmed frame are rebuilt for retry and class C receive in frame
+  // while waiting for duty cycle: keep a copy.
+  pendTxInFrame = !confirmed && !isClassCActive();
+  if (!pendTxInFrame) {
+    std::copy(source, source + dlen, pendTxData.begin());
+    pendTxFrameOffset = 0;
+  }
+#endif
   pendTxConf = confirmed;
   pendTxPort = port;
   pendTxLen = dlen;
@@ -1167,6 +1715,49 @@ int8_t Lmic::setTxData2(uint8_t port, uint8_t *data, uint8_t dlen,
   return 0;
 }
 
+void Lmic::setUplinkQueue(UplinkQueue *const queue) {
+  uplinkQueue = queue;
+  engineUpdate();
+}
+
+int8_t Lmic::queueUplink(uint8_t const port, uint8_t const *const data,
+                         uint8_t const length, bool const confirmed,
+                         uint8_t const priority) {
+  if (!uplinkQueue)
+    return -1;
+  auto const result = uplinkQueue->push(port, data, length, confirmed, priority);
+  if (result == 0) {
+    engineUpdate();
+  }
+  return result;
+}
+
+int8_t Lmic::queueUplink(uint8_t const port, uint8_t const *const data,
+                         uint8_t const length, bool const confirmed,
+                         uint8_t const priority, OsTime const expiry) {
+  if (!uplinkQueue)
+    return -1;
+  auto const result =
+      uplinkQueue->push(port, data, length, confirmed, priority, expiry);
+  if (result == 0) {
+    engineUpdate();
+  }
+  return result;
+}
+
+void Lmic::setFrameCounterStore(FrameCounterStore *const store) {
+  frameCounterStore = store;
+  uint32_t up;
+  uint32_t dn;
+  if (store && store->restore(devaddr, up, dn)) {
+    // never go back, the session may be restored with newer counters.
+    seqnoUp = std::max(seqnoUp, up);
+    seqnoDn = std::max(seqnoDn, dn);
+    PRINT_DEBUG(1, F("Frame counters restored up %" PRIu32 " down %" PRIu32),
+                seqnoUp, seqnoDn);
+  }
+}
+
 // Send a payload-less message to signal device is alive
 void Lmic::sendAlive() {
   opmode.set(OpState::POLL);
@@ -1199,6 +1790,10 @@ void Lmic::setSession(uint32_t const newnetid, devaddr_t const newdevaddr,
   opmode.reset(OpState::TXRXPEND);
   opmode.set(OpState::NEXTCHNL);
   stateJustJoined();
+#if defined(LMIC_PIPELINED_TX)
+  // sealed with the previous keys.
+  frameStaged = false;
+#endif
 }
 
 // Enable/disable link check validation.
@@ -1230,31 +1825,80 @@ OsTime Lmic::int_trigger_time() const {
   }
 }
 
+// Close the rx window when no preamble is detected by the time a downlink
+// would have been, or when a preamble is not followed by a valid header.
+bool Lmic::closeRxWindowEarly() {
+  auto const now = os_getTime();
+  if (now < rxPreambleDeadline) {
+    return false;
+  }
+  auto const activity = radio.rx_activity();
+  if (activity == RxActivity::HEADER) {
+    return false;
+  }
+
+  auto const rps = txrxFlags.test(TxRxStatus::DNW1)
+                       ? channelParams.getRx1Parameter().rps
+                       : channelParams.getRx2Parameter().rps;
+  const OsDeltaTime symbol = timeBySymbol(rps);
+  if (activity == RxActivity::PREAMBLE) {
+    if (!rxPreambleSeen) {
+      // header end at the latest after the whole preamble and the header.
+      rxPreambleSeen = true;
+      rxHeaderDeadline = now + (PAMBL_SYMS + SYNC_HEADER_SYMS) * symbol;
+    }
+    if (now < rxHeaderDeadline) {
+      return false;
+    }
+    rxWindowStats.noHeader++;
+    PRINT_DEBUG(1, F("RX window closed, no header"));
+  } else {
+    PRINT_DEBUG(1, F("RX window closed, no preamble"));
+  }
+
+  radio.rx_abort();
+  rxWindowStats.earlyClose++;
+  // only the listening cut before the radio symbol timeout is known.
+  auto const radioEnd = rxtime + rxsyms * symbol;
+  if (now < radioEnd) {
+    rxWindowStats.timeSaved += radioEnd - now;
+  }
+  return true;
+}
+
 void Lmic::wait_end_rx() {
   if (radio.io_check()) {
     const auto now = int_trigger_time();
 
-    dataLen = radio.handle_end_rx(frame, true);
+    dataLen = radio.handle_end_rx(rxBuffer(), true);
 
     PRINT_DEBUG(1, F("End RX - Open RX : %" PRIi32 " us "),
                 (now - rxtime).to_us());
     rxtime = now;
-
-    // if radio task ended, activate job.
-    if (opmode.test(OpState::JOINING)) {
-      processRxJacc();
-    } else {
-      processRxDnData();
-    }
+  } else if (closeRxWindowEarly()) {
+    dataLen = 0;
+    rxtime = os_getTime();
   } else {
     // if radio has not finish come back later (loop).
     next_job = Job(&Lmic::wait_end_rx);
+    return;
+  }
+
+  // if radio task ended, activate job.
+  if (opmode.test(OpState::JOINING)) {
+    processRxJacc();
+  } else {
+    processRxDnData();
   }
 }
 
 void Lmic::wait_end_rx_c() {
   if (radio.io_check()) {
-    dataLen = radio.handle_end_rx(frame, false);
+    dataLen = radio.handle_end_rx(rxBuffer(), false);
+#if defined(LMIC_PIPELINED_TX) && !defined(LMIC_SINGLE_BUFFER)
+    // received in frame, over the staged frame.
+    frameStaged = false;
+#endif
     // if radio task ended, activate job.
     if (decodeFrame()) {
       resetAdrCount();
@@ -1300,6 +1944,7 @@ void Lmic::saveStateCommon(StoringAbtract &store) const {
   store.write(adrAckReq);
   store.write(rxDelay);
   aes.saveState(store);
+  rand.saveState(store);
 }
 
 void Lmic::saveState(StoringAbtract &store) const {
@@ -1333,6 +1978,12 @@ void Lmic::loadStateCommon(RetrieveAbtract &store) {
   store.read(adrAckReq);
   store.read(rxDelay);
   aes.loadState(store);
+  rand.loadState(store);
+#if defined(LMIC_PIPELINED_TX)
+  frameStaged = false;
+#endif
+  // avoid same random after each restore of the same state.
+  mixRandom();
 }
 
 void Lmic::loadState(RetrieveAbtract &store) {
@@ -1346,6 +1997,14 @@ void Lmic::loadStateWithoutTimeData(RetrieveAbtract &store) {
   channelParams.loadStateWithoutTimeData(store);
 }
 
+void Lmic::resume(RetrieveAbtract &store) {
+  radio.resume();
+  next_job = {};
+  clearTransientState();
+  // random pool, channels, devaddr and opmode are part of the state.
+  loadState(store);
+}
+
 #endif
 
 OsDeltaTime Lmic::run() {
@@ -1353,6 +2012,10 @@ OsDeltaTime Lmic::run() {
 
   // if the RXC windows is open check if we receive data
   if (txrxFlags.test(TxRxStatus::DNWC)) {
+    if (rxcDutyCycle) {
+      // radio with rx duty cycle driven by the MCU need to be called back.
+      delay = std::min(delay, radio.rx_duty_cycle_poll());
+    }
     wait_end_rx_c();
   }
 
@@ -18,6 +18,10 @@ namespace EU433 {
 extern CONST_TABLE2(uint8_t, _DR2RPS_CRC)[] = {
     rps_DR0, rps_DR1, rps_DR2, rps_DR3, rps_DR4, rps_DR5, rps_DR6};
 
+// LoRaWAN™ Regional Parameters, max M + 5 (no repeater).
+extern CONST_TABLE2(uint8_t, MAX_FRAME_LENS)[] = {64,  64,  64,  128,
+                                                  255, 255, 255, 255};
+
 } // namespace EU433
 
 LmicEu433::LmicEu433(Radio &aradio)
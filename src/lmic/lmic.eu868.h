@@ -37,6 +37,11 @@ constexpr uint8_t rps_DR5 = rps_t{SF7, BandWidth::BW125, CodingRate::CR_4_5};
 constexpr uint8_t rps_DR6 = rps_t{SF7, BandWidth::BW250, CodingRate::CR_4_5};
 
 extern CONST_TABLE2(uint8_t, _DR2RPS_CRC)[];
+// Max time on air of uplinks by datarate and length bucket.
+inline CONST_TABLE(AirtimeTable<7>, AIRTIME) = make_airtime_table(
+    rps_DR0, rps_DR1, rps_DR2, rps_DR3, rps_DR4, rps_DR5, rps_DR6);
+// max frame length (MHDR to MIC) by datarate.
+extern CONST_TABLE2(uint8_t, MAX_FRAME_LENS)[];
 
 constexpr uint8_t limitRX1DrOffset = 6;
 
@@ -58,7 +63,8 @@ using EU868Channels =
 using Eu868RegionalChannelParams =
     DYNAMIC_CHANNEL::DynamicRegionalChannelParams<
         EU868Channels, EU868::MaxEIRPValue, 5, 0,
-        EU868::RESOLVE_TABLE(_DR2RPS_CRC), 7, EU868::FREQ_DNW2, EU868::rps_DNW2,
+        EU868::RESOLVE_TABLE(_DR2RPS_CRC), EU868::RESOLVE_TABLE(MAX_FRAME_LENS), 7,
+        EU868::FREQ_DNW2, EU868::rps_DNW2,
         EU868::MaxPowerIndex, EU868::limitRX1DrOffset, EU868::FREQ_MIN,
         EU868::FREQ_MAX>;
 
@@ -66,6 +72,25 @@ class LmicEu868 final : public Lmic {
 public:
   explicit LmicEu868(Radio &radio);
 
+#if defined(ENABLE_SAVE_RESTORE)
+  static constexpr uint16_t STATE_SIZE =
+      LmicStateSize<Eu868RegionalChannelParams>::value;
+  static constexpr uint16_t STATE_SIZE_WITHOUT_TIME_DATA =
+      LmicStateSize<Eu868RegionalChannelParams>::withoutTimeData;
+  using State = std::array<uint8_t, STATE_SIZE>;
+
+  using Lmic::loadState;
+  using Lmic::saveState;
+  void saveState(State &state) const {
+    StoringBuffer store{state.begin()};
+    saveState(store);
+  };
+  void loadState(State const &state) {
+    RetrieveBuffer retrieve{state.begin()};
+    loadState(retrieve);
+  };
+#endif
+
 private:
   Aes aes;
   LmicRand rand;
@@ -14,11 +14,14 @@
 #define _lmic_h_
 
 #include "../aes/lmic_aes.h"
+#include "airtime.h"
 #include "enumflagsvalue.h"
+#include "framecounterstore.h"
 #include "lmicrand.h"
 #include "lorabase.h"
 #include "oslmic.h"
 #include "radio.h"
+#include "uplinkqueue.h"
 #include <array>
 
 //!< Transmit attempts for confirmed frames
@@ -114,18 +117,118 @@ struct TransmitionParameters {
   int8_t power;
 };
 
+// One way to send an uplink, see Lmic::planTx.
+struct TxPlanOption {
+  // earliest start allowed by duty cycle
+  OsTime txTime;
+  OsDeltaTime airtime;
+  uint32_t frequency;
+  // estimated charge in uC (airtime with LMIC_TX_CURRENT_MA)
+  uint32_t charge;
+  dr_t dr;
+  uint8_t channel;
+  // max application payload at this datarate
+  uint8_t maxPayload;
+};
+
 struct TimeAndStatus {
   OsTime time;
   bool status;
 };
 
+struct RxWindowStats {
+  // number of rx windows closed before the radio end them.
+  uint16_t earlyClose = 0;
+  // windows closed after a preamble without valid header (in earlyClose).
+  uint16_t noHeader = 0;
+  // rx time cut before the radio symbol timeout. The listening cut after a
+  // preamble without header is not counted, the radio end is unknown.
+  // Multiply by radio rx current to get energy saved.
+  OsDeltaTime timeSaved;
+};
+
+// Downlinks rejected by decodeFrame, by reason in order of the checks.
+// Only badMic cost an AES CMAC.
+struct DownlinkFilterStats {
+  // not a LoRaWAN 1.0 data down frame (join accept, uplink, proprietary).
+  uint16_t badHeader = 0;
+  // shorter than an empty frame.
+  uint16_t badLength = 0;
+  // frame for another device.
+  uint16_t otherAddress = 0;
+  // FOpts past the end of the frame, or FOpts in class C window.
+  uint16_t badFOpts = 0;
+  // replayed counter, or more than MAX_FCNT_GAP ahead.
+  uint16_t badCounter = 0;
+  uint16_t badMic = 0;
+};
+
+// Downlink backlogs drained with fast drain (see Lmic::setFastDrain).
+// Throughput is bytes / duration.
+struct FastDrainStats {
+  // backlogs drained, from a downlink with frame pending to the last one.
+  uint16_t drains = 0;
+  // empty uplinks sent to fetch the backlogs.
+  uint16_t polls = 0;
+  // downlinks received, first one of each backlog included.
+  uint16_t downlinks = 0;
+  // application payload received.
+  uint32_t bytes = 0;
+  // sum of time from first to last downlink of the backlogs.
+  OsDeltaTime duration;
+};
+
 uint32_t read_frequency(const uint8_t *ptr);
 
+class Lmic;
+
+/**
+ * Application payload of the last downlink, in the receive buffer.
+ * The payload is decrypted in place when read, a downlink which is not
+ * read is never decrypted.
+ * Valid until the next uplink or receive.
+ */
+class DownlinkView {
+public:
+  explicit DownlinkView(Lmic const &almic) : lmic(almic){};
+  // 0 if no port.
+  uint8_t port() const;
+  uint8_t length() const;
+  bool empty() const { return length() == 0; };
+  // Whole payload, nullptr if none.
+  uint8_t const *data() const;
+  /**
+   * Payload with only the first count bytes decrypted (rounded up to the
+   * AES block of 16 bytes), the remaining is decrypted by data().
+   */
+  uint8_t const *peek(uint8_t count) const;
+
+private:
+  Lmic const &lmic;
+};
+
 class RegionalChannelParams {
 public:
   virtual TransmitionParameters getTxParameter() const = 0;
   virtual TransmitionParameters getRx1Parameter() const = 0;
   virtual TransmitionParameters getRx2Parameter() const = 0;
+  // Earliest time (not before now) a channel usable at the tx datarate is
+  // free.
+  virtual OsTime getTxAvailability(OsTime now) const = 0;
+
+  // Uplink planning at any datarate and channel.
+  virtual dr_t getTxDr() const = 0;
+  virtual rps_t getRps(dr_t dr) const = 0;
+  // Max length of the frame (MHDR to MIC) at the datarate.
+  virtual uint8_t getMaxFrameLength(dr_t dr) const = 0;
+  virtual uint8_t getChannelCount() const = 0;
+  /**
+   * Frequency and time the channel is free (not before now).
+   * Return false if the channel is not usable at the datarate.
+   */
+  virtual bool getChannelAvailability(uint8_t channel, dr_t dr, OsTime now,
+                                      uint32_t &frequency,
+                                      OsTime &availability) const = 0;
   virtual void reduceDr(uint8_t diff) = 0;
 
   int8_t const InvalidPower = -128;
@@ -149,6 +252,9 @@ public:
   virtual OsTime nextTx(OsTime now) = 0;
   virtual OsTime initJoinLoop() = 0;
   virtual TimeAndStatus nextJoinState() = 0;
+  // Join accept received for the last join request sent.
+  // rssi in dBm and snr in dB of the join accept.
+  virtual void joinAccepted(int16_t rssi, int8_t snr) = 0;
   virtual void setRx2Parameter(uint32_t rx2frequency, dr_t rx2datarate) = 0;
   virtual void setRx2DataRate(dr_t rx2datarate) = 0;
   virtual void setRx1DrOffset(uint8_t drOffset) = 0;
@@ -171,9 +277,13 @@ public:
 };
 
 class Lmic {
+  friend class DownlinkView;
+
 public:
   static OsDeltaTime timeBySymbol(rps_t rps);
-  static OsDeltaTime calcAirTime(rps_t rps, uint8_t plen);
+  static constexpr OsDeltaTime calcAirTime(rps_t rps, uint8_t plen) {
+    return lora_airtime(rps, plen);
+  }
 
 private:
   using Job = OsJobType<Lmic>;
@@ -188,6 +298,25 @@ private:
   // time of detect of change of state of radio module
   OsTime last_int_trigger;
   uint8_t rxsyms = 0;
+  // time after which a rx window without preamble is closed.
+  OsTime rxPreambleDeadline;
+  // time after which a rx window without valid header is closed, set when
+  // a preamble is seen.
+  OsTime rxHeaderDeadline;
+  bool rxPreambleSeen = false;
+  // rx window statistics
+  RxWindowStats rxWindowStats;
+  DownlinkFilterStats downlinkFilterStats;
+  // fast drain of frame pending backlogs, max polls by backlog (0 = off).
+  uint8_t fastDrainMaxPolls = 0;
+  uint8_t fastDrainPolls = 0;
+  bool fastDrainActive = false;
+  // tx datarate changed for a poll, restored at receive.
+  bool fastDrainDrSet = false;
+  dr_t fastDrainSavedDr = 0;
+  // last downlink of the backlog.
+  OsTime fastDrainLast;
+  FastDrainStats fastDrainStats;
 
   eventCallback_t eventCallBack = nullptr;
   keyCallback_t devEuiCallBack = nullptr;
@@ -212,6 +341,8 @@ private:
 
   uint8_t clockError = 0; // Inaccuracy in the clock. CLOCK_ERROR_MAX
                           // represents +/-100% error
+  // class C listen with radio rx duty cycle instead of rx continuous.
+  bool rxcDutyCycle = false;
 
   // pending data length
   uint8_t pendTxLen = 0;
@@ -219,8 +350,28 @@ private:
   bool pendTxConf = false;
   // pending data port
   uint8_t pendTxPort = 0;
+#if !defined(LMIC_SINGLE_BUFFER)
   // pending data
   std::array<uint8_t, MAX_LEN_PAYLOAD> pendTxData;
+#endif
+  // pending data is already in frame at pendTxFrameOffset (reserveTxData).
+  bool pendTxInFrame = false;
+  // offset of payload given by reserveTxData, 0 if none.
+  uint8_t pendTxFrameOffset = 0;
+  // pending data in frame is encrypted (kept for confirmed retry).
+  bool pendTxSealed = false;
+  // application queue, used when no data pending.
+  UplinkQueue *uplinkQueue = nullptr;
+  // persistent frame counters, nullptr if none.
+  FrameCounterStore *frameCounterStore = nullptr;
+#if defined(LMIC_PIPELINED_TX)
+  // data frame built and sealed while waiting for airtime.
+  bool frameStaged = false;
+  bool stagedWithData = false;
+  uint8_t stagedLength = 0;
+  dr_t stagedDr = 0;
+  uint32_t stagedSeqno = 0;
+#endif
 
   // pending Fopts lens
   uint8_t pendTxFOptsLen = 0;
@@ -247,13 +398,31 @@ private:
   // Rx delay after TX, init at reset
   OsDeltaTime rxDelay;
 
+#if defined(LMIC_SINGLE_BUFFER)
   FrameBuffer frame;
+  // downlinks, never alias the pending data in frame. Mutable, the payload
+  // is decrypted in place when read.
+  mutable RxFrameBuffer rxFrame;
+  RxFrameBuffer &rxBuffer() { return rxFrame; }
+  RxFrameBuffer const &rxBuffer() const { return rxFrame; }
+  RxFrameBuffer &decryptBuffer() const { return rxFrame; }
+#else
+  // mutable, a downlink payload is decrypted in place when read.
+  mutable FrameBuffer frame;
+  RxFrameBuffer &rxBuffer() { return frame; }
+  RxFrameBuffer const &rxBuffer() const { return frame; }
+  RxFrameBuffer &decryptBuffer() const { return frame; }
+#endif
   // transaction flags (TX-RX combo)
   TxRxStatusValue txrxFlags;
   // 0 no data or zero length data, >0 byte count of data
   uint8_t dataLen = 0;
   // 0 or start of data (dataBeg-1 is port)
   uint8_t dataBeg = 0;
+  // bytes of data already decrypted (cache of getData, see decryptBuffer)
+  mutable uint8_t dataClearLen = 0;
+  // frame counter of the data, for deferred decryption.
+  uint32_t dataSeqno = 0;
   uint8_t txCnt = 0;
 
 private:
@@ -263,6 +432,14 @@ private:
   void processRx2DnData();
   void setupRx1();
   void setupRx2();
+  void setRxDeadlines(rps_t rps);
+  bool closeRxWindowEarly();
+  uint8_t maxPayloadLength(dr_t dr) const;
+  bool planOption(uint8_t channel, dr_t dr, uint8_t length, OsTime now,
+                  TxPlanOption &option) const;
+  // with the same now for availability and options.
+  bool planCheapestTx(uint8_t length, OsTime now, OsTime deadline,
+                      TxPlanOption &option) const;
   void setupRxC();
   OsTime schedRx12(OsDeltaTime delay, rps_t rps);
 
@@ -284,7 +461,25 @@ private:
 
   void reportEvent(EventType ev);
 
-  void buildDataFrame();
+  // false if the pending payload did not fit and is left for the next one.
+  bool buildDataFrame();
+  // decrypt at least count bytes of the downlink payload.
+  void decryptData(uint8_t count) const;
+  // mix a fresh sample in the random pool (init without seed, restore).
+  void mixRandom();
+  // counter of the next data frame (same as previous for a v1.0.2 retry).
+  uint32_t nextSeqnoUp() const;
+  uint8_t dataFrameFctrl(uint8_t foptsLen) const;
+  // write the data frame with counter seqno in frame, return its length.
+  uint8_t composeDataFrame(uint32_t seqno, bool &withData);
+  // update counters and pending MAC commands for the frame sent.
+  void commitDataFrame(uint8_t length, bool withData);
+#if defined(LMIC_PIPELINED_TX)
+  void stageDataFrame();
+  bool stagedFrameValid() const;
+#endif
+  // where to write pending data, in frame at offset in single buffer mode.
+  uint8_t *pendTxDestination(uint8_t offset);
   void engineUpdate();
   void parse_ladr(const uint8_t *const opts, uint8_t *response,
                   uint8_t &responseLenght);
@@ -308,6 +503,11 @@ private:
 
   bool decodeFrame();
   void processDnData();
+  void trackFastDrain(bool more, uint8_t length);
+  void selectFastDrainDr(bool queued);
+  void restoreFastDrainDr();
+  // drop the pending frame build and the fast drain.
+  void clearTransientState();
   void txDelay(OsTime reftime, uint8_t secSpan);
   void resetAdrCount();
   void incrementAdrCount();
@@ -316,7 +516,10 @@ private:
 public:
   void setBatteryLevel(uint8_t level);
   // set default/start DR/txpow
-  void setDrTx(uint8_t dr) { channelParams.setDrTx(dr); };
+  void setDrTx(uint8_t dr) {
+    fastDrainDrSet = false;
+    channelParams.setDrTx(dr);
+  };
 
   void setRx2Parameter(uint32_t rx2frequency, dr_t rx2datarate);
   void setDutyRate(uint8_t duty_rate);
@@ -332,7 +535,11 @@ public:
   void setAntennaPowerAdjustment(int8_t power);
   bool startJoining();
 
-  void init();
+  // Init radio, seed random from radio noise if seedRandom.
+  // Without seed, the random pool should be restored with loadState.
+  void init(bool seedRandom = true);
+  // Seed random from radio noise (slow), on demand.
+  void seedRandom();
   void shutdown();
   void reset();
   void setDevKey(const AesKey &key) { aes.setDevKey(key); };
@@ -340,17 +547,77 @@ public:
   void clrTxData();
   void setTxData();
   int8_t setTxData2(uint8_t port, uint8_t *data, uint8_t dlen, bool confirmed);
+  /**
+   * Reserve the payload of the next uplink directly in the frame buffer,
+   * avoid the copies of setTxData2. Return nullptr if the MAC is busy.
+   * The buffer is valid until commitTxData and replace the data returned
+   * by getData().
+   */
+  uint8_t *reserveTxData(uint8_t &maxLength);
+  /**
+   * Send the dlen bytes written in the reserved buffer.
+   * Return 0 if ok, -1 if no reservation or port 0, -2 if too long.
+   */
+  int8_t commitTxData(uint8_t port, uint8_t dlen, bool confirmed);
+  // Queue to send from when no data set with setTxData2, nullptr to remove.
+  // The queue must be alive until removed.
+  void setUplinkQueue(UplinkQueue *queue);
+  /**
+   * Push an uplink in the queue and wake the MAC if idle, an entry pushed
+   * directly in the queue is only taken at the next uplink.
+   * Return as UplinkQueue::push, -1 also if no queue is set.
+   */
+  int8_t queueUplink(uint8_t port, uint8_t const *data, uint8_t length,
+                     bool confirmed, uint8_t priority = 0);
+  int8_t queueUplink(uint8_t port, uint8_t const *data, uint8_t length,
+                     bool confirmed, uint8_t priority, OsTime expiry);
+  /**
+   * Keep frame counters in store, nullptr to remove. Set it after
+   * setSession (or a restore of the session): the counters of the session
+   * are restored from the store if it has a record for the device address.
+   * The store must be alive until removed.
+   */
+  void setFrameCounterStore(FrameCounterStore *store);
+  // True if a new uplink can be set: joined and no uplink pending.
+  bool isReadyForTxData() const;
+#if defined(LMIC_PIPELINED_TX)
+  // True if the pending uplink is already built and sealed.
+  bool isFrameStaged() const { return frameStaged; };
+#endif
+  // Max application payload of the next uplink at the tx datarate (and room
+  // for FOpts with LMIC_SINGLE_BUFFER).
+  uint8_t getMaxTxPayloadLength() const;
+  // Radio parameters of the next uplink (for calcAirTime).
+  rps_t getTxRps() const { return channelParams.getTxParameter().rps; };
+  // Earliest time the duty cycle limits allow the next uplink, now when
+  // already allowed.
+  OsTime getTxAvailability() const;
+  OsTime getTxAvailability(OsTime now) const;
+  /**
+   * Ways to send length bytes of payload: for each datarate with a max
+   * payload long enough, the channel free first, or each usable channel if
+   * perChannel. Datarate is not changed, use setDrTx to apply a choice.
+   * Return the number of options written (at most maxOptions).
+   */
+  uint8_t planTx(uint8_t length, TxPlanOption *options, uint8_t maxOptions,
+                 bool perChannel = false) const;
+  /**
+   * Option with the lowest airtime starting before deadline.
+   * Return false if none.
+   */
+  bool planCheapestTx(uint8_t length, OsTime deadline,
+                      TxPlanOption &option) const;
   void sendAlive();
   void setClockError(uint8_t error);
 
   OpStateValue getOpMode() const { return opmode; };
   TxRxStatusValue getTxRxFlags() const { return txrxFlags; };
   uint8_t getDataLen() const { return dataLen; };
-  uint8_t const *getData() const {
-    return dataBeg ? frame.cbegin() + dataBeg : nullptr;
-  };
+  // Payload of the last downlink, decrypted on first call.
+  uint8_t const *getData() const { return getDownlink().data(); };
+  DownlinkView getDownlink() const { return DownlinkView(*this); };
   uint8_t getPort() const {
-    return txrxFlags.test(TxRxStatus::PORT) ? frame[dataBeg - 1] : 0;
+    return txrxFlags.test(TxRxStatus::PORT) ? rxBuffer()[dataBeg - 1] : 0;
   };
 
   void setEventCallBack(eventCallback_t callback) { eventCallBack = callback; };
@@ -360,6 +627,28 @@ public:
   bool isClassCActive() const { return opmode.test(OpState::CLASSC); };
   void activateClassC() { opmode.set(OpState::CLASSC); }
   void deactivateClassC() { opmode.reset(OpState::CLASSC); }
+  RxWindowStats const &getRxWindowStats() const { return rxWindowStats; }
+  void resetRxWindowStats() { rxWindowStats = RxWindowStats(); }
+  DownlinkFilterStats const &getDownlinkFilterStats() const {
+    return downlinkFilterStats;
+  }
+  void resetDownlinkFilterStats() {
+    downlinkFilterStats = DownlinkFilterStats();
+  }
+  /**
+   * Fetch downlinks signaled by frame pending as fast as possible: the empty
+   * uplinks (polls) are sent at the datarate with least airtime available
+   * as early as the tx datarate (only without ADR, the network choose the
+   * datarate with ADR), at most maxPolls by backlog, then polls are sent
+   * as usual. 0 (default) disable.
+   */
+  void setFastDrain(uint8_t maxPolls);
+  bool isFastDraining() const { return fastDrainActive; }
+  FastDrainStats const &getFastDrainStats() const { return fastDrainStats; }
+  void resetFastDrainStats() { fastDrainStats = FastDrainStats(); }
+
+  // Low power class C, the radio sleep between preamble detection.
+  void setClassCRxDutyCycle(bool enabled) { rxcDutyCycle = enabled; }
 
   // Use in certification tests
   void setRegionalDutyCycleVerification(bool enabled) {
@@ -383,6 +672,25 @@ public:
   void saveStateWithoutTimeData(StoringAbtract &store) const;
   void loadState(RetrieveAbtract &strore);
   void loadStateWithoutTimeData(RetrieveAbtract &strore);
+  /**
+   * Replace init, reset and loadState on wake up from deep sleep: restore
+   * the state saved with saveState without random seeding, default
+   * channels and radio reset (if the radio retained its state).
+   */
+  void resume(RetrieveAbtract &store);
+
+  // size of the state without regional parameters.
+  static constexpr uint16_t getStateSizeCommon() {
+    return sizeof(rxsyms) + sizeof(globalDutyRate) + sizeof(pendTxFOptsLen) +
+           sizeof(pendTxFOpts) + sizeof(netid) + sizeof(opmode) +
+           sizeof(upRepeat) + sizeof(devNonce) + sizeof(devaddr) +
+           sizeof(seqnoDn) + sizeof(seqnoUp) + sizeof(dnConf) +
+           sizeof(adrAckReq) + sizeof(rxDelay) + Aes::getStateSize() +
+           LmicRand::getStateSize();
+  };
+  static constexpr uint16_t getStateSizeTimeData() {
+    return sizeof(globalDutyAvail);
+  };
 #endif
 
   explicit Lmic(Radio &aradio, Aes &aaes, LmicRand &arand,
@@ -392,6 +700,22 @@ public:
   OsDeltaTime run();
 };
 
+#if defined(ENABLE_SAVE_RESTORE)
+/**
+ * Exact size of saveState of a MAC with regional parameters ChannelParams.
+ * Each region define State, an array of this size:
+ *   LmicEu868::State state;
+ *   LMIC.saveState(state);
+ */
+template <typename ChannelParams> struct LmicStateSize {
+  static constexpr uint16_t value = Lmic::getStateSizeCommon() +
+                                    ChannelParams::getStateSize() +
+                                    Lmic::getStateSizeTimeData();
+  static constexpr uint16_t withoutTimeData =
+      Lmic::getStateSizeCommon() + ChannelParams::getStateSizeWithoutTimeData();
+};
+#endif
+
 // Construct a bit map of allowed datarates from drlo to drhi (both included).
 template <typename T> constexpr uint16_t dr_range_map(T drlo, T drhi) {
   return (((uint16_t)0xFFFF << static_cast<uint8_t>(drlo)) &
@@ -11,6 +11,7 @@
  *******************************************************************************/
 #include "../hal/print_debug.h"
 
+#include "bitmask.h"
 #include "bufferpack.h"
 #include "lmic.us915.h"
 #include "lmic_table.h"
@@ -37,7 +38,7 @@ constexpr dr_t DR_DNW2 = Us915RegionalChannelParams::SF12CR;
 } // namespace
 
 #define maxFrameLen(dr)                                                        \
-  ((dr) <= DR_SF11CR ? TABLE_GET_U1(maxFrameLens, (dr)) : 0xFF)
+  ((dr) <= SF8C ? TABLE_GET_U1(maxFrameLens, (dr)) : 0xFF)
 CONST_TABLE(uint8_t, maxFrameLens)
 [] = {24, 66, 142, 255, 255, 255, 255, 255, 66, 142};
 
@@ -45,11 +46,11 @@ namespace {
 constexpr rps_t rps_DWN2 =
     rps_t{SF12, BandWidth::BW500, CodingRate::CR_4_5, true};
 
-constexpr uint8_t rps_DR0 = rps_t{SF10, BandWidth::BW125, CodingRate::CR_4_5};
-constexpr uint8_t rps_DR1 = rps_t{SF9, BandWidth::BW125, CodingRate::CR_4_5};
-constexpr uint8_t rps_DR2 = rps_t{SF8, BandWidth::BW125, CodingRate::CR_4_5};
-constexpr uint8_t rps_DR3 = rps_t{SF7, BandWidth::BW125, CodingRate::CR_4_5};
-constexpr uint8_t rps_DR4 = rps_t{SF8, BandWidth::BW500, CodingRate::CR_4_5};
+using US915::rps_DR0;
+using US915::rps_DR1;
+using US915::rps_DR2;
+using US915::rps_DR3;
+using US915::rps_DR4;
 
 constexpr uint8_t rps_DR8 = rps_t{SF12, BandWidth::BW500, CodingRate::CR_4_5};
 constexpr uint8_t rps_DR9 = rps_t{SF11, BandWidth::BW500, CodingRate::CR_4_5};
@@ -138,6 +139,7 @@ void Us915RegionalChannelParams::initDefaultChannels() {
   for (uint8_t i = 0; i < 4; i++)
     channelMap[i] = 0xFFFF;
   channelMap[4] = 0x00FF;
+  usedMap = {};
 }
 
 void Us915RegionalChannelParams::handleCFList(const uint8_t *ptr) {
@@ -220,12 +222,21 @@ void Us915RegionalChannelParams::mapChannels(uint8_t chMaskCntl,
     channelMap[chMaskCntl] = chMask;
   }
   // TODO handle chMaskCntl = 5
+
+  // Channel mask from network give the sub-band of gateways,
+  // try it first on next join.
+  uint8_t const bands = enabledSubBands();
+  if (bands != 0 && bands != 0xFF) {
+    joinSubBand = mask_select(bands, 0);
+  }
 }
 
 uint32_t Us915RegionalChannelParams::getTxFrequency() const {
-  uint8_t chnl = txChnl;
-  ASSERT(chnl < 64 + 8);
+  ASSERT(txChnl < 64 + 8);
+  return channelFrequency(txChnl);
+}
 
+uint32_t Us915RegionalChannelParams::channelFrequency(uint8_t const chnl) {
   if (chnl < 64) {
     return US915_125kHz_UPFBASE + chnl * US915_125kHz_UPFSTEP;
   }
@@ -241,28 +252,68 @@ int8_t Us915RegionalChannelParams::getTxPower() const {
 
 void Us915RegionalChannelParams::updateTxTimes(OsDeltaTime) {}
 
-// US does not have duty cycling - return now as earliest TX time
-OsTime Us915RegionalChannelParams::nextTx(OsTime now) {
-  if (chRnd == 0)
-    chRnd = rand.uint8() & 0x3F;
-  if (datarate >= SF8C) { // 500kHz
-    uint8_t map = channelMap[64 / 16] & 0xFF;
-    for (uint8_t i = 0; i < 8; i++) {
-      if ((map & (1 << (++chRnd & 7))) != 0) {
-        txChnl = 64 + (chRnd & 7);
-        return now;
-      }
+uint16_t Us915RegionalChannelParams::enabledChannels(uint8_t const word) const {
+  // only 8 channels of 500kHz
+  return word == 64 / 16 ? channelMap[word] & 0x00FF : channelMap[word];
+}
+
+// Pick a random enabled channel in words [firstWord, firstWord + nbWords) of
+// the channel map, limited to bits of restrict in each word. A channel is not
+// used again before all other enabled channels have been used.
+bool Us915RegionalChannelParams::pickChannel(uint8_t const firstWord,
+                                             uint8_t const nbWords,
+                                             uint16_t const restrict) {
+  std::array<uint16_t, 64 / 16> candidates;
+  uint8_t total = 0;
+  for (uint8_t i = 0; i < nbWords; i++) {
+    candidates[i] = enabledChannels(firstWord + i) & restrict &
+                    ~usedMap[firstWord + i];
+    total += mask_count(candidates[i]);
+  }
+
+  if (total == 0) {
+    // all enabled channels used, start a new rotation
+    for (uint8_t i = 0; i < nbWords; i++) {
+      usedMap[firstWord + i] &= ~restrict;
+      candidates[i] = enabledChannels(firstWord + i) & restrict;
+      total += mask_count(candidates[i]);
+    }
+    if (total == 0) {
+      return false;
+    }
+    // do not start the new rotation with the last channel, it stay in the
+    // rotation.
+    uint8_t const lastWord = txChnl / 16 - firstWord;
+    uint16_t const lastBit = 1 << (txChnl & 0xF);
+    if (total > 1 && lastWord < nbWords &&
+        (candidates[lastWord] & lastBit) != 0) {
+      candidates[lastWord] &= ~lastBit;
+      total--;
     }
-  } else { // 125kHz
-    for (uint8_t i = 0; i < 64; i++) {
-      uint8_t chnl = ++chRnd & 0x3F;
-      if ((channelMap[(chnl >> 4)] & (1 << (chnl & 0xF))) != 0) {
-        txChnl = chnl;
-        return now;
-      }
+  }
+
+  uint8_t nth = rand.uint8() % total;
+  for (uint8_t i = 0; i < nbWords; i++) {
+    uint8_t const count = mask_count(candidates[i]);
+    if (nth < count) {
+      auto const bit = mask_select(candidates[i], nth);
+      usedMap[firstWord + i] |= 1 << bit;
+      txChnl = (firstWord + i) * 16 + bit;
+      return true;
     }
+    nth -= count;
+  }
+  return false;
+}
+
+// US does not have duty cycling - return now as earliest TX time
+OsTime Us915RegionalChannelParams::nextTx(OsTime now) {
+  bool const found =
+      datarate >= SF8C ? pickChannel(64 / 16, 1) : pickChannel(0, 64 / 16);
+  if (!found) {
+    // No feasible channel  found! Keep old one.
+    PRINT_DEBUG(1, F("Error Fail to find a channel."));
   }
-  // No feasible channel  found! Keep old one.
   return now;
 }
 
@@ -298,6 +349,28 @@ TransmitionParameters Us915RegionalChannelParams::getTxParameter() const {
   return {getTxFrequency(), rps_t(getRawRps(datarate)), getTxPower()};
 }
 
+uint8_t Us915RegionalChannelParams::getMaxFrameLength(dr_t const dr) const {
+  return maxFrameLen(dr);
+}
+
+bool Us915RegionalChannelParams::getChannelAvailability(
+    uint8_t const channel, dr_t const dr, OsTime const now,
+    uint32_t &frequency, OsTime &availability) const {
+  // 125kHz channels for DR0-3, 500kHz channels for DR4
+  if (channel >= 64 + 8 || (dr == SF8C) != (channel >= 64) || dr > SF8C ||
+      (channelMap[channel >> 4] & (1 << (channel & 0xF))) == 0) {
+    return false;
+  }
+  frequency = channelFrequency(channel);
+  availability = now;
+  return true;
+}
+
+// no duty cycle in US915
+OsTime Us915RegionalChannelParams::getTxAvailability(OsTime const now) const {
+  return now;
+}
+
 TransmitionParameters Us915RegionalChannelParams::getRx1Parameter() const {
   auto val = rps_t(getRawRps(getRx1Dr()));
   val.nocrc = true;
@@ -308,37 +381,94 @@ TransmitionParameters Us915RegionalChannelParams::getRx2Parameter() const {
   return rx2Parameter;
 }
 
+// mask of sub-bands with at least one 125kHz channel enabled
+uint8_t Us915RegionalChannelParams::enabledSubBands() const {
+  uint8_t bands = 0;
+  for (uint8_t band = 0; band < 8; band++) {
+    if (((channelMap[band / 2] >> (8 * (band & 1))) & 0xFF) != 0) {
+      bands |= 1 << band;
+    }
+  }
+  return bands;
+}
+
+// index-th sub-band with enabled channels, counting from joinStartBand.
+uint8_t Us915RegionalChannelParams::joinSubBandAt(uint8_t const index) const {
+  uint8_t const bands = enabledSubBands();
+  if (bands == 0) {
+    return (joinStartBand + index) & 7;
+  }
+  // rotate to have start band as bit 0
+  uint8_t const rotated =
+      (bands >> joinStartBand) | (bands << (8 - joinStartBand));
+  return (joinStartBand + mask_select(rotated, index % mask_count(bands))) &
+         7;
+}
+
+// One round of join is 8 sub-bands, each with a 125kHz channel then the
+// 500kHz channel in the same part of spectrum.
+constexpr uint8_t JOIN_ROUND_ATTEMPTS = 16;
+// Datarate of 125kHz attempts is lowered at each round, down to SF10.
+constexpr uint8_t JOIN_ROUNDS = 4;
+
+void Us915RegionalChannelParams::setupJoinAttempt() {
+  uint8_t const round = joinAttempt / JOIN_ROUND_ATTEMPTS;
+  uint8_t const step = joinAttempt % JOIN_ROUND_ATTEMPTS;
+  uint8_t const band = joinSubBandAt(step / 2);
+
+  if ((step & 1) != 0) {
+    datarate = SF8C;
+    if ((enabledChannels(64 / 16) & (1 << band)) != 0) {
+      txChnl = 64 + band;
+    } else {
+      pickChannel(64 / 16, 1);
+    }
+  } else {
+    datarate = joinDr > round ? joinDr - round : SF10;
+    if (!pickChannel(band / 2, 1, 0xFF << (8 * (band & 1)))) {
+      pickChannel(0, 64 / 16);
+    }
+  }
+  PRINT_DEBUG(2, F("Join attempt %d on channel %d, DR%d"), joinAttempt,
+              txChnl, datarate);
+}
+
 OsTime Us915RegionalChannelParams::initJoinLoop() {
-  chRnd = 0;
-  txChnl = 0;
+  joinAttempt = 0;
+  usedMap = {};
   adrTxPow = 20;
-  setDrJoin(SF7);
+  // known sub-band first, else start at random.
+  joinStartBand = joinSubBand < 8 ? joinSubBand : rand.uint8() & 7;
+  setupJoinAttempt();
   return os_getTime() + OsDeltaTime::rnd_delay(rand, 8);
 }
 
 TimeAndStatus Us915RegionalChannelParams::nextJoinState() {
-  // Try the following:
-  //   SF7/8/9/10  on a random channel 0..63
-  //   SF8C        on a random channel 64..71
-  //
+  // Alternate 125kHz and 500kHz attempts over sub-bands with enabled
+  // channels, from the last known sub-band.
+  // Signal a failure after each round.
   bool failed = false;
-  if (datarate != SF8C) {
-    txChnl = 64 + (txChnl & 7);
-    datarate = SF8C;
-  } else {
-    txChnl = rand.uint8() & 0x3F;
-    int8_t dr = SF7 - ++chRnd;
-    if (dr < SF10) {
-      dr = SF10;
-      failed = true; // All DR exhausted - signal failed
-      chRnd = 0;
+  joinAttempt++;
+  if (joinAttempt % JOIN_ROUND_ATTEMPTS == 0) {
+    failed = true;
+    if (joinAttempt >= JOIN_ROUND_ATTEMPTS * JOIN_ROUNDS) {
+      // stay on the lowest datarate round
+      joinAttempt = JOIN_ROUND_ATTEMPTS * (JOIN_ROUNDS - 1);
     }
-    datarate = dr;
   }
+  setupJoinAttempt();
 
   return {os_getTime(), !failed};
 }
 
+void Us915RegionalChannelParams::joinAccepted(int16_t, int8_t) {
+  joinSubBand = txChnl < 64 ? txChnl / 8 : txChnl - 64;
+  if (datarate < SF8C) {
+    joinDr = datarate;
+  }
+  PRINT_DEBUG(2, F("Join accepted on sub-band %d"), joinSubBand);
+}
+
 void Us915RegionalChannelParams::setRx1DrOffset(uint8_t drOffset) {
   rx1DrOffset = drOffset;
 }
@@ -360,7 +490,10 @@ void Us915RegionalChannelParams::saveStateWithoutTimeData(
     StoringAbtract &store) const {
 
   store.write(channelMap);
-  store.write(chRnd);
+  store.write(usedMap);
+  store.write(joinAttempt);
+  store.write(joinSubBand);
+  store.write(joinDr);
   store.write(txChnl);
   store.write(adrTxPow);
   store.write(datarate);
@@ -371,7 +504,10 @@ void Us915RegionalChannelParams::saveStateWithoutTimeData(
 void Us915RegionalChannelParams::saveState(StoringAbtract &store) const {
 
   store.write(channelMap);
-  store.write(chRnd);
+  store.write(usedMap);
+  store.write(joinAttempt);
+  store.write(joinSubBand);
+  store.write(joinDr);
   store.write(txChnl);
   store.write(adrTxPow);
   store.write(datarate);
@@ -383,7 +519,10 @@ void Us915RegionalChannelParams::loadStateWithoutTimeData(
     RetrieveAbtract &store) {
 
   store.read(channelMap);
-  store.read(chRnd);
+  store.read(usedMap);
+  store.read(joinAttempt);
+  store.read(joinSubBand);
+  store.read(joinDr);
   store.read(txChnl);
   store.read(adrTxPow);
   store.read(datarate);
@@ -393,7 +532,10 @@ void Us915RegionalChannelParams::loadStateWithoutTimeData(
 
 void Us915RegionalChannelParams::loadState(RetrieveAbtract &store) {
   store.read(channelMap);
-  store.read(chRnd);
+  store.read(usedMap);
+  store.read(joinAttempt);
+  store.read(joinSubBand);
+  store.read(joinDr);
   store.read(txChnl);
   store.read(adrTxPow);
   store.read(datarate);
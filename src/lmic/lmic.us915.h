@@ -15,6 +15,18 @@
 
 #include "lmic.h"
 
+namespace US915 {
+constexpr uint8_t rps_DR0 = rps_t{SF10, BandWidth::BW125, CodingRate::CR_4_5};
+constexpr uint8_t rps_DR1 = rps_t{SF9, BandWidth::BW125, CodingRate::CR_4_5};
+constexpr uint8_t rps_DR2 = rps_t{SF8, BandWidth::BW125, CodingRate::CR_4_5};
+constexpr uint8_t rps_DR3 = rps_t{SF7, BandWidth::BW125, CodingRate::CR_4_5};
+constexpr uint8_t rps_DR4 = rps_t{SF8, BandWidth::BW500, CodingRate::CR_4_5};
+
+// Max time on air of uplinks by datarate and length bucket.
+inline CONST_TABLE(AirtimeTable<5>, AIRTIME) =
+    make_airtime_table(rps_DR0, rps_DR1, rps_DR2, rps_DR3, rps_DR4);
+} // namespace US915
+
 class Us915RegionalChannelParams final : public RegionalChannelParams {
 public:
   enum Dr : dr_t {
@@ -54,10 +66,19 @@ public:
   virtual bool setAdrToMaxIfNotAlreadySet() final;
 
   uint32_t getTxFrequency() const;
+  static uint32_t channelFrequency(uint8_t chnl);
   int8_t getTxPower() const;
   TransmitionParameters getTxParameter() const final;
   TransmitionParameters getRx1Parameter() const final;
   TransmitionParameters getRx2Parameter() const final;
+  OsTime getTxAvailability(OsTime now) const final;
+  dr_t getTxDr() const final { return datarate; };
+  rps_t getRps(dr_t dr) const final { return rps_t(getRawRps(dr)); };
+  uint8_t getMaxFrameLength(dr_t dr) const final;
+  uint8_t getChannelCount() const final { return 64 + 8; };
+  bool getChannelAvailability(uint8_t channel, dr_t dr, OsTime now,
+                              uint32_t &frequency,
+                              OsTime &availability) const final;
 
   int8_t pow2dBm(uint8_t powerIndex) const final;
   OsDeltaTime getDwn2SafetyZone() const final;
@@ -74,6 +95,9 @@ public:
   OsTime nextTx(OsTime now) final;
   OsTime initJoinLoop() final;
   TimeAndStatus nextJoinState() final;
+  void joinAccepted(int16_t rssi, int8_t snr) final;
+  // sub-band (0-7) tried first by the join loop, 0xFF if unknown.
+  uint8_t getJoinSubBand() const { return joinSubBand; };
   void setRx2Parameter(uint32_t rx2frequency, dr_t rx2datarate) final;
   void setRx2DataRate(dr_t rx2datarate) final;
   void setRx1DrOffset(uint8_t drOffset) final;
@@ -83,6 +107,17 @@ public:
   virtual void saveStateWithoutTimeData(StoringAbtract &store) const final;
   virtual void loadState(RetrieveAbtract &store) final;
   virtual void loadStateWithoutTimeData(RetrieveAbtract &store) final;
+
+  // no time data in US915
+  static constexpr uint16_t getStateSize() {
+    return sizeof(channelMap) + sizeof(usedMap) + sizeof(joinAttempt) +
+           sizeof(joinSubBand) + sizeof(joinDr) + sizeof(txChnl) +
+           sizeof(adrTxPow) + sizeof(datarate) + sizeof(rx1DrOffset) +
+           sizeof(rx2Parameter);
+  };
+  static constexpr uint16_t getStateSizeWithoutTimeData() {
+    return getStateSize();
+  };
 #endif
 
   explicit Us915RegionalChannelParams(LmicRand &arand);
@@ -90,7 +125,16 @@ public:
 private:
   // enabled bits
   std::array<uint16_t, (72 + 15) / 16> channelMap;
-  uint16_t chRnd = 0;
+  // channels already used in the current rotation
+  std::array<uint16_t, (72 + 15) / 16> usedMap = {};
+  // join request sent since initJoinLoop
+  uint16_t joinAttempt = 0;
+  // sub-band and datarate of the last join accepted, or heard in channel
+  // mask from network server.
+  uint8_t joinSubBand = 0xFF;
+  dr_t joinDr = SF7;
+  // sub-band of the first join request of the loop.
+  uint8_t joinStartBand = 0;
   // channel for next TX
   uint8_t txChnl = 0;
   // ADR adjusted TX power, limit power to this value.
@@ -102,6 +146,12 @@ private:
   TransmitionParameters rx2Parameter;
   LmicRand &rand;
 
+  uint16_t enabledChannels(uint8_t word) const;
+  bool pickChannel(uint8_t firstWord, uint8_t nbWords,
+                   uint16_t restrict = 0xFFFF);
+  uint8_t enabledSubBands() const;
+  uint8_t joinSubBandAt(uint8_t index) const;
+  void setupJoinAttempt();
   void enableChannel(uint8_t channel);
   void enableSubBand(uint8_t band);
   void disableSubBand(uint8_t band);
@@ -114,6 +164,25 @@ class LmicUs915 final : public Lmic {
 public:
   explicit LmicUs915(Radio &radio);
 
+#if defined(ENABLE_SAVE_RESTORE)
+  static constexpr uint16_t STATE_SIZE =
+      LmicStateSize<Us915RegionalChannelParams>::value;
+  static constexpr uint16_t STATE_SIZE_WITHOUT_TIME_DATA =
+      LmicStateSize<Us915RegionalChannelParams>::withoutTimeData;
+  using State = std::array<uint8_t, STATE_SIZE>;
+
+  using Lmic::loadState;
+  using Lmic::saveState;
+  void saveState(State &state) const {
+    StoringBuffer store{state.begin()};
+    saveState(store);
+  };
+  void loadState(State const &state) {
+    RetrieveBuffer retrieve{state.begin()};
+    loadState(retrieve);
+  };
+#endif
+
 private:
   Aes aes;
   LmicRand rand;
@@ -13,6 +13,7 @@
 #ifndef _lmic_table_h_
 #define _lmic_table_h_
 
+#include <stddef.h>
 #include <stdint.h>
 
 // ======================================================================
@@ -14,6 +14,7 @@
 #define lmic_lmicdynamicchannel_h
 
 #include "bands.h"
+#include "bitmask.h"
 #include "bufferpack.h"
 #include "channelList.h"
 #include "lmic.h"
@@ -25,8 +26,42 @@
 namespace DYNAMIC_CHANNEL {
 constexpr OsDeltaTime DNW2_SAFETY_ZONE = OsDeltaTime::from_ms(3000);
 
+// Parameters of the last join accepted, used to start next join loop.
+struct JoinHint {
+  static constexpr dr_t NO_DR = 0xFF;
+  dr_t dr = NO_DR;
+  uint8_t channel = 0;
+  // join accept link quality
+  int16_t rssi = 0;
+  int8_t snr = 0;
+
+  constexpr bool isValid() const { return dr != NO_DR; }
+
+#if defined(ENABLE_SAVE_RESTORE)
+  // field by field, the padding of the struct is not saved.
+  void saveState(StoringAbtract &store) const {
+    store.write(dr);
+    store.write(channel);
+    store.write(rssi);
+    store.write(snr);
+  };
+
+  void loadState(RetrieveAbtract &store) {
+    store.read(dr);
+    store.read(channel);
+    store.read(rssi);
+    store.read(snr);
+  };
+
+  static constexpr uint16_t getStateSize() {
+    return sizeof(dr) + sizeof(channel) + sizeof(rssi) + sizeof(snr);
+  };
+#endif
+};
+
 template <typename ChannelListType, int8_t MaxEIRP, dr_t MaxJoinDR,
-          dr_t MinJoinDR, const uint8_t *dr_table, dr_t MaxDr,
+          dr_t MinJoinDR, const uint8_t *dr_table,
+          const uint8_t *maxFrameLength_table, dr_t MaxDr,
           uint32_t default_Freq_RX2, uint8_t default_rps_RX2,
           uint8_t maxPowerIndex, uint8_t limitRX1DrOffset,
           uint32_t minFrequency, uint32_t maxFrequency>
@@ -63,6 +98,39 @@ public:
   };
   TransmitionParameters getRx2Parameter() const final { return rx2Parameter; };
 
+  dr_t getTxDr() const final { return datarate; };
+
+  uint8_t getMaxFrameLength(dr_t const dr) const final {
+    return table_get_u1(maxFrameLength_table, dr);
+  };
+
+  uint8_t getChannelCount() const final {
+    return ChannelListType::LIMIT_CHANNELS;
+  };
+
+  bool getChannelAvailability(uint8_t const channel, dr_t const dr,
+                              OsTime const now, uint32_t &frequency,
+                              OsTime &availability) const final {
+    if (channel >= ChannelListType::LIMIT_CHANNELS ||
+        !channels.is_enable_at_dr(channel, dr)) {
+      return false;
+    }
+    frequency = channels.getFrequency(channel);
+    availability = channels.getAvailability(channel);
+    if (availability < now) {
+      availability = now;
+    }
+    return true;
+  };
+
+  OsTime getTxAvailability(OsTime const now) const final {
+    uint16_t candidates = channels.enabledAtDr(datarate);
+    if (candidates == 0) {
+      return now;
+    }
+    return channels.earliestAvailability(candidates, now);
+  };
+
   int8_t pow2dBm(uint8_t const powerIndex) const final {
     if (powerIndex > maxPowerIndex) {
       return InvalidPower;
@@ -139,59 +207,55 @@ public:
   };
 
   OsTime nextTx(OsTime now) final {
-
-    bool channelFound = false;
-    OsTime nextTransmitTime;
-    // next channel or other (random)
-    uint8_t nextChannel = txChnl + 1 + (rand.uint8() % 2);
-
-    for (uint8_t channelIndex = 0;
-         channelIndex < ChannelListType::LIMIT_CHANNELS; channelIndex++) {
-      if (nextChannel >= channels.LIMIT_CHANNELS) {
-        nextChannel = 0;
-      }
-
-      if (channels.is_enable_at_dr(nextChannel, datarate)) {
-        auto availability = channels.getAvailability(nextChannel);
-
-        PRINT_DEBUG(2, F("Considering channel %d"), nextChannel);
-
-        if (!channelFound || availability < nextTransmitTime) {
-          txChnl = nextChannel;
-          nextTransmitTime = availability;
-          channelFound = true;
-        }
-        if (availability < now) {
-          // no need to search better
-          txChnl = nextChannel;
-          return availability;
-        }
-      }
-      nextChannel++;
+    uint16_t candidates = channels.enabledAtDr(datarate);
+    if (candidates == 0) {
+      // Fail to find a channel continue on current one.
+      // UGLY FAILBACK
+      PRINT_DEBUG(1, F("Error Fail to find a channel."));
+      return now;
     }
 
-    if (channelFound) {
-      return nextTransmitTime;
+    auto const availability = channels.earliestAvailability(candidates, now);
+
+    // spread uplinks: random channel among the first available, other than
+    // the last one used when possible.
+    uint16_t const others = candidates & ~(1 << txChnl);
+    if (others != 0) {
+      candidates = others;
     }
+    txChnl = mask_select(candidates, rand.uint8() % mask_count(candidates));
 
-    // Fail to find a channel continue on current one.
-    // UGLY FAILBACK
-    PRINT_DEBUG(1, F("Error Fail to find a channel."));
-    return now;
+    PRINT_DEBUG(2, F("Select channel %d"), txChnl);
+    return availability;
   };
 
   OsTime initJoinLoop() final {
-    txChnl = rand.uint8() % 3;
     adrTxPow = MaxEIRP;
-    setDrJoin(MaxJoinDR);
+    joinCount = 0;
+    if (joinHint.isValid()) {
+      // start where last join succeeded
+      txChnl = joinHint.channel;
+      setDrJoin(joinStartDr());
+    } else {
+      txChnl = rand.uint8() % 3;
+      setDrJoin(MaxJoinDR);
+    }
     auto startTime =
-        channels.getAvailability(0) + OsDeltaTime::rnd_delay(rand, 8);
+        channels.getAvailability(txChnl) + OsDeltaTime::rnd_delay(rand, 8);
     PRINT_DEBUG(1,
                 F("Init Join loop : avail=%" PRIu32 " startTime=%" PRIu32 ""),
-                channels.getAvailability(0).tick(), startTime.tick());
+                channels.getAvailability(txChnl).tick(), startTime.tick());
     return startTime;
   };
 
+  void joinAccepted(int16_t const rssi, int8_t const snr) final {
+    joinHint = {datarate, txChnl, rssi, snr};
+    PRINT_DEBUG(2, F("Join hint DR%d channel %d snr %d"), datarate, txChnl,
+                snr);
+  };
+
+  JoinHint const &getJoinHint() const { return joinHint; };
+
   TimeAndStatus nextJoinState() final {
     bool failed = false;
 
@@ -204,7 +268,8 @@ public:
       if (datarate == MinJoinDR) {
         // we have tried all DR - signal EV_JOIN_FAILED
         failed = true;
-        // and retry from highest datarate.
+        // hint was wrong, retry from highest datarate.
+        joinHint = JoinHint();
         datarate = MaxJoinDR;
         txChnl = rand.uint8() % 3;
       } else {
@@ -257,7 +322,7 @@ public:
   dr_t lowerDR(dr_t const dr, uint8_t const n) const {
     return dr < n ? 0 : dr - n;
   };
-  rps_t getRps(dr_t const dr) const {
+  rps_t getRps(dr_t const dr) const final {
     return rps_t(table_get_u1(dr_table, dr));
   };
   rps_t getRpsDw(dr_t const dr) const {
@@ -276,6 +341,7 @@ private:
     store.write(datarate);
     store.write(rx1DrOffset);
     store.write(rx2Parameter);
+    joinHint.saveState(store);
   };
   void loadStateCommun(RetrieveAbtract &store) {
     store.read(txChnl);
@@ -283,6 +349,7 @@ private:
     store.read(datarate);
     store.read(rx1DrOffset);
     store.read(rx2Parameter);
+    joinHint.loadState(store);
   };
 
 public:
@@ -305,6 +372,23 @@ public:
     channels.loadStateWithoutTimeData(store);
     loadStateCommun(store);
   };
+
+  static constexpr uint16_t getStateSize() {
+    return ChannelListType::getStateBytes() + getStateSizeCommun();
+  };
+  static constexpr uint16_t getStateSizeWithoutTimeData() {
+    return ChannelListType::getStateBytesWithoutTimeData() +
+           getStateSizeCommun();
+  };
+
+private:
+  static constexpr uint16_t getStateSizeCommun() {
+    return sizeof(txChnl) + sizeof(adrTxPow) + sizeof(datarate) +
+           sizeof(rx1DrOffset) + sizeof(rx2Parameter) +
+           JoinHint::getStateSize();
+  };
+
+public:
 #endif
 
   explicit DynamicRegionalChannelParams(LmicRand &arand) : rand{arand} {};
@@ -330,8 +414,26 @@ protected:
   uint8_t joinCount = 0;
   TransmitionParameters rx2Parameter = {default_Freq_RX2, rps_t(default_rps_RX2), 0};
 
+  JoinHint joinHint;
+
 private:
   dr_t getRx1Dr() const { return lowerDR(datarate, rx1DrOffset); };
+
+  // Datarate of the hint, one step faster when the join accept was received
+  // with 10dB of margin, one step slower under 3dB.
+  dr_t joinStartDr() const {
+    auto const sf = getRps(joinHint.dr).sf;
+    // demodulation floor: -7.5dB at SF7, 2.5dB lower by SF step.
+    int16_t const floor_x2 = -15 - 5 * (sf - SF7);
+    int16_t const margin_x2 = 2 * joinHint.snr - floor_x2;
+    if (margin_x2 >= 2 * 10 && joinHint.dr < MaxJoinDR) {
+      return joinHint.dr + 1;
+    }
+    if (margin_x2 < 2 * 3 && joinHint.dr > MinJoinDR) {
+      return joinHint.dr - 1;
+    }
+    return joinHint.dr;
+  };
 };
 
 } // namespace DYNAMIC_CHANNEL
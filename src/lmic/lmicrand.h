@@ -13,6 +13,7 @@
 #ifndef _lmicrand_h_
 #define _lmicrand_h_
 
+#include "bufferpack.h"
 #include <stdint.h>
 #include <array>
 
@@ -25,8 +26,14 @@ class LmicRand {
 public:
   explicit LmicRand(Aes &){};
   void init(Radio &){};
+  void mix(uint32_t){};
   uint8_t uint8();
   uint16_t uint16();
+
+  // hardware random generator, nothing to save.
+  void saveState(StoringAbtract &) const {};
+  void loadState(RetrieveAbtract &){};
+  static constexpr uint16_t getStateSize() { return 0; };
 };
 
 #else
@@ -34,14 +41,22 @@ public:
 class LmicRand {
 public:
   explicit LmicRand(Aes &aes);
+  // seed the pool from radio noise (slow).
   void init(Radio &radio);
+  // mix a cheap fresh sample in the pool (time of wake up...).
+  void mix(uint32_t sample);
   uint8_t uint8();
   uint16_t uint16();
 
+  // The pool is saved to avoid the radio seed at each wake up.
+  void saveState(StoringAbtract &store) const;
+  void loadState(RetrieveAbtract &store);
+  static constexpr uint16_t getStateSize() { return sizeof(randbuf); };
+
 private:
   Aes &aes;
   uint8_t index = 16;
-  std::array<uint8_t,16> randbuf;
+  std::array<uint8_t,16> randbuf = {};
 };
 #endif
 
@@ -24,6 +24,28 @@ void LmicRand::init(Radio &radio) {
   index = 16;
 }
 
+void LmicRand::mix(uint32_t const sample) {
+  randbuf[0] ^= static_cast<uint8_t>(sample);
+  randbuf[1] ^= static_cast<uint8_t>(sample >> 8);
+  randbuf[2] ^= static_cast<uint8_t>(sample >> 16);
+  randbuf[3] ^= static_cast<uint8_t>(sample >> 24);
+  // encrypt at next to spread the sample.
+  index = 16;
+}
+
+void LmicRand::saveState(StoringAbtract &store) const {
+  // pool is saved after a new encryption, the next values are not
+  // the one already given.
+  std::array<uint8_t, 16> pool = randbuf;
+  aes.encrypt(pool.begin(), pool.size());
+  store.write(pool);
+}
+
+void LmicRand::loadState(RetrieveAbtract &store) {
+  store.read(randbuf);
+  index = 16;
+}
+
 // return next random byte derived from seed buffer
 uint8_t LmicRand::uint8() {
   if (index >= randbuf.size()) {
@@ -53,6 +53,8 @@ constexpr uint8_t STD_PREAMBLE_LEN = 8;
 
 constexpr uint8_t MAX_LEN_FRAME = LMIC_MAX_BUFFER_LENGTH;
 constexpr uint8_t MAX_LEN_FOPTS = 15;
+// max forward jump of downlink counter (LoRaWAN 1.0.2 MAX_FCNT_GAP).
+constexpr int32_t MAX_FCNT_GAP = 16384;
 constexpr uint8_t DELAY_JACC1 = 5;   // in secs
 constexpr uint8_t DELAY_DNW1 = 1;    // in secs down window #1
 constexpr uint8_t DELAY_EXTDNW2 = 1; // in secs
@@ -62,11 +64,32 @@ constexpr uint8_t DELAY_DNW2 =
 
 using FrameBuffer = std::array<uint8_t, MAX_LEN_FRAME>;
 
+#if defined(LMIC_SINGLE_BUFFER)
+// Pending uplink payload is kept in the TX frame, downlinks are received
+// in a separate area, set LMIC_RX_BUFFER_LENGTH to make it smaller than
+// MAX_LEN_FRAME (64 for the biggest downlink at DR0-DR2 in EU868).
+#ifndef LMIC_RX_BUFFER_LENGTH
+#define LMIC_RX_BUFFER_LENGTH LMIC_MAX_BUFFER_LENGTH
+#endif
+// join accept with CFList must fit.
+static_assert(LMIC_RX_BUFFER_LENGTH >= 33, "RX buffer too small");
+static_assert(LMIC_RX_BUFFER_LENGTH <= LMIC_MAX_BUFFER_LENGTH,
+              "RX buffer bigger than frame");
+using RxFrameBuffer = std::array<uint8_t, LMIC_RX_BUFFER_LENGTH>;
+#else
+using RxFrameBuffer = FrameBuffer;
+#endif
+
 enum class PktDir : uint8_t {
   UP = 0,
   DOWN = 1,
 };
 constexpr uint8_t MAX_LEN_PAYLOAD = MAX_LEN_FRAME - 8 - 4;
+#if defined(LMIC_SINGLE_BUFFER)
+// payload kept in frame must still fit when FOpts grow to their max (and port).
+constexpr uint8_t MAX_LEN_IN_FRAME_PAYLOAD =
+    MAX_LEN_PAYLOAD - MAX_LEN_FOPTS - 1;
+#endif
 
 enum {
   // Bitfields in frame control octet
@@ -77,6 +77,10 @@ constexpr OsDeltaTime operator+(OsDeltaTime const &a, OsDeltaTime const &b) {
   return OsDeltaTime(a.tick() + b.tick());
 }
 
+constexpr OsDeltaTime operator-(OsDeltaTime const &a, OsDeltaTime const &b) {
+  return OsDeltaTime(a.tick() - b.tick());
+}
+
 constexpr OsDeltaTime operator*(int16_t const &a, OsDeltaTime const &b) {
   return OsDeltaTime(a * b.tick());
 }
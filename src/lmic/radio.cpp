@@ -10,5 +10,22 @@ int8_t Radio::get_last_packet_snr_x4() const {
   return last_packet_snr_reg;
 }
 
+void Radio::rx_duty_cycle(uint32_t const freq, rps_t const rps, OsDeltaTime,
+                          OsDeltaTime) {
+  rx(freq, rps);
+}
+
+OsDeltaTime Radio::rx_duty_cycle_poll() { return OsInfiniteDeltaTime; }
+
+RxActivity Radio::rx_activity() const { return RxActivity::HEADER; }
+
+void Radio::rx_abort() {}
+
+uint8_t Radio::noise_sample() const { return 0; }
+
+bool Radio::resume() {
+  init();
+  return false;
+}
 
 Radio::Radio() {}
@@ -19,20 +19,52 @@
 #include <stdint.h>
 #include <array>
 
+// Activity seen by the radio during a rx window.
+enum class RxActivity : uint8_t {
+  // Channel idle
+  NONE,
+  // A preamble has been detected, no valid header yet
+  PREAMBLE,
+  // A valid header has been received, frame reception in progress
+  HEADER,
+};
+
 class Radio {
 
 public:
   explicit Radio();
   virtual void init(void) = 0;
+  // Wake up after a MCU deep sleep where the radio was kept in sleep.
+  // Skip reset and checks and return true if the radio retained its state.
+  // Default implementation do a full init.
+  virtual bool resume();
   virtual void rst() const = 0;
   virtual void tx(uint32_t freq, rps_t rps, int8_t txpow,
                   uint8_t const *framePtr, uint8_t frameLength) = 0;
   virtual void rx(uint32_t freq, rps_t rps, uint8_t rxsyms, OsTime rxtime) = 0;
   // Rx continuous
   virtual void rx(uint32_t freq, rps_t rps) = 0;
+  // Rx continuous with low power listening, the radio alternate
+  // rxPeriod of listening and sleepPeriod of sleep until a preamble is found.
+  // Default implementation fall back to rx continuous.
+  virtual void rx_duty_cycle(uint32_t freq, rps_t rps, OsDeltaTime rxPeriod,
+                             OsDeltaTime sleepPeriod);
+  // Called regularly while rx duty cycle is active, for radio where
+  // the listen/sleep loop is driven by the MCU.
+  // Return the delay before the radio need to be polled again.
+  virtual OsDeltaTime rx_duty_cycle_poll();
+  // Activity of the current rx window.
+  // Default implementation cannot tell, it report a reception in progress
+  // so the window is never closed early.
+  virtual RxActivity rx_activity() const;
+  // Close the current rx window and put the radio in sleep.
+  virtual void rx_abort();
 
   virtual void init_random(std::array<uint8_t,16> &randbuf) = 0;
-  virtual uint8_t handle_end_rx(FrameBuffer &frame, bool goSleep) = 0;
+  // One noise read (a single register access) mixed in the random pool when
+  // the slow seed is skipped. Default 0: radio without it in sleep mode.
+  virtual uint8_t noise_sample() const;
+  virtual uint8_t handle_end_rx(RxFrameBuffer &frame, bool goSleep) = 0;
   virtual void handle_end_tx() const = 0;
 
   virtual uint8_t rssi() const = 0;
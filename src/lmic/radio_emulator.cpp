@@ -0,0 +1,111 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "radio_emulator.h"
+
+#if LMIC_HAL_IO == LMIC_GENERIC
+
+#include "../hal/hal.h"
+#include <algorithm>
+#include <cmath>
+
+void RadioEmulator::install() { hal_io_set_device(this); }
+
+void RadioEmulator::uninstall() { hal_io_set_device(nullptr); }
+
+void RadioEmulator::select() {
+  update(hal_ticks());
+  stats.transactions++;
+  begin_transaction();
+}
+
+void RadioEmulator::deselect() { end_transaction(); }
+
+uint8_t RadioEmulator::transfer(uint8_t const outval) {
+  stats.bytes++;
+  return transfer_byte(outval);
+}
+
+bool RadioEmulator::dio(uint8_t const index) {
+  update(hal_ticks());
+  return dio_value(index);
+}
+
+void RadioEmulator::simulateRx(EmulatedPacket const &packet,
+                               OsTime const start) {
+  pendingRx = packet;
+  pendingRx.start = start;
+  pendingRx.end =
+      start + timeOnAir(packet.sf, packet.bw, packet.cr, packet.crc, false,
+                        symbolTime(packet.sf, packet.bw).to_us() >= 16000,
+                        8, packet.length);
+}
+
+EmulatedPacket RadioEmulator::popLastTx() {
+  auto const packet = lastTx;
+  lastTx = EmulatedPacket();
+  return packet;
+}
+
+void RadioEmulator::listenStart(OsTime const time) {
+  if (!listening) {
+    listening = true;
+    listenBegin = time;
+  }
+}
+
+void RadioEmulator::listenStop(OsTime const time) {
+  if (listening) {
+    listening = false;
+    rxTime += time - listenBegin;
+  }
+}
+
+OsDeltaTime RadioEmulator::symbolTime(uint8_t const sf, uint16_t const bw) {
+  return OsDeltaTime::from_us_round((1000 << sf) / bw);
+}
+
+OsDeltaTime RadioEmulator::timeOnAir(uint8_t const sf, uint16_t const bw,
+                                     uint8_t const cr, bool const crc,
+                                     bool const implicitHeader,
+                                     bool const ldro,
+                                     uint16_t const preambleLength,
+                                     uint8_t const length) {
+  double const tsym = std::ldexp(1.0, sf) / (bw * 1000.0);
+  double const tpreamble = (preambleLength + 4.25) * tsym;
+  double const num = 8.0 * length - 4.0 * sf + 28 + (crc ? 16 : 0) -
+                     (implicitHeader ? 20 : 0);
+  double const den = 4.0 * (sf - (ldro ? 2 : 0));
+  double const payloadSymbols =
+      8 + std::max(std::ceil(num / den) * cr, 0.0);
+  double const seconds = tpreamble + payloadSymbols * tsym;
+  return OsDeltaTime(static_cast<int32_t>(
+      std::lround(seconds * OSTICKS_PER_SEC)));
+}
+
+uint8_t RadioEmulator::noise() {
+  // 16 bits galois LFSR
+  uint16_t const lsb = lfsr & 1u;
+  lfsr >>= 1;
+  if (lsb) {
+    lfsr ^= 0xB400u;
+  }
+  return static_cast<uint8_t>(lfsr);
+}
+
+bool RadioEmulator::canReceive(uint32_t const freq, uint8_t const sf,
+                               uint16_t const bw, OsTime const listenStart,
+                               OsDeltaTime const maxPreambleWait) const {
+  if (!pendingRx.is_valid() || pendingRx.freq != freq || pendingRx.sf != sf ||
+      pendingRx.bw != bw) {
+    return false;
+  }
+  // need at least 4 symbols of preamble to lock.
+  auto const lastLock =
+      pendingRx.start + OsDeltaTime(4 * symbolTime(sf, bw).tick());
+  return listenStart <= lastLock &&
+         pendingRx.start <= listenStart + maxPreambleWait;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef radio_emulator_h
+#define radio_emulator_h
+
+#include "../boardconfig.h"
+
+#if LMIC_HAL_IO == LMIC_GENERIC
+
+#include "../hal/hal_io.h"
+#include "osticks.h"
+#include <array>
+#include <stdint.h>
+
+/**
+ * Count of SPI transfers done with the emulated radio.
+ */
+struct SpiStats {
+  // number of NSS low / NSS high sequences
+  uint32_t transactions = 0;
+  // number of bytes exchanged (command, address and data)
+  uint32_t bytes = 0;
+};
+
+/**
+ * LoRa packet on air, seen by the emulated radio.
+ */
+struct EmulatedPacket {
+  // frequency is zero if not a valid packet
+  uint32_t freq = 0;
+  // 7..12
+  uint8_t sf = 7;
+  // in kHz 125, 250, 500
+  uint16_t bw = 125;
+  // 5..8 for 4/5..4/8
+  uint8_t cr = 5;
+  bool crc = true;
+  // false for a preamble without valid header (noise, collision).
+  bool header = true;
+  std::array<uint8_t, 256> data = {};
+  uint8_t length = 0;
+  // start of transmission (first preamble symbol)
+  OsTime start;
+  // end of transmission
+  OsTime end;
+  int16_t rssi = -60;
+  // SNR in dB * 4
+  int8_t snr = 20;
+
+  bool is_valid() const { return freq != 0; }
+};
+
+/**
+ * Common part of radio emulators, connected to the generic HAL.
+ * Time of the radio is the time of the HAL, use hal_add_time_in_sleep to
+ * advance it.
+ */
+class RadioEmulator : public HalIoDevice {
+public:
+  // Connect the emulator to the generic HAL.
+  void install();
+  // Disconnect the emulator from the generic HAL.
+  void uninstall();
+
+  void select() final;
+  void deselect() final;
+  uint8_t transfer(uint8_t outval) final;
+  bool dio(uint8_t index) final;
+
+  SpiStats const &spiStats() const { return stats; }
+  void resetSpiStats() { stats = SpiStats(); }
+
+  // Time with the receiver on (rx and cad), of the listen already ended.
+  OsDeltaTime rxOnTime() const { return rxTime; }
+  void resetRxOnTime() { rxTime = OsDeltaTime(0); }
+
+  /**
+   * Packet sent by the gateway, received if the radio listen
+   * on the same frequency and spreading factor when it start.
+   * Only rx of sf and bw have to be set in packet, start and end are computed.
+   */
+  void simulateRx(EmulatedPacket const &packet, OsTime start);
+  // last packet transmitted by the radio.
+  EmulatedPacket popLastTx();
+
+  /**
+   * Time on air of a packet (formula from SX1276 datasheet).
+   */
+  static OsDeltaTime timeOnAir(uint8_t sf, uint16_t bw, uint8_t cr, bool crc,
+                               bool implicitHeader, bool ldro,
+                               uint16_t preambleLength, uint8_t length);
+  static OsDeltaTime symbolTime(uint8_t sf, uint16_t bw);
+
+protected:
+  EmulatedPacket pendingRx;
+  EmulatedPacket lastTx;
+
+  // Current operation of the radio, with end time.
+  bool operationPending = false;
+  OsTime operationEnd;
+
+  // random generator for noise
+  uint16_t lfsr = 0xACE1;
+  uint8_t noise();
+
+  // Receiver turned on / off at time.
+  void listenStart(OsTime time);
+  void listenStop(OsTime time);
+
+  // Check if pending rx packet can be received by a listen starting at
+  // listenStart with the radio settings.
+  bool canReceive(uint32_t freq, uint8_t sf, uint16_t bw, OsTime listenStart,
+                  OsDeltaTime maxPreambleWait) const;
+
+  virtual void begin_transaction() = 0;
+  virtual void end_transaction() = 0;
+  virtual uint8_t transfer_byte(uint8_t outval) = 0;
+  virtual bool dio_value(uint8_t index) const = 0;
+  // apply the events which have occurred before now.
+  virtual void update(OsTime now) = 0;
+
+private:
+  SpiStats stats;
+  bool listening = false;
+  OsTime listenBegin;
+  OsDeltaTime rxTime;
+};
+
+#endif
+
+#endif
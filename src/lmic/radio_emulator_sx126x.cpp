@@ -0,0 +1,502 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "radio_emulator_sx126x.h"
+
+#if LMIC_HAL_IO == LMIC_GENERIC
+
+#include "../hal/hal.h"
+#include <algorithm>
+
+namespace {
+enum Opcode : uint8_t {
+  ClearIrqStatus = 0x02,
+  ClearDeviceErrors = 0x07,
+  SetDioIrqParams = 0x08,
+  WriteRegister = 0x0D,
+  WriteBuffer = 0x0E,
+  GetStats = 0x10,
+  GetPacketType = 0x11,
+  GetIrqStatus = 0x12,
+  GetRxBufferStatus = 0x13,
+  GetPacketStatus = 0x14,
+  GetRssiInst = 0x15,
+  GetDeviceErrors = 0x17,
+  ReadRegister = 0x1D,
+  ReadBuffer = 0x1E,
+  SetStandby = 0x80,
+  SetRx = 0x82,
+  SetTx = 0x83,
+  SetSleep = 0x84,
+  SetRfFrequency = 0x86,
+  SetModulationParams = 0x8B,
+  SetPacketParams = 0x8C,
+  SetBufferBaseAddress = 0x8F,
+  SetRxDutyCycle = 0x94,
+  SetLoRaSymbNumTimeout = 0xA0,
+  GetStatus = 0xC0,
+  SetFs = 0xC1,
+  SetCad = 0xC5,
+};
+
+constexpr uint16_t IRQ_TX_DONE = 1 << 0;
+constexpr uint16_t IRQ_RX_DONE = 1 << 1;
+constexpr uint16_t IRQ_PREAMBLE_DETECTED = 1 << 2;
+constexpr uint16_t IRQ_HEADER_VALID = 1 << 4;
+constexpr uint16_t IRQ_HEADER_ERR = 1 << 5;
+constexpr uint16_t IRQ_CAD_DONE = 1 << 7;
+constexpr uint16_t IRQ_CAD_DETECTED = 1 << 8;
+constexpr uint16_t IRQ_TIMEOUT = 1 << 9;
+
+constexpr uint16_t REG_RANDOM = 0x0819;
+
+// Symbols of sync word and header after the preamble.
+constexpr uint8_t SYNC_HEADER_SYMS = 13;
+
+// step of timeout and periods 15.625us
+OsDeltaTime from_steps(uint32_t steps) {
+  return OsDeltaTime::from_us(static_cast<int64_t>(steps) * 125 / 8);
+}
+
+uint32_t read24(uint8_t const *p) {
+  return (static_cast<uint32_t>(p[0]) << 16) |
+         (static_cast<uint32_t>(p[1]) << 8) | p[2];
+}
+} // namespace
+
+RadioEmulatorSx126x::RadioEmulatorSx126x() { reset(); }
+
+OsDeltaTime RadioEmulatorSx126x::rxDutyCycleRxPeriod() const {
+  return from_steps(dutyCycleRxSteps);
+}
+
+OsDeltaTime RadioEmulatorSx126x::rxDutyCycleSleepPeriod() const {
+  return from_steps(dutyCycleSleepSteps);
+}
+
+void RadioEmulatorSx126x::reset() {
+  coldReset();
+  chipMode = Mode::STDBY_RC;
+  commands = 0;
+}
+
+void RadioEmulatorSx126x::coldReset() {
+  buffer.fill(0);
+  registers.fill(0);
+  // LoRa sync word
+  registers[0x0740] = 0x14;
+  registers[0x0741] = 0x24;
+  rfFrequency = 0;
+  sfParam = 7;
+  bwParam = 4;
+  crParam = 1;
+  ldroParam = false;
+  preambleLength = 8;
+  implicitHeader = false;
+  payloadLength = 0;
+  crcOn = true;
+  txBaseAddress = 0;
+  rxBaseAddress = 0;
+  symbNumTimeout = 0;
+  dutyCycleRxSteps = 0;
+  dutyCycleSleepSteps = 0;
+  irqMask = 0;
+  dio1Mask = 0;
+  irq = 0;
+  operation = Operation::NONE;
+  operationPending = false;
+  receiving = false;
+}
+
+void RadioEmulatorSx126x::begin_transaction() {
+  index = 0;
+  // NSS falling edge wake up the chip
+  if (chipMode == Mode::SLEEP) {
+    chipMode = Mode::STDBY_RC;
+  }
+}
+
+void RadioEmulatorSx126x::end_transaction() {
+  if (index > 0) {
+    commands++;
+    execute();
+  }
+}
+
+uint8_t RadioEmulatorSx126x::transfer_byte(uint8_t const outval) {
+  uint16_t const position = index++;
+  if (position == 0) {
+    opcode = outval;
+    return status();
+  }
+
+  switch (opcode) {
+  case WriteRegister:
+    if (position < 3) {
+      parameters[position - 1] = outval;
+    } else {
+      uint16_t const addr = (parameters[0] << 8 | parameters[1]) + position - 3;
+      registers[addr & 0x0FFF] = outval;
+    }
+    return status();
+  case WriteBuffer:
+    if (position < 2) {
+      parameters[0] = outval;
+    } else {
+      buffer[static_cast<uint8_t>(parameters[0] + position - 2)] = outval;
+    }
+    return status();
+  case ReadRegister:
+    if (position < 3) {
+      parameters[position - 1] = outval;
+      return status();
+    }
+    return response(position);
+  case ReadBuffer:
+    if (position < 2) {
+      parameters[0] = outval;
+      return status();
+    }
+    return response(position);
+  case GetStatus:
+  case GetStats:
+  case GetPacketType:
+  case GetIrqStatus:
+  case GetRxBufferStatus:
+  case GetPacketStatus:
+  case GetRssiInst:
+  case GetDeviceErrors:
+    return response(position);
+  default:
+    if (position - 1u < parameters.size()) {
+      parameters[position - 1] = outval;
+    }
+    return status();
+  }
+}
+
+uint8_t RadioEmulatorSx126x::response(uint16_t const position) {
+  // first byte after opcode (and address) is the status
+  switch (opcode) {
+  case ReadRegister: {
+    if (position == 3) {
+      return status();
+    }
+    uint16_t const addr = (parameters[0] << 8 | parameters[1]) + position - 4;
+    if (addr >= REG_RANDOM && addr < REG_RANDOM + 4 && chipMode == Mode::RX) {
+      return noise();
+    }
+    return registers[addr & 0x0FFF];
+  }
+  case ReadBuffer:
+    if (position == 2) {
+      return status();
+    }
+    return buffer[static_cast<uint8_t>(parameters[0] + position - 3)];
+  case GetStatus:
+    return status();
+  default:
+    break;
+  }
+
+  if (position == 1) {
+    return status();
+  }
+  uint16_t const pos = position - 2;
+  switch (opcode) {
+  case GetPacketType:
+    return 0x01;
+  case GetIrqStatus:
+    return pos == 0 ? static_cast<uint8_t>(irq >> 8)
+                    : static_cast<uint8_t>(irq & 0xFF);
+  case GetRxBufferStatus:
+    return pos == 0 ? rxPayloadLength : rxBaseAddress;
+  case GetPacketStatus:
+    if (pos == 1) {
+      return static_cast<uint8_t>(rxSnr);
+    }
+    return static_cast<uint8_t>(-rxRssi * 2);
+  case GetRssiInst:
+    return static_cast<uint8_t>(200 + (noise() & 0x0F));
+  default:
+    return 0;
+  }
+}
+
+uint8_t RadioEmulatorSx126x::status() const {
+  uint8_t mode = 0;
+  switch (chipMode) {
+  case Mode::STDBY_RC:
+    mode = 0x2;
+    break;
+  case Mode::STDBY_XOSC:
+    mode = 0x3;
+    break;
+  case Mode::FS:
+    mode = 0x4;
+    break;
+  case Mode::RX:
+    mode = 0x5;
+    break;
+  case Mode::TX:
+    mode = 0x6;
+    break;
+  default:
+    break;
+  }
+  // command status 0x1 : command successfully processed
+  return static_cast<uint8_t>((mode << 4) | (0x1 << 1));
+}
+
+void RadioEmulatorSx126x::execute() {
+  auto const now = hal_ticks();
+  uint8_t const *const p = parameters.data();
+
+  switch (opcode) {
+  case ClearIrqStatus:
+    irq &= ~static_cast<uint16_t>(p[0] << 8 | p[1]);
+    break;
+  case SetDioIrqParams:
+    irqMask = static_cast<uint16_t>(p[0] << 8 | p[1]);
+    dio1Mask = static_cast<uint16_t>(p[2] << 8 | p[3]);
+    break;
+  case SetStandby:
+    operation = Operation::NONE;
+    operationPending = false;
+    receiving = false;
+    listenStop(now);
+    chipMode = p[0] ? Mode::STDBY_XOSC : Mode::STDBY_RC;
+    break;
+  case SetSleep:
+    // bit 2 : warm start, configuration retained
+    if (!(p[0] & 0x04)) {
+      coldReset();
+    }
+    operation = Operation::NONE;
+    operationPending = false;
+    listenStop(now);
+    chipMode = Mode::SLEEP;
+    break;
+  case SetFs:
+    listenStop(now);
+    chipMode = Mode::FS;
+    break;
+  case SetRfFrequency:
+    rfFrequency = static_cast<uint32_t>(p[0]) << 24 |
+                  static_cast<uint32_t>(p[1]) << 16 |
+                  static_cast<uint32_t>(p[2]) << 8 | p[3];
+    break;
+  case SetModulationParams:
+    sfParam = p[0];
+    bwParam = p[1];
+    crParam = p[2];
+    ldroParam = p[3];
+    break;
+  case SetPacketParams:
+    preambleLength = static_cast<uint16_t>(p[0] << 8 | p[1]);
+    implicitHeader = p[2];
+    payloadLength = p[3];
+    crcOn = p[4];
+    break;
+  case SetBufferBaseAddress:
+    txBaseAddress = p[0];
+    rxBaseAddress = p[1];
+    break;
+  case SetLoRaSymbNumTimeout:
+    symbNumTimeout = p[0];
+    break;
+  case SetTx: {
+    lastTx = EmulatedPacket();
+    lastTx.freq = frequency();
+    lastTx.sf = sfParam;
+    lastTx.bw = bw();
+    lastTx.cr = 4 + crParam;
+    lastTx.crc = crcOn;
+    lastTx.length = payloadLength;
+    for (uint8_t i = 0; i < payloadLength; i++) {
+      lastTx.data[i] = buffer[static_cast<uint8_t>(txBaseAddress + i)];
+    }
+    lastTx.start = now;
+    lastTx.end = now + packetTimeOnAir(payloadLength);
+    listenStop(now);
+    chipMode = Mode::TX;
+    operation = Operation::TX;
+    operationPending = true;
+    operationEnd = lastTx.end;
+    break;
+  }
+  case SetRx:
+    startRx(read24(p));
+    break;
+  case SetRxDutyCycle:
+    // Listen periods are not modeled, a packet is received as in continuous
+    // mode, the radio goes to standby after the reception.
+    dutyCycleRxSteps = read24(p);
+    dutyCycleSleepSteps = read24(p + 3);
+    startRx(0xFFFFFF);
+    rxKind = RxKind::DUTY_CYCLE;
+    break;
+  case SetCad: {
+    auto const duration = OsDeltaTime(2 * symbol().tick());
+    cadDetected = pendingRx.is_valid() && pendingRx.freq == frequency() &&
+                  pendingRx.sf == sfParam && pendingRx.start <= now + duration &&
+                  now < pendingRx.end;
+    chipMode = Mode::RX;
+    listenStart(now);
+    operation = Operation::CAD;
+    operationPending = true;
+    operationEnd = now + duration;
+    break;
+  }
+  default:
+    // other commands (calibration, PA, regulator, DIO2/3...) only
+    // change analog settings.
+    break;
+  }
+}
+
+void RadioEmulatorSx126x::startRx(uint32_t const timeout) {
+  auto const now = hal_ticks();
+  chipMode = Mode::RX;
+  listenStart(now);
+  operation = Operation::RX;
+  receiving = false;
+  operationPending = false;
+
+  OsDeltaTime maxPreambleWait(0);
+  if (timeout == 0xFFFFFF) {
+    rxKind = RxKind::CONTINUOUS;
+  } else if (timeout == 0) {
+    rxKind = RxKind::SINGLE;
+    maxPreambleWait = OsDeltaTime(symbNumTimeout * symbol().tick());
+    if (symbNumTimeout != 0) {
+      operationPending = true;
+      operationEnd = now + maxPreambleWait;
+    }
+  } else {
+    rxKind = RxKind::TIMER;
+    maxPreambleWait = from_steps(timeout);
+    operationPending = true;
+    operationEnd = now + maxPreambleWait;
+  }
+
+  if (canReceive(frequency(), sfParam, bw(), now, maxPreambleWait)) {
+    receiving = true;
+    operationPending = true;
+    operationEnd = std::max(pendingRx.end, now);
+  }
+}
+
+void RadioEmulatorSx126x::setIrq(uint16_t const flags) {
+  irq |= flags & irqMask;
+}
+
+void RadioEmulatorSx126x::finishOperation() {
+  operationPending = false;
+  switch (operation) {
+  case Operation::TX:
+    setIrq(IRQ_TX_DONE);
+    chipMode = Mode::STDBY_RC;
+    operation = Operation::NONE;
+    break;
+  case Operation::RX:
+    if (receiving && !pendingRx.header) {
+      setIrq(IRQ_PREAMBLE_DETECTED | IRQ_HEADER_ERR);
+      pendingRx = EmulatedPacket();
+      receiving = false;
+      if (rxKind == RxKind::CONTINUOUS) {
+        return;
+      }
+    } else if (receiving) {
+      for (uint8_t i = 0; i < pendingRx.length; i++) {
+        buffer[static_cast<uint8_t>(rxBaseAddress + i)] = pendingRx.data[i];
+      }
+      rxPayloadLength = pendingRx.length;
+      rxRssi = pendingRx.rssi;
+      rxSnr = pendingRx.snr;
+      setIrq(IRQ_PREAMBLE_DETECTED | IRQ_HEADER_VALID | IRQ_RX_DONE);
+      pendingRx = EmulatedPacket();
+      receiving = false;
+      if (rxKind == RxKind::CONTINUOUS) {
+        // stay in rx
+        return;
+      }
+    } else {
+      setIrq(IRQ_TIMEOUT);
+    }
+    listenStop(operationEnd);
+    chipMode = Mode::STDBY_RC;
+    operation = Operation::NONE;
+    break;
+  case Operation::CAD:
+    setIrq(cadDetected ? (IRQ_CAD_DONE | IRQ_CAD_DETECTED) : IRQ_CAD_DONE);
+    listenStop(operationEnd);
+    chipMode = Mode::STDBY_RC;
+    operation = Operation::NONE;
+    break;
+  default:
+    break;
+  }
+}
+
+void RadioEmulatorSx126x::update(OsTime const now) {
+  if (operation == Operation::RX && !receiving &&
+      (rxKind == RxKind::CONTINUOUS || rxKind == RxKind::DUTY_CYCLE) &&
+      pendingRx.is_valid() && pendingRx.freq == frequency() &&
+      pendingRx.sf == sfParam && pendingRx.start <= now) {
+    receiving = true;
+    operationPending = true;
+    operationEnd = pendingRx.end;
+  }
+  if (operation == Operation::RX && receiving) {
+    if (pendingRx.start + OsDeltaTime(4 * symbol().tick()) <= now) {
+      setIrq(IRQ_PREAMBLE_DETECTED);
+    }
+    if (pendingRx.header &&
+        pendingRx.start + OsDeltaTime((preambleLength + SYNC_HEADER_SYMS) *
+                                      symbol().tick()) <=
+            now) {
+      setIrq(IRQ_HEADER_VALID);
+    }
+  }
+  if (operationPending && operationEnd <= now) {
+    finishOperation();
+  }
+}
+
+bool RadioEmulatorSx126x::dio_value(uint8_t const index) const {
+  if (index == 1) {
+    return irq & dio1Mask;
+  }
+  // busy
+  return false;
+}
+
+uint32_t RadioEmulatorSx126x::frequency() const {
+  // RF_Freq = freq * 2^25 / 32Mhz, round to hundred of Hz
+  uint64_t const freq = (static_cast<uint64_t>(rfFrequency) * 32000000) >> 25;
+  return (static_cast<uint32_t>(freq) + 50) / 100 * 100;
+}
+
+uint16_t RadioEmulatorSx126x::bw() const {
+  switch (bwParam) {
+  case 0x05:
+    return 250;
+  case 0x06:
+    return 500;
+  default:
+    return 125;
+  }
+}
+
+OsDeltaTime RadioEmulatorSx126x::symbol() const {
+  return symbolTime(sfParam, bw());
+}
+
+OsDeltaTime RadioEmulatorSx126x::packetTimeOnAir(uint8_t const length) const {
+  return timeOnAir(sfParam, bw(), 4 + crParam, crcOn, implicitHeader,
+                   ldroParam, preambleLength, length);
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef radio_emulator_sx126x_h
+#define radio_emulator_sx126x_h
+
+#include "radio_emulator.h"
+
+#if LMIC_HAL_IO == LMIC_GENERIC
+
+/**
+ * Command level emulation of a SX1262 in LoRa mode.
+ * Model the commands used by the driver, the data buffer, the register
+ * space, the chip mode (sleep, standby, fs, rx, tx), IRQ status with DIO1
+ * mask, and time on air of TX, RX (single, continuous, duty cycle) and CAD.
+ * Busy pin (DIO0 of the HAL) is always low.
+ */
+class RadioEmulatorSx126x final : public RadioEmulator {
+public:
+  enum class Mode : uint8_t { SLEEP, STDBY_RC, STDBY_XOSC, FS, RX, TX };
+
+  explicit RadioEmulatorSx126x();
+
+  void reset() final;
+
+  Mode mode() const { return chipMode; }
+  uint16_t irqStatus() const { return irq; }
+  // number of command received since reset
+  uint32_t commandCount() const { return commands; }
+  // periods of the last SetRxDutyCycle.
+  OsDeltaTime rxDutyCycleRxPeriod() const;
+  OsDeltaTime rxDutyCycleSleepPeriod() const;
+
+protected:
+  void begin_transaction() final;
+  void end_transaction() final;
+  uint8_t transfer_byte(uint8_t outval) final;
+  bool dio_value(uint8_t index) const final;
+  void update(OsTime now) final;
+
+private:
+  enum class Operation : uint8_t { NONE, TX, RX, CAD };
+  enum class RxKind : uint8_t { SINGLE, CONTINUOUS, DUTY_CYCLE, TIMER };
+
+  Mode chipMode = Mode::SLEEP;
+  Operation operation = Operation::NONE;
+  RxKind rxKind = RxKind::SINGLE;
+  bool receiving = false;
+  bool cadDetected = false;
+
+  // configuration
+  uint32_t rfFrequency = 0;
+  uint8_t sfParam = 7;
+  uint8_t bwParam = 4;
+  uint8_t crParam = 1;
+  bool ldroParam = false;
+  uint16_t preambleLength = 8;
+  bool implicitHeader = false;
+  uint8_t payloadLength = 0;
+  bool crcOn = true;
+  uint8_t txBaseAddress = 0;
+  uint8_t rxBaseAddress = 0;
+  uint8_t symbNumTimeout = 0;
+  uint32_t dutyCycleRxSteps = 0;
+  uint32_t dutyCycleSleepSteps = 0;
+  uint16_t irqMask = 0;
+  uint16_t dio1Mask = 0;
+  uint16_t irq = 0;
+
+  // last received packet
+  uint8_t rxPayloadLength = 0;
+  int16_t rxRssi = 0;
+  int8_t rxSnr = 0;
+
+  std::array<uint8_t, 256> buffer;
+  std::array<uint8_t, 0x1000> registers;
+
+  // SPI state
+  uint8_t opcode = 0;
+  uint16_t index = 0;
+  std::array<uint8_t, 16> parameters;
+  uint32_t commands = 0;
+
+  void coldReset();
+  void execute();
+  void setIrq(uint16_t flags);
+  void finishOperation();
+  void startRx(uint32_t timeout);
+  uint8_t status() const;
+  uint8_t response(uint16_t position);
+
+  uint32_t frequency() const;
+  uint16_t bw() const;
+  OsDeltaTime symbol() const;
+  OsDeltaTime packetTimeOnAir(uint8_t length) const;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,400 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "radio_emulator_sx127x.h"
+
+#if LMIC_HAL_IO == LMIC_GENERIC
+
+#include "../hal/hal.h"
+#include <algorithm>
+
+namespace {
+constexpr uint8_t RegFifo = 0x00;
+constexpr uint8_t RegOpMode = 0x01;
+constexpr uint8_t RegFrfMsb = 0x06;
+constexpr uint8_t RegFrfMid = 0x07;
+constexpr uint8_t RegFrfLsb = 0x08;
+constexpr uint8_t LORARegFifoAddrPtr = 0x0D;
+constexpr uint8_t LORARegFifoTxBaseAddr = 0x0E;
+constexpr uint8_t LORARegFifoRxBaseAddr = 0x0F;
+constexpr uint8_t LORARegFifoRxCurrentAddr = 0x10;
+constexpr uint8_t LORARegIrqFlagsMask = 0x11;
+constexpr uint8_t LORARegIrqFlags = 0x12;
+constexpr uint8_t LORARegRxNbBytes = 0x13;
+constexpr uint8_t LORARegModemStat = 0x18;
+constexpr uint8_t LORARegPktSnrValue = 0x19;
+constexpr uint8_t LORARegPktRssiValue = 0x1A;
+constexpr uint8_t LORARegModemConfig1 = 0x1D;
+constexpr uint8_t LORARegModemConfig2 = 0x1E;
+constexpr uint8_t LORARegSymbTimeoutLsb = 0x1F;
+constexpr uint8_t LORARegPreambleMsb = 0x20;
+constexpr uint8_t LORARegPreambleLsb = 0x21;
+constexpr uint8_t LORARegPayloadLength = 0x22;
+constexpr uint8_t LORARegModemConfig3 = 0x26;
+constexpr uint8_t LORARegRssiWideband = 0x2C;
+constexpr uint8_t RegDioMapping1 = 0x40;
+constexpr uint8_t RegVersion = 0x42;
+
+constexpr uint8_t OPMODE_LORA = 0x80;
+constexpr uint8_t OPMODE_MASK = 0x07;
+constexpr uint8_t OPMODE_SLEEP = 0x00;
+constexpr uint8_t OPMODE_STANDBY = 0x01;
+constexpr uint8_t OPMODE_TX = 0x03;
+constexpr uint8_t OPMODE_RX = 0x05;
+constexpr uint8_t OPMODE_RX_SINGLE = 0x06;
+constexpr uint8_t OPMODE_CAD = 0x07;
+
+constexpr uint8_t IRQ_LORA_RXTOUT = 0x80;
+constexpr uint8_t IRQ_LORA_RXDONE = 0x40;
+constexpr uint8_t IRQ_LORA_HEADER = 0x10;
+constexpr uint8_t IRQ_LORA_TXDONE = 0x08;
+constexpr uint8_t IRQ_LORA_CDDONE = 0x04;
+constexpr uint8_t IRQ_LORA_FHSSCH = 0x02;
+constexpr uint8_t IRQ_LORA_CDDETD = 0x01;
+
+// Flags of DIO0 and DIO1 indexed by mapping value
+constexpr uint8_t DIO0_FLAGS[4] = {IRQ_LORA_RXDONE, IRQ_LORA_TXDONE,
+                                   IRQ_LORA_CDDONE, 0};
+constexpr uint8_t DIO1_FLAGS[4] = {IRQ_LORA_RXTOUT, IRQ_LORA_FHSSCH,
+                                   IRQ_LORA_CDDETD, 0};
+
+constexpr uint8_t MODEM_STAT_SIGNAL_DETECTED = 0x01;
+constexpr uint8_t MODEM_STAT_SIGNAL_SYNCHRONIZED = 0x02;
+constexpr uint8_t MODEM_STAT_RX_ONGOING = 0x04;
+constexpr uint8_t MODEM_STAT_HEADER_INFO_VALID = 0x08;
+constexpr uint8_t MODEM_STAT_MODEM_CLEAR = 0x10;
+
+// Symbols of sync word and header after the preamble.
+constexpr uint8_t SYNC_HEADER_SYMS = 13;
+} // namespace
+
+RadioEmulatorSx127x::RadioEmulatorSx127x() { reset(); }
+
+void RadioEmulatorSx127x::reset() {
+  // Default values of registers in LoRa mode (datasheet)
+  regs.fill(0);
+  regs[RegOpMode] = 0x09;
+  regs[RegFrfMsb] = 0x6C;
+  regs[RegFrfMid] = 0x80;
+  regs[0x09] = 0x4F;
+  regs[0x0A] = 0x09;
+  regs[0x0B] = 0x2B;
+  regs[0x0C] = 0x20;
+  regs[LORARegFifoTxBaseAddr] = 0x80;
+  regs[LORARegModemConfig1] = 0x72;
+  regs[LORARegModemConfig2] = 0x70;
+  regs[LORARegSymbTimeoutLsb] = 0x64;
+  regs[LORARegPreambleLsb] = 0x08;
+  regs[LORARegPayloadLength] = 0x01;
+  regs[0x23] = 0xFF;
+  regs[0x24] = 0x00;
+  regs[LORARegModemConfig3] = 0x04;
+  regs[0x31] = 0xC3;
+  regs[0x33] = 0x27;
+  regs[0x37] = 0x0A;
+  regs[0x39] = 0x12;
+  regs[RegVersion] = 0x12;
+  regs[0x4D] = 0x84;
+  fifo.fill(0);
+  operation = Operation::NONE;
+  operationPending = false;
+  receiving = false;
+}
+
+uint8_t RadioEmulatorSx127x::mode() const {
+  return regs[RegOpMode] & OPMODE_MASK;
+}
+
+void RadioEmulatorSx127x::begin_transaction() { firstByte = true; }
+
+void RadioEmulatorSx127x::end_transaction() {}
+
+uint8_t RadioEmulatorSx127x::transfer_byte(uint8_t const outval) {
+  if (firstByte) {
+    firstByte = false;
+    writeAccess = outval & 0x80;
+    address = outval & 0x7F;
+    return 0;
+  }
+
+  uint8_t const addr = address;
+  // burst access, the fifo is not incremented
+  if (address != RegFifo) {
+    address = (address + 1) & 0x7F;
+  }
+  if (writeAccess) {
+    writeRegister(addr, outval);
+    return 0;
+  }
+  return readRegister(addr);
+}
+
+uint8_t RadioEmulatorSx127x::readRegister(uint8_t const addr) {
+  switch (addr) {
+  case RegFifo: {
+    uint8_t const val = fifo[regs[LORARegFifoAddrPtr]];
+    regs[LORARegFifoAddrPtr]++;
+    return val;
+  }
+  case LORARegModemStat:
+    return modemStatus(hal_ticks());
+  case LORARegRssiWideband:
+    return noise();
+  default:
+    return regs[addr];
+  }
+}
+
+void RadioEmulatorSx127x::writeRegister(uint8_t const addr,
+                                        uint8_t const value) {
+  switch (addr) {
+  case RegFifo:
+    fifo[regs[LORARegFifoAddrPtr]] = value;
+    regs[LORARegFifoAddrPtr]++;
+    break;
+  case RegOpMode: {
+    // LoRa bit can only be changed in sleep mode
+    uint8_t lora = regs[RegOpMode] & OPMODE_LORA;
+    if (mode() == OPMODE_SLEEP) {
+      lora = value & OPMODE_LORA;
+    }
+    regs[RegOpMode] = (value & ~OPMODE_LORA) | lora;
+    changeMode(value & OPMODE_MASK);
+    break;
+  }
+  case LORARegIrqFlags:
+    // write one to clear
+    regs[LORARegIrqFlags] &= ~value;
+    break;
+  case LORARegModemStat:
+  case LORARegRxNbBytes:
+  case LORARegFifoRxCurrentAddr:
+  case LORARegPktSnrValue:
+  case LORARegPktRssiValue:
+  case RegVersion:
+    // read only
+    break;
+  default:
+    regs[addr] = value;
+  }
+}
+
+void RadioEmulatorSx127x::changeMode(uint8_t const newMode) {
+  auto const now = hal_ticks();
+  operation = Operation::NONE;
+  operationPending = false;
+  receiving = false;
+  listenStop(now);
+
+  switch (newMode) {
+  case OPMODE_SLEEP:
+    // FIFO is cleared in sleep mode.
+    fifo.fill(0);
+    break;
+  case OPMODE_TX: {
+    uint8_t const len = regs[LORARegPayloadLength];
+    lastTx = EmulatedPacket();
+    lastTx.freq = frequency();
+    lastTx.sf = sf();
+    lastTx.bw = bw();
+    lastTx.cr = cr();
+    lastTx.crc = crc();
+    lastTx.length = len;
+    for (uint8_t i = 0; i < len; i++) {
+      lastTx.data[i] =
+          fifo[static_cast<uint8_t>(regs[LORARegFifoTxBaseAddr] + i)];
+    }
+    lastTx.start = now;
+    lastTx.end = now + timeOnAir(sf(), bw(), cr(), crc(), implicitHeader(),
+                                 ldro(), preambleLength(), len);
+    operation = Operation::TX;
+    operationPending = true;
+    operationEnd = lastTx.end;
+    break;
+  }
+  case OPMODE_RX:
+  case OPMODE_RX_SINGLE: {
+    bool const single = newMode == OPMODE_RX_SINGLE;
+    auto const timeout = OsDeltaTime(symbolTimeout() * symbol().tick());
+    operation = Operation::RX;
+    operationPending = true;
+    listenStart(now);
+    if (canReceive(frequency(), sf(), bw(), now,
+                   single ? timeout : OsDeltaTime(0))) {
+      receiving = true;
+      operationEnd = std::max(pendingRx.end, now);
+    } else if (single) {
+      operationEnd = now + timeout;
+    } else {
+      // continuous rx wait for ever
+      operationPending = false;
+    }
+    break;
+  }
+  case OPMODE_CAD: {
+    // CAD last about 2 symbols.
+    auto const duration = OsDeltaTime(2 * symbol().tick());
+    cadDetected = pendingRx.is_valid() && pendingRx.freq == frequency() &&
+                  pendingRx.sf == sf() && pendingRx.start <= now + duration &&
+                  now < pendingRx.end;
+    operation = Operation::CAD;
+    operationPending = true;
+    operationEnd = now + duration;
+    listenStart(now);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void RadioEmulatorSx127x::setIrq(uint8_t const flags) {
+  regs[LORARegIrqFlags] |= flags & ~regs[LORARegIrqFlagsMask];
+}
+
+void RadioEmulatorSx127x::finishOperation() {
+  operationPending = false;
+  switch (operation) {
+  case Operation::TX:
+    setIrq(IRQ_LORA_TXDONE);
+    regs[RegOpMode] = (regs[RegOpMode] & ~OPMODE_MASK) | OPMODE_STANDBY;
+    break;
+  case Operation::RX:
+    if (receiving && pendingRx.header) {
+      uint8_t const base = regs[LORARegFifoRxBaseAddr];
+      for (uint8_t i = 0; i < pendingRx.length; i++) {
+        fifo[static_cast<uint8_t>(base + i)] = pendingRx.data[i];
+      }
+      regs[LORARegFifoRxCurrentAddr] = base;
+      regs[LORARegRxNbBytes] = pendingRx.length;
+      regs[LORARegPktSnrValue] = static_cast<uint8_t>(pendingRx.snr);
+      regs[LORARegPktRssiValue] = static_cast<uint8_t>(pendingRx.rssi + 139);
+      setIrq(IRQ_LORA_HEADER | IRQ_LORA_RXDONE);
+      pendingRx = EmulatedPacket();
+      receiving = false;
+    } else if (receiving) {
+      // preamble only, modem back to preamble search until the timeout.
+      pendingRx = EmulatedPacket();
+      receiving = false;
+      setIrq(IRQ_LORA_RXTOUT);
+    } else {
+      setIrq(IRQ_LORA_RXTOUT);
+    }
+    if (mode() == OPMODE_RX_SINGLE) {
+      listenStop(operationEnd);
+      regs[RegOpMode] = (regs[RegOpMode] & ~OPMODE_MASK) | OPMODE_STANDBY;
+    } else {
+      // continuous rx, wait the next packet.
+      operationPending = false;
+    }
+    break;
+  case Operation::CAD:
+    setIrq(cadDetected ? (IRQ_LORA_CDDONE | IRQ_LORA_CDDETD)
+                       : IRQ_LORA_CDDONE);
+    listenStop(operationEnd);
+    regs[RegOpMode] = (regs[RegOpMode] & ~OPMODE_MASK) | OPMODE_STANDBY;
+    break;
+  default:
+    break;
+  }
+}
+
+void RadioEmulatorSx127x::update(OsTime const now) {
+  // packet sent after the start of a continuous rx.
+  if (operation == Operation::RX && !receiving && mode() == OPMODE_RX &&
+      pendingRx.is_valid() && pendingRx.freq == frequency() &&
+      pendingRx.sf == sf() && pendingRx.start <= now) {
+    receiving = true;
+    operationPending = true;
+    operationEnd = pendingRx.end;
+  }
+  if (operation == Operation::RX && receiving && pendingRx.header &&
+      headerEnd() <= now) {
+    setIrq(IRQ_LORA_HEADER);
+  }
+  if (operationPending && operationEnd <= now) {
+    finishOperation();
+  }
+}
+
+bool RadioEmulatorSx127x::dio_value(uint8_t const index) const {
+  uint8_t const mapping = regs[RegDioMapping1];
+  uint8_t const flags = regs[LORARegIrqFlags];
+  if (index == 0) {
+    return flags & DIO0_FLAGS[(mapping >> 6) & 0x03];
+  }
+  if (index == 1) {
+    return flags & DIO1_FLAGS[(mapping >> 4) & 0x03];
+  }
+  return false;
+}
+
+uint8_t RadioEmulatorSx127x::modemStatus(OsTime const now) const {
+  if (operation != Operation::RX || !receiving || now < pendingRx.start) {
+    return MODEM_STAT_MODEM_CLEAR;
+  }
+  uint8_t status = MODEM_STAT_SIGNAL_DETECTED | MODEM_STAT_SIGNAL_SYNCHRONIZED |
+                   MODEM_STAT_RX_ONGOING;
+  if (pendingRx.header && headerEnd() <= now) {
+    status |= MODEM_STAT_HEADER_INFO_VALID;
+  }
+  return status;
+}
+
+OsTime RadioEmulatorSx127x::headerEnd() const {
+  return pendingRx.start +
+         OsDeltaTime((preambleLength() + SYNC_HEADER_SYMS) * symbol().tick());
+}
+
+uint32_t RadioEmulatorSx127x::frequency() const {
+  uint64_t const frf = (static_cast<uint32_t>(regs[RegFrfMsb]) << 16) |
+                       (static_cast<uint32_t>(regs[RegFrfMid]) << 8) |
+                       regs[RegFrfLsb];
+  // FQ = (FRF * 32 Mhz) / (2 ^ 19), round to hundred of Hz
+  return (static_cast<uint32_t>((frf * 32000000) >> 19) + 50) / 100 * 100;
+}
+
+uint8_t RadioEmulatorSx127x::sf() const {
+  return regs[LORARegModemConfig2] >> 4;
+}
+
+uint16_t RadioEmulatorSx127x::bw() const {
+  switch (regs[LORARegModemConfig1] >> 4) {
+  case 8:
+    return 250;
+  case 9:
+    return 500;
+  default:
+    return 125;
+  }
+}
+
+uint8_t RadioEmulatorSx127x::cr() const {
+  return 4 + ((regs[LORARegModemConfig1] >> 1) & 0x07);
+}
+
+bool RadioEmulatorSx127x::crc() const {
+  return regs[LORARegModemConfig2] & 0x04;
+}
+
+bool RadioEmulatorSx127x::implicitHeader() const {
+  return regs[LORARegModemConfig1] & 0x01;
+}
+
+bool RadioEmulatorSx127x::ldro() const {
+  return regs[LORARegModemConfig3] & 0x08;
+}
+
+uint16_t RadioEmulatorSx127x::preambleLength() const {
+  return (regs[LORARegPreambleMsb] << 8) | regs[LORARegPreambleLsb];
+}
+
+uint16_t RadioEmulatorSx127x::symbolTimeout() const {
+  return ((regs[LORARegModemConfig2] & 0x03) << 8) |
+         regs[LORARegSymbTimeoutLsb];
+}
+
+OsDeltaTime RadioEmulatorSx127x::symbol() const { return symbolTime(sf(), bw()); }
+
+#endif
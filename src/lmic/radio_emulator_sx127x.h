@@ -0,0 +1,70 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef radio_emulator_sx127x_h
+#define radio_emulator_sx127x_h
+
+#include "radio_emulator.h"
+
+#if LMIC_HAL_IO == LMIC_GENERIC
+
+/**
+ * Register level emulation of a SX1276 in LoRa mode.
+ * Model the register file, the FIFO, opmode transitions, IRQ flags with mask
+ * and DIO0/DIO1 mapping, and time on air of TX, RX and CAD.
+ */
+class RadioEmulatorSx127x final : public RadioEmulator {
+public:
+  explicit RadioEmulatorSx127x();
+
+  void reset() final;
+
+  uint8_t reg(uint8_t addr) const { return regs[addr & 0x7F]; }
+  uint8_t mode() const;
+
+protected:
+  void begin_transaction() final;
+  void end_transaction() final;
+  uint8_t transfer_byte(uint8_t outval) final;
+  bool dio_value(uint8_t index) const final;
+  void update(OsTime now) final;
+
+private:
+  std::array<uint8_t, 0x80> regs;
+  std::array<uint8_t, 256> fifo;
+
+  // SPI state
+  bool firstByte = true;
+  bool writeAccess = false;
+  uint8_t address = 0;
+
+  enum class Operation : uint8_t { NONE, TX, RX, CAD };
+  Operation operation = Operation::NONE;
+  bool receiving = false;
+  bool cadDetected = false;
+
+  uint8_t readRegister(uint8_t addr);
+  void writeRegister(uint8_t addr, uint8_t value);
+  void changeMode(uint8_t newMode);
+  void setIrq(uint8_t flags);
+  void finishOperation();
+
+  uint32_t frequency() const;
+  uint8_t sf() const;
+  uint16_t bw() const;
+  uint8_t cr() const;
+  bool crc() const;
+  bool implicitHeader() const;
+  bool ldro() const;
+  uint16_t preambleLength() const;
+  uint16_t symbolTimeout() const;
+  OsDeltaTime symbol() const;
+  uint8_t modemStatus(OsTime now) const;
+  // end of the header of the packet received.
+  OsTime headerEnd() const;
+};
+
+#endif
+
+#endif
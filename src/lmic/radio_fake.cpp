@@ -27,7 +27,7 @@ uint8_t RadioFake::rssi() const { return 0; }
 
 // called by hal ext IRQ handler
 // (radio goes to stanby mode after tx/rx operations)
-uint8_t RadioFake::handle_end_rx(FrameBuffer &frame, bool) {
+uint8_t RadioFake::handle_end_rx(RxFrameBuffer &frame, bool) {
   if (!isReceived) {
     PRINT_DEBUG(1, F("Handle end rx without message"));
     return 0;
@@ -45,7 +45,7 @@ public:
   void rx(uint32_t freq, rps_t rps) final;
 
   void init_random(std::array<uint8_t, 16> &randbuf) final;
-  uint8_t handle_end_rx(FrameBuffer &frame, bool goSleep) final;
+  uint8_t handle_end_rx(RxFrameBuffer &frame, bool goSleep) final;
   void handle_end_tx() const final;
   bool io_check() const final;
 
@@ -4,6 +4,7 @@
 
 #include "radio_sx1262.h"
 #include "../hal/print_debug.h"
+#include "../hal/hal_trace.h"
 
 #include "../aes/lmic_aes.h"
 #include "lmic_table.h"
@@ -200,6 +201,13 @@ constexpr uint8_t cr_to_parameter(CodingRate cr) {
           static_cast<uint8_t>(cr));
 }
 
+// Duty cycle periods are in step of 15.625us (1/64 ms), 24 bits.
+uint32_t to_duty_cycle_period(OsDeltaTime const period) {
+  auto const steps = static_cast<uint32_t>(period.to_us()) * 8 / 125;
+  return std::min(std::max(steps, static_cast<uint32_t>(1)),
+                  static_cast<uint32_t>(0xFFFFFF));
+}
+
 constexpr uint8_t crForLog(rps_t const rps) {
   return (5 - static_cast<uint8_t>(CodingRate::CR_4_5) +
           static_cast<uint8_t>(rps.getCr()));
@@ -244,6 +252,19 @@ struct SetLoraSymbNumCommand : Sx1262Command<1> {
   void set_lora_symb_num(uint8_t rxsyms) { parameter[0] = rxsyms; };
 };
 
+struct SetRxDutyCycleCommand : Sx1262Command<6> {
+  SetRxDutyCycleCommand()
+      : Sx1262Command<6>{RadioCommand::SetRxDutyCycle, {}} {};
+  void set_periods(uint32_t rxPeriod, uint32_t sleepPeriod) {
+    parameter[0] = static_cast<uint8_t>(rxPeriod >> 16);
+    parameter[1] = static_cast<uint8_t>(rxPeriod >> 8);
+    parameter[2] = static_cast<uint8_t>(rxPeriod);
+    parameter[3] = static_cast<uint8_t>(sleepPeriod >> 16);
+    parameter[4] = static_cast<uint8_t>(sleepPeriod >> 8);
+    parameter[5] = static_cast<uint8_t>(sleepPeriod);
+  };
+};
+
 // Fixed value commands
 
 /**
@@ -315,6 +336,7 @@ constexpr Sx1262Command_P<2> clear_all_irq PROGMEM =
 } // namespace
 
 void RadioSx1262::init() {
+  TraceOperationScope const trace(TraceOperation::INIT);
   PRINT_DEBUG(1, F("Radio Init"));
   hal.init();
   // manually reset radio
@@ -341,8 +363,26 @@ void RadioSx1262::init() {
   set_sleep();
 }
 
+bool RadioSx1262::resume() {
+  {
+    TraceOperationScope const trace(TraceOperation::INIT);
+    hal.init();
+    // NSS wake up the chip in standby RC, configuration and calibration are
+    // done before each operation.
+    wait_ready(hal);
+    if (((get_status() >> 4) & 7) == 0x2) {
+      set_sleep();
+      return true;
+    }
+  }
+  PRINT_DEBUG(1, F("Radio not ready"));
+  init();
+  return false;
+}
+
 // get random seed from wideband noise rssi
 void RadioSx1262::init_random(std::array<uint8_t, 16> &randbuf) {
+  TraceOperationScope const trace(TraceOperation::INIT_RANDOM);
   PRINT_DEBUG(1, F("Init random"));
 
   init_config();
@@ -366,10 +406,12 @@ uint8_t RadioSx1262::rssi() const { return 0; }
 
 // called by hal ext IRQ handler
 // (radio goes to stanby mode after tx/rx operations)
-uint8_t RadioSx1262::handle_end_rx(FrameBuffer &frame, bool goSleep) {
+uint8_t RadioSx1262::handle_end_rx(RxFrameBuffer &frame, bool goSleep) {
+  TraceOperationScope const trace(TraceOperation::END_RX);
   uint16_t flags = get_irq_status();
 
   uint16_t const RxDone = 1 << 1;
+  uint16_t const HeaderErr = 1 << 5;
   uint16_t const Timeout = 1 << 9;
 
   uint8_t length = 0;
@@ -380,18 +422,50 @@ uint8_t RadioSx1262::handle_end_rx(FrameBuffer &frame, bool goSleep) {
   } else if (flags & Timeout) {
     // indicate timeout
     PRINT_DEBUG(1, F("RX timeout"));
+  } else if (flags & HeaderErr) {
+    PRINT_DEBUG(1, F("RX header error"));
+  }
+
+  if (goSleep) {
+    // no interrupt
+    set_dio1_irq_params(0x00);
+    clear_all_irq();
+    rx_duty_cycle_rx_period = 0;
+    set_sleep();
+  } else {
+    PRINT_DEBUG(1, F("RX CONTINUE"));
+    clear_all_irq();
+    // in duty cycle mode the radio go back to standby after a reception.
+    if (rx_duty_cycle_rx_period != 0) {
+      set_rx_duty_cycle();
+    }
+  }
+  return length;
+}
+
+RxActivity RadioSx1262::rx_activity() const {
+  uint16_t const flags = get_irq_status();
+  uint16_t const PreambleDetected = 1 << 2;
+  uint16_t const HeaderValid = 1 << 4;
+  if (flags & HeaderValid) {
+    return RxActivity::HEADER;
   }
+  if (flags & PreambleDetected) {
+    return RxActivity::PREAMBLE;
+  }
+  return RxActivity::NONE;
+}
 
+void RadioSx1262::rx_abort() {
+  rx_duty_cycle_rx_period = 0;
   // no interrupt
   set_dio1_irq_params(0x00);
   clear_all_irq();
-
-  if (goSleep)
-    set_sleep();
-  return length;
+  set_sleep();
 }
 
 void RadioSx1262::handle_end_tx() const {
+  TraceOperationScope const trace(TraceOperation::END_TX);
   // no interrupt
   set_dio1_irq_params(0x00);
   clear_all_irq();
@@ -406,6 +480,8 @@ void RadioSx1262::rst() const {
 
 void RadioSx1262::tx(uint32_t const freq, rps_t const rps, int8_t const txpow,
                      uint8_t const *const framePtr, uint8_t const frameLength) {
+  TraceOperationScope const trace(TraceOperation::TX);
+  rx_duty_cycle_rx_period = 0;
   init_config();
   set_rf_frequency(freq);
   set_modulation_params_lora(rps);
@@ -428,6 +504,8 @@ void RadioSx1262::tx(uint32_t const freq, rps_t const rps, int8_t const txpow,
 
 void RadioSx1262::rx(uint32_t const freq, rps_t const rps, uint8_t const rxsyms,
                      OsTime const rxtime) {
+  TraceOperationScope const trace(TraceOperation::RX);
+  rx_duty_cycle_rx_period = 0;
   init_config();
   set_rf_frequency(freq);
   set_modulation_params_lora(rps);
@@ -437,8 +515,15 @@ void RadioSx1262::rx(uint32_t const freq, rps_t const rps, uint8_t const rxsyms,
 
   set_lora_symb_num_timeout(rxsyms);
   uint16_t const RxDone = 1 << 1;
+  uint16_t const PreambleDetected = 1 << 2;
+  uint16_t const HeaderValid = 1 << 4;
+  uint16_t const HeaderErr = 1 << 5;
   uint16_t const Timeout = 1 << 9;
-  set_dio1_irq_params(RxDone | Timeout);
+  // Preamble and header are only latched for rx_activity,
+  // a header error end the reception like a timeout.
+  set_dio1_irq_params(RxDone | PreambleDetected | HeaderValid | HeaderErr |
+                          Timeout,
+                      RxDone | HeaderErr | Timeout);
   clear_all_irq();
 
   // ramp up
@@ -454,6 +539,8 @@ void RadioSx1262::rx(uint32_t const freq, rps_t const rps, uint8_t const rxsyms,
 }
 
 void RadioSx1262::rx(uint32_t const freq, rps_t const rps) {
+  TraceOperationScope const trace(TraceOperation::RX);
+  rx_duty_cycle_rx_period = 0;
   init_config();
   set_rf_frequency(freq);
   set_modulation_params_lora(rps);
@@ -471,6 +558,32 @@ void RadioSx1262::rx(uint32_t const freq, rps_t const rps) {
   set_rx_continious();
 }
 
+void RadioSx1262::rx_duty_cycle(uint32_t const freq, rps_t const rps,
+                                OsDeltaTime const rxPeriod,
+                                OsDeltaTime const sleepPeriod) {
+  TraceOperationScope const trace(TraceOperation::RX);
+  init_config();
+  set_rf_frequency(freq);
+  set_modulation_params_lora(rps);
+  set_packet_params_lora(rps, MAX_LEN_FRAME, true);
+  // enable antenna switch for RX
+  hal.pin_switch_antenna_tx(false);
+
+  uint16_t const RxDone = 1 << 1;
+  set_dio1_irq_params(RxDone);
+  clear_all_irq();
+
+  rx_duty_cycle_rx_period = to_duty_cycle_period(rxPeriod);
+  rx_duty_cycle_sleep_period = to_duty_cycle_period(sleepPeriod);
+  // the radio alternate rx and sleep (warm start) by itself,
+  // it stay in rx when a preamble is detected.
+  set_rx_duty_cycle();
+
+  PRINT_DEBUG(1, F("RXMODE_DUTY_CYCLE, freq=%" PRIu32 ", rx=%" PRIu32
+                   ", sleep=%" PRIu32),
+              freq, rx_duty_cycle_rx_period, rx_duty_cycle_sleep_period);
+}
+
 /**
  * Check the IO pin.
  * Return true if the radio has finish it's operation
@@ -619,7 +732,7 @@ void RadioSx1262::write_frame(uint8_t const *framePtr,
   hal.endspi();
 }
 
-uint8_t RadioSx1262::read_frame(FrameBuffer &frame) const {
+uint8_t RadioSx1262::read_frame(RxFrameBuffer &frame) const {
   // read frame status
   Sx1262Command<2> frame_status = {RadioCommand::GetRxBufferStatus,
                                    {0x00, 0x00}};
@@ -674,14 +787,21 @@ void RadioSx1262::clear_all_irq() const {
 }
 
 void RadioSx1262::set_dio1_irq_params(uint16_t mask) const {
+  set_dio1_irq_params(mask, mask);
+}
+
+void RadioSx1262::set_dio1_irq_params(uint16_t irqMask,
+                                      uint16_t dio1Mask) const {
 
-  auto const maskH = static_cast<uint8_t>(mask >> 8);
-  auto maskL = static_cast<uint8_t>(mask & 0xFF);
+  auto const maskH = static_cast<uint8_t>(irqMask >> 8);
+  auto const maskL = static_cast<uint8_t>(irqMask & 0xFF);
+  auto const dio1MaskH = static_cast<uint8_t>(dio1Mask >> 8);
+  auto const dio1MaskL = static_cast<uint8_t>(dio1Mask & 0xFF);
 
   send_command(hal, Sx1262Command<8>{RadioCommand::SetDioIrqParams,
                                      {maskH, maskL,
                                       // DIO1
-                                      maskH, maskL,
+                                      dio1MaskH, dio1MaskL,
                                       // DIO2
                                       0x00, 0x00,
                                       // DIO 3
@@ -697,6 +817,12 @@ void RadioSx1262::set_rx_continious() const {
   send_command(hal, cmds::set_rx_continious);
 }
 
+void RadioSx1262::set_rx_duty_cycle() const {
+  cmds::SetRxDutyCycleCommand cmd;
+  cmd.set_periods(rx_duty_cycle_rx_period, rx_duty_cycle_sleep_period);
+  send_command(hal, cmd);
+}
+
 uint8_t RadioSx1262::get_rssi_inst() const {
   Sx1262Command<1> cmd{RadioCommand::GetRssiInst, {}};
   read_command(hal, cmd);
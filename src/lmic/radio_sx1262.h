@@ -24,6 +24,9 @@ private:
   // ImageCalibrationBand const image_calibration_band;
   uint16_t const image_calibration_params;
   bool const DIO2_as_rf_switch_ctrl;
+  // rx duty cycle periods in step of 15.625us, 0 when not active.
+  uint32_t rx_duty_cycle_rx_period = 0;
+  uint32_t rx_duty_cycle_sleep_period = 0;
 
 public:
   explicit RadioSx1262(lmic_pinmap const &pins,
@@ -32,14 +35,19 @@ public:
                        ImageCalibrationBand calibration_band,
                        bool dio2_as_rf_switch_ctrl);
   void init() final;
+  bool resume() final;
   void rst() const final;
   void tx(uint32_t freq, rps_t rps, int8_t txpow, uint8_t const *framePtr,
           uint8_t frameLength) final;
   void rx(uint32_t freq, rps_t rps, uint8_t rxsyms, OsTime rxtime) final;
   void rx(uint32_t freq, rps_t rps) final;
+  void rx_duty_cycle(uint32_t freq, rps_t rps, OsDeltaTime rxPeriod,
+                     OsDeltaTime sleepPeriod) final;
+  RxActivity rx_activity() const final;
+  void rx_abort() final;
 
   void init_random(std::array<uint8_t, 16> &randbuf) final;
-  uint8_t handle_end_rx(FrameBuffer &frame, bool goSleep) final;
+  uint8_t handle_end_rx(RxFrameBuffer &frame, bool goSleep) final;
   void handle_end_tx() const final;
   bool io_check() const final;
 
@@ -59,7 +67,7 @@ private:
   void init_config() const;
 
   void write_frame(uint8_t const *framePtr, uint8_t frameLength) const;
-  uint8_t read_frame(FrameBuffer &frame) const;
+  uint8_t read_frame(RxFrameBuffer &frame) const;
   uint8_t get_status() const;
   uint16_t get_device_errors() const;
   uint16_t get_irq_status() const;
@@ -67,8 +75,10 @@ private:
 
   void clear_all_irq() const;
   void set_dio1_irq_params(uint16_t mask) const;
+  void set_dio1_irq_params(uint16_t irqMask, uint16_t dio1Mask) const;
   void set_rx() const;
   void set_rx_continious() const;
+  void set_rx_duty_cycle() const;
   void set_tx() const;
   void set_fs() const;
   void set_lora_symb_num_timeout(uint8_t rxsyms) const;
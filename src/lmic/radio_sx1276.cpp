@@ -12,6 +12,7 @@
 
 #include "radio_sx1276.h"
 #include "../hal/print_debug.h"
+#include "../hal/hal_trace.h"
 
 #include "../aes/lmic_aes.h"
 #include "bufferpack.h"
@@ -109,6 +110,10 @@ constexpr uint8_t LORA_MAC_PREAMBLE = 0x34;
 constexpr uint8_t RXLORA_RXMODE_RSSI_REG_MODEM_CONFIG1 = 0x0A;
 constexpr uint8_t RXLORA_RXMODE_RSSI_REG_MODEM_CONFIG2 = 0x70;
 
+// RegModemStat
+constexpr uint8_t MODEM_STAT_SIGNAL_DETECTED = 0x01;
+constexpr uint8_t MODEM_STAT_SIGNAL_SYNCHRONIZED = 0x02;
+
 // ----------------------------------------
 // Constants for radio registers
 constexpr uint8_t OPMODE_LORA = 0x80;
@@ -137,6 +142,7 @@ constexpr uint8_t IRQ_LORA_CDDETD_MASK = 0x01;
 // DIO function mappings                D0D1D2D3
 constexpr uint8_t MAP_DIO0_LORA_RXDONE = 0x00; // 00------
 constexpr uint8_t MAP_DIO0_LORA_TXDONE = 0x40; // 01------
+constexpr uint8_t MAP_DIO0_LORA_CADDONE = 0x80; // 10------
 constexpr uint8_t MAP_DIO0_LORA_NOP = 0xC0;    // 11------
 constexpr uint8_t MAP_DIO1_LORA_RXTOUT = 0x00; // --00----
 constexpr uint8_t MAP_DIO1_LORA_NOP = 0x30;    // --11----
@@ -144,6 +150,10 @@ constexpr uint8_t MAP_DIO2_LORA_NOP = 0x0C;    // ----11--
 
 constexpr uint8_t LNA_RX_GAIN = (0x20 | 0x03);
 
+// symbol timeout of the rx started after a preamble is detected by CAD,
+// cover the remaining of a LoRaWAN preamble.
+constexpr uint8_t SNIFF_RX_SYMS = 8;
+
 constexpr uint8_t crForLog(rps_t const &rps) {
   return (5 - static_cast<uint8_t>(CodingRate::CR_4_5) +
           static_cast<uint8_t>(rps.getCr()));
@@ -271,6 +281,7 @@ void RadioSx1276::rxrssi() const {
 }
 
 void RadioSx1276::init() {
+  TraceOperationScope const trace(TraceOperation::INIT);
   hal.init();
   // manually reset radio
   // drive RST pin low
@@ -296,8 +307,24 @@ void RadioSx1276::init() {
   opmode(OPMODE_SLEEP);
 }
 
+bool RadioSx1276::resume() {
+  {
+    TraceOperationScope const trace(TraceOperation::INIT);
+    hal.init();
+    // sleep mode is lost on power loss (standby after reset), LoRa mode
+    // is selected before each operation.
+    if ((hal.read_reg(RegOpMode) & OPMODE_MASK) == OPMODE_SLEEP) {
+      return true;
+    }
+  }
+  PRINT_DEBUG(1, F("Radio state lost"));
+  init();
+  return false;
+}
+
 // get random seed from wideband noise rssi
 void RadioSx1276::init_random(std::array<uint8_t, 16> &randbuf) {
+  TraceOperationScope const trace(TraceOperation::INIT_RANDOM);
   // seed 15-byte randomness via noise rssi
   rxrssi();
   while ((hal.read_reg(RegOpMode) & OPMODE_MASK) != OPMODE_RX)
@@ -316,6 +343,11 @@ void RadioSx1276::init_random(std::array<uint8_t, 16> &randbuf) {
   opmode(OPMODE_SLEEP);
 }
 
+// register readable in sleep mode, no wake up of the radio.
+uint8_t RadioSx1276::noise_sample() const {
+  return hal.read_reg(LORARegRssiWideband);
+}
+
 uint8_t RadioSx1276::rssi() const {
   uint8_t const r = hal.read_reg(LORARegRssiValue);
   return r;
@@ -323,8 +355,8 @@ uint8_t RadioSx1276::rssi() const {
 
 // called by hal ext IRQ handler
 // (radio goes to stanby mode after tx/rx operations)
-uint8_t RadioSx1276::handle_end_rx(FrameBuffer &frame, bool goSleep) {
-
+uint8_t RadioSx1276::handle_end_rx(RxFrameBuffer &frame, bool goSleep) {
+  TraceOperationScope const trace(TraceOperation::END_RX);
   uint8_t const flags = hal.read_reg(LORARegIrqFlags);
   PRINT_DEBUG(2, F("irq: flags: 0x%x\n"), flags);
 
@@ -352,9 +384,13 @@ uint8_t RadioSx1276::handle_end_rx(FrameBuffer &frame, bool goSleep) {
   }
 
   if (goSleep) {
+    sniffState = SniffState::OFF;
     clear_and_disable_irq();
     // go from stanby to sleep
     opmode(OPMODE_SLEEP);
+  } else if (sniffState != SniffState::OFF) {
+    // radio is in standby after the rx single, listen again.
+    startCad();
   } else {
     PRINT_DEBUG(1, F("RX CONTINUE"));
     clear_irq();
@@ -364,7 +400,26 @@ uint8_t RadioSx1276::handle_end_rx(FrameBuffer &frame, bool goSleep) {
   return length;
 }
 
+RxActivity RadioSx1276::rx_activity() const {
+  // ValidHeader is latched, modem status only reflect the current state.
+  if (hal.read_reg(LORARegIrqFlags) & IRQ_LORA_HEADER_MASK) {
+    return RxActivity::HEADER;
+  }
+  uint8_t const stat = hal.read_reg(LORARegModemStat);
+  if (stat & (MODEM_STAT_SIGNAL_DETECTED | MODEM_STAT_SIGNAL_SYNCHRONIZED)) {
+    return RxActivity::PREAMBLE;
+  }
+  return RxActivity::NONE;
+}
+
+void RadioSx1276::rx_abort() {
+  sniffState = SniffState::OFF;
+  clear_and_disable_irq();
+  opmode(OPMODE_SLEEP);
+}
+
 void RadioSx1276::handle_end_tx() const {
+  TraceOperationScope const trace(TraceOperation::END_TX);
   clear_and_disable_irq();
   // go from stanby to sleep
   opmode(OPMODE_SLEEP);
@@ -410,6 +465,8 @@ constexpr uint8_t NB_TX_INIT_CMD =
 
 void RadioSx1276::tx(uint32_t const freq, rps_t const rps, int8_t const txpow,
                      uint8_t const *const framePtr, uint8_t const frameLength) {
+  TraceOperationScope const trace(TraceOperation::TX);
+  sniffState = SniffState::OFF;
   // select LoRa modem (from sleep mode)
   opmodeLora();
   // enter standby mode (required for FIFO loading))
@@ -456,9 +513,10 @@ CONST_TABLE(uint16_t, RX_INIT_CMD)
         .raw(),
     // clear all radio IRQ flags
     RegSet(LORARegIrqFlags, 0xFF).raw(),
-    // enable required radio IRQs
+    // enable required radio IRQs, valid header is only read by rx_activity.
     RegSet(LORARegIrqFlagsMask,
-           (uint8_t) ~(IRQ_LORA_RXDONE_MASK | IRQ_LORA_RXTOUT_MASK))
+           (uint8_t) ~(IRQ_LORA_RXDONE_MASK | IRQ_LORA_RXTOUT_MASK |
+                       IRQ_LORA_HEADER_MASK))
         .raw(),
 
 };
@@ -468,6 +526,8 @@ constexpr uint8_t NB_RX_INIT_CMD =
 
 void RadioSx1276::rx(uint32_t const freq, rps_t const rps, uint8_t const rxsyms,
                      OsTime const rxtime) {
+  TraceOperationScope const trace(TraceOperation::RX);
+  sniffState = SniffState::OFF;
   // receive frame now (exactly at rxtime)
   // select LoRa modem (from sleep mode)
   opmodeLora();
@@ -504,8 +564,7 @@ void RadioSx1276::rx(uint32_t const freq, rps_t const rps, uint8_t const rxsyms,
   // or timed out, and the corresponding IRQ will inform us about completion.
 }
 
-void RadioSx1276::rx(uint32_t const freq, rps_t const rps) {
-  // receive frame now (exactly at rxtime)
+void RadioSx1276::configRx(uint32_t const freq, rps_t const rps) {
   // select LoRa modem (from sleep mode)
   opmodeLora();
   ASSERT((hal.read_reg(RegOpMode) & OPMODE_LORA) != 0);
@@ -525,6 +584,12 @@ void RadioSx1276::rx(uint32_t const freq, rps_t const rps) {
 
   // enable antenna switch for RX
   hal.pin_switch_antenna_tx(false);
+}
+
+void RadioSx1276::rx(uint32_t const freq, rps_t const rps) {
+  TraceOperationScope const trace(TraceOperation::RX);
+  sniffState = SniffState::OFF;
+  configRx(freq, rps);
 
   // now instruct the radio to receive
   // continous rx
@@ -535,10 +600,88 @@ void RadioSx1276::rx(uint32_t const freq, rps_t const rps) {
   // the radio will stay in receive mode until not end
 }
 
+// The sx1276 has no hardware rx duty cycle, the loop is done with CAD :
+// CAD, if nothing detected sleep for sleepPeriod, else rx single.
+// rxPeriod is only used as the poll delay, CAD duration is fixed by the chip.
+void RadioSx1276::rx_duty_cycle(uint32_t const freq, rps_t const rps,
+                                OsDeltaTime const rxPeriod,
+                                OsDeltaTime const sleepPeriod) {
+  TraceOperationScope const trace(TraceOperation::RX);
+  configRx(freq, rps);
+  // symbol timeout for rx after detection
+  hal.write_reg(LORARegSymbTimeoutLsb, SNIFF_RX_SYMS);
+
+  sniffRxPeriod = rxPeriod;
+  sniffSleepPeriod = sleepPeriod;
+  startCad();
+
+  PRINT_DEBUG(1, F("RXMODE_CAD, freq=%" PRIu32 ", SF=%d, BW=%d, CR=4/%d"),
+              freq, rps.sf + 6, bwForLog(rps), crForLog(rps));
+}
+
+void RadioSx1276::startCad() {
+  opmode(OPMODE_STANDBY);
+  // configure DIO mapping DIO0=CadDone DIO1=NOP DIO2=NOP
+  hal.write_reg(RegDioMapping1,
+                MAP_DIO0_LORA_CADDONE | MAP_DIO1_LORA_NOP | MAP_DIO2_LORA_NOP);
+  clear_irq();
+  hal.write_reg(LORARegIrqFlagsMask,
+                (uint8_t) ~(IRQ_LORA_CDDONE_MASK | IRQ_LORA_CDDETD_MASK));
+  opmode(OPMODE_CAD);
+  sniffState = SniffState::CAD;
+}
+
+void RadioSx1276::startSniffRx() {
+  // configure DIO mapping DIO0=RxDone DIO1=RxTout DIO2=NOP
+  hal.write_reg(RegDioMapping1, MAP_DIO0_LORA_RXDONE | MAP_DIO1_LORA_RXTOUT |
+                                    MAP_DIO2_LORA_NOP);
+  clear_irq();
+  hal.write_reg(LORARegIrqFlagsMask,
+                (uint8_t) ~(IRQ_LORA_RXDONE_MASK | IRQ_LORA_RXTOUT_MASK));
+  opmode(OPMODE_RX_SINGLE);
+  sniffState = SniffState::RX;
+}
+
+OsDeltaTime RadioSx1276::rx_duty_cycle_poll() {
+  switch (sniffState) {
+  case SniffState::CAD:
+    if (!hal.io_check0()) {
+      // cad not finished
+      return sniffRxPeriod;
+    }
+    if (hal.read_reg(LORARegIrqFlags) & IRQ_LORA_CDDETD_MASK) {
+      PRINT_DEBUG(2, F("CAD detected"));
+      startSniffRx();
+      return OsInfiniteDeltaTime;
+    }
+    clear_irq();
+    opmode(OPMODE_SLEEP);
+    sniffNextCad = os_getTime() + sniffSleepPeriod;
+    sniffState = SniffState::SLEEP;
+    return sniffSleepPeriod;
+  case SniffState::SLEEP: {
+    auto const now = os_getTime();
+    if (now < sniffNextCad) {
+      return sniffNextCad - now;
+    }
+    startCad();
+    return sniffRxPeriod;
+  }
+  default:
+    return OsInfiniteDeltaTime;
+  }
+}
+
 /**
  * Check the IO pin.
  * Return true if the radio has finish it's operation
  */
-bool RadioSx1276::io_check() const { return hal.io_check(); }
+bool RadioSx1276::io_check() const {
+  // during CAD and sleep of rx duty cycle the DIO do not report an rx.
+  if (sniffState == SniffState::CAD || sniffState == SniffState::SLEEP) {
+    return false;
+  }
+  return hal.io_check();
+}
 
 RadioSx1276::RadioSx1276(lmic_pinmap const &pins) : hal(pins) {}
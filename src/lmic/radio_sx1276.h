@@ -32,30 +32,47 @@ class RadioSx1276 final : public Radio {
 public:
   explicit RadioSx1276(lmic_pinmap const &pins);
   void init(void) final;
+  bool resume() final;
   void rst() const final;
   void tx(uint32_t freq, rps_t rps, int8_t txpow, uint8_t const *framePtr,
           uint8_t frameLength) final;
   void rx(uint32_t freq, rps_t rps, uint8_t rxsyms, OsTime rxtime) final;
   void rx(uint32_t freq, rps_t rps) final;
+  void rx_duty_cycle(uint32_t freq, rps_t rps, OsDeltaTime rxPeriod,
+                     OsDeltaTime sleepPeriod) final;
+  OsDeltaTime rx_duty_cycle_poll() final;
+  RxActivity rx_activity() const final;
+  void rx_abort() final;
 
   void init_random(std::array<uint8_t, 16> &randbuf) final;
-  uint8_t handle_end_rx(FrameBuffer &frame, bool goSleep) final;
+  uint8_t noise_sample() const final;
+  uint8_t handle_end_rx(RxFrameBuffer &frame, bool goSleep) final;
   void handle_end_tx() const final;
   bool io_check() const final;
 
   uint8_t rssi() const final;
 
 private:
+  // State of the CAD based rx duty cycle loop.
+  enum class SniffState : uint8_t { OFF, CAD, SLEEP, RX };
+  SniffState sniffState = SniffState::OFF;
+  OsDeltaTime sniffRxPeriod;
+  OsDeltaTime sniffSleepPeriod;
+  OsTime sniffNextCad;
+
   void opmode(uint8_t mode) const;
   void opmodeLora() const;
   void configLoraModem(rps_t rps);
   void configChannel(uint32_t freq) const;
   void configPower(int8_t pw) const;
+  void configRx(uint32_t freq, rps_t rps);
+  void startCad();
+  void startSniffRx();
   void rxrssi() const;
   void clear_irq() const;
   void clear_and_disable_irq() const;
   void write_list_of_reg(uint16_t const *listcmd, uint8_t nb_cmd) const;
-    HalIo hal;
+  HalIo hal;
 };
 
 #endif
\ No newline at end of file
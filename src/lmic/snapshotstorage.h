@@ -0,0 +1,45 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef _snapshotstorage_h_
+#define _snapshotstorage_h_
+
+#include <stdint.h>
+
+/**
+ * Byte addressable memory keeping a snapshot (RTC RAM, EEPROM, flash
+ * emulated EEPROM...).
+ */
+class SnapshotStorage {
+public:
+  virtual uint8_t read(uint16_t offset) const = 0;
+  virtual void write(uint16_t offset, uint8_t value) = 0;
+};
+
+// Snapshot kept in a RAM buffer (RTC RAM of ESP32).
+class SnapshotBuffer final : public SnapshotStorage {
+public:
+  explicit SnapshotBuffer(uint8_t *const abuffer) : buffer(abuffer){};
+
+  uint8_t read(uint16_t const offset) const final { return buffer[offset]; };
+  void write(uint16_t const offset, uint8_t const value) final {
+    buffer[offset] = value;
+  };
+
+private:
+  uint8_t *const buffer;
+};
+
+constexpr uint16_t CRC16_INIT = 0xFFFF;
+
+// CRC-16/CCITT-FALSE
+inline uint16_t crc16_update(uint16_t crc, uint8_t const value) {
+  crc ^= static_cast<uint16_t>(value) << 8;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+#endif
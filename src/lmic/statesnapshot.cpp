@@ -0,0 +1,275 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "statesnapshot.h"
+
+#if defined(ENABLE_SAVE_RESTORE)
+
+#include "../hal/print_debug.h"
+
+namespace {
+
+namespace offset {
+constexpr uint16_t magic = 0;
+constexpr uint16_t version = 2;
+constexpr uint16_t kind = 3;
+constexpr uint16_t length = 4;
+constexpr uint16_t crc = 6;
+constexpr uint16_t generation = 8;
+} // namespace offset
+
+// Only count the length of the state.
+class CountingStoring final : public StoringAbtract {
+public:
+  uint16_t length = 0;
+
+protected:
+  void store(void const *, size_t const size) final { length += size; }
+};
+
+// Check if the payload in storage is the same as the state.
+class CompareStoring final : public StoringAbtract {
+public:
+  CompareStoring(SnapshotStorage const &astorage, uint16_t const base)
+      : storage(astorage), offset(base + StateSnapshot::HEADER_SIZE){};
+  bool same = true;
+
+protected:
+  void store(void const *val, size_t const size) final {
+    auto const bytes = static_cast<uint8_t const *>(val);
+    for (size_t i = 0; i < size && same; i++, offset++) {
+      same = storage.read(offset) == bytes[i];
+    }
+  }
+
+private:
+  SnapshotStorage const &storage;
+  uint16_t offset;
+};
+
+// Write payload bytes that differ from storage.
+class DeltaStoring final : public StoringAbtract {
+public:
+  DeltaStoring(SnapshotStorage &astorage, uint16_t const base)
+      : storage(astorage), offset(base + StateSnapshot::HEADER_SIZE){};
+  uint16_t crc = CRC16_INIT;
+  uint16_t writes = 0;
+
+protected:
+  void store(void const *val, size_t const size) final {
+    auto const bytes = static_cast<uint8_t const *>(val);
+    for (size_t i = 0; i < size; i++, offset++) {
+      if (storage.read(offset) != bytes[i]) {
+        storage.write(offset, bytes[i]);
+        writes++;
+      }
+      crc = crc16_update(crc, bytes[i]);
+    }
+  }
+
+private:
+  SnapshotStorage &storage;
+  uint16_t offset;
+};
+
+class StorageRetrieve final : public RetrieveAbtract {
+public:
+  StorageRetrieve(SnapshotStorage const &astorage, uint16_t const base)
+      : storage(astorage), offset(base + StateSnapshot::HEADER_SIZE){};
+
+protected:
+  void retrieve(void *val, size_t const size) final {
+    auto const bytes = static_cast<uint8_t *>(val);
+    for (size_t i = 0; i < size; i++, offset++) {
+      bytes[i] = storage.read(offset);
+    }
+  }
+
+private:
+  SnapshotStorage const &storage;
+  uint16_t offset;
+};
+
+void saveKind(Lmic const &lmic, StoringAbtract &store,
+              StateSnapshot::Kind const kind) {
+  if (kind == StateSnapshot::Kind::FULL) {
+    lmic.saveState(store);
+  } else {
+    lmic.saveStateWithoutTimeData(store);
+  }
+}
+
+} // namespace
+
+StateSnapshot::StateSnapshot(SnapshotStorage &astorage,
+                             uint16_t const acapacity)
+    : storage(astorage), capacity(acapacity) {}
+
+uint16_t StateSnapshot::stateLength(Lmic const &lmic, Kind const kind) {
+  CountingStoring counter;
+  saveKind(lmic, counter, kind);
+  return counter.length;
+}
+
+uint16_t StateSnapshot::readU2(uint16_t const offset) const {
+  return storage.read(offset) | (storage.read(offset + 1) << 8);
+}
+
+void StateSnapshot::writeU2(uint16_t const offset, uint16_t const value) {
+  uint8_t const bytes[2] = {static_cast<uint8_t>(value),
+                            static_cast<uint8_t>(value >> 8)};
+  for (uint8_t i = 0; i < 2; i++) {
+    if (storage.read(offset + i) != bytes[i]) {
+      storage.write(offset + i, bytes[i]);
+      writeCount++;
+    }
+  }
+}
+
+bool StateSnapshot::save(Lmic const &lmic, Kind const kind) {
+  writeCount = 0;
+  auto const length = stateLength(lmic, kind);
+  if (HEADER_SIZE + length > slotSize()) {
+    PRINT_DEBUG(1, F("Snapshot of %d bytes does not fit"), length);
+    return false;
+  }
+
+  uint16_t current;
+  uint16_t currentLength;
+  Kind currentKind;
+  bool const hasCurrent = currentSlot(current, currentLength, currentKind);
+  if (hasCurrent && currentLength == length && currentKind == kind) {
+    CompareStoring compare{storage, current};
+    saveKind(lmic, compare, kind);
+    if (compare.same) {
+      PRINT_DEBUG(2, F("Snapshot unchanged"));
+      return true;
+    }
+  }
+
+  // never write over the current snapshot.
+  uint16_t const base = hasCurrent && current == 0 ? slotSize() : 0;
+  uint16_t const generation =
+      hasCurrent ? readU2(current + offset::generation) + 1 : 0;
+  DeltaStoring store{storage, base};
+  saveKind(lmic, store, kind);
+  writeCount = store.writes;
+
+  // header last, a partial write fail the CRC check. Until the generation
+  // is written the previous snapshot stay the current one.
+  writeU2(base + offset::magic, MAGIC);
+  writeU2(base + offset::version, VERSION | (static_cast<uint8_t>(kind) << 8));
+  writeU2(base + offset::length, length);
+  writeU2(base + offset::crc, store.crc);
+  writeU2(base + offset::generation, generation);
+
+  PRINT_DEBUG(2, F("Snapshot %d bytes, %d written"), length, writeCount);
+  return true;
+}
+
+bool StateSnapshot::validHeader(uint16_t const base, uint16_t &length,
+                                Kind &kind) const {
+  if (readU2(base + offset::magic) != MAGIC ||
+      storage.read(base + offset::version) != VERSION) {
+    return false;
+  }
+  auto const rawKind = storage.read(base + offset::kind);
+  if (rawKind > static_cast<uint8_t>(Kind::WITHOUT_TIME_DATA)) {
+    return false;
+  }
+  kind = static_cast<Kind>(rawKind);
+  length = readU2(base + offset::length);
+  return HEADER_SIZE + length <= slotSize();
+}
+
+uint16_t StateSnapshot::payloadCrc(uint16_t const base,
+                                   uint16_t const length) const {
+  uint16_t crc = CRC16_INIT;
+  for (uint16_t i = 0; i < length; i++) {
+    crc = crc16_update(crc, storage.read(base + HEADER_SIZE + i));
+  }
+  return crc;
+}
+
+bool StateSnapshot::validSlot(uint16_t const base, uint16_t &length,
+                              Kind &kind) const {
+  return validHeader(base, length, kind) &&
+         payloadCrc(base, length) == readU2(base + offset::crc);
+}
+
+bool StateSnapshot::currentSlot(uint16_t &base, uint16_t &length,
+                                Kind &kind) const {
+  bool found = false;
+  uint16_t generation = 0;
+  for (uint16_t slot = 0; slot < 2; slot++) {
+    uint16_t const slotBase = slot * slotSize();
+    uint16_t slotLength;
+    Kind slotKind;
+    if (!validSlot(slotBase, slotLength, slotKind)) {
+      continue;
+    }
+    uint16_t const gen = readU2(slotBase + offset::generation);
+    // generation wrap around, newest is ahead of the other.
+    if (!found || static_cast<int16_t>(gen - generation) > 0) {
+      found = true;
+      generation = gen;
+      base = slotBase;
+      length = slotLength;
+      kind = slotKind;
+    }
+  }
+  return found;
+}
+
+bool StateSnapshot::isValid() const {
+  uint16_t base;
+  uint16_t length;
+  Kind kind;
+  return currentSlot(base, length, kind);
+}
+
+bool StateSnapshot::validFor(Lmic const &lmic, uint16_t &base,
+                             Kind &kind) const {
+  uint16_t length;
+  if (!currentSlot(base, length, kind) ||
+      length != stateLength(lmic, kind)) {
+    PRINT_DEBUG(1, F("No valid snapshot"));
+    return false;
+  }
+  return true;
+}
+
+bool StateSnapshot::load(Lmic &lmic) const {
+  uint16_t base;
+  Kind kind;
+  if (!validFor(lmic, base, kind)) {
+    return false;
+  }
+
+  StorageRetrieve retrieve{storage, base};
+  if (kind == Kind::FULL) {
+    lmic.loadState(retrieve);
+  } else {
+    lmic.loadStateWithoutTimeData(retrieve);
+  }
+  return true;
+}
+
+bool StateSnapshot::resume(Lmic &lmic) const {
+  uint16_t base;
+  Kind kind;
+  if (!validFor(lmic, base, kind) || kind != Kind::FULL) {
+    return false;
+  }
+  StorageRetrieve retrieve{storage, base};
+  lmic.resume(retrieve);
+  return true;
+}
+
+void StateSnapshot::invalidate() {
+  writeU2(offset::magic, 0);
+  writeU2(slotSize() + offset::magic, 0);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef _statesnapshot_h_
+#define _statesnapshot_h_
+
+#include "lmic.h"
+#include "snapshotstorage.h"
+#include <stdint.h>
+
+#if defined(ENABLE_SAVE_RESTORE)
+
+/**
+ * Versioned and checksummed copy of Lmic::saveState.
+ *
+ * The storage is split in two slots, each save write the slot not holding
+ * the current snapshot, a power loss during a write leave the previous
+ * snapshot intact.
+ * Header (10 bytes, little endian): magic, layout version, kind (with or
+ * without time data), payload length, CRC16 of the payload and generation.
+ * Only bytes which differ from the content of the slot are written
+ * (usually sequence numbers, duty cycle and random pool), the header is
+ * written last and the generation at the very end.
+ * A snapshot is valid if header match the current build (version and state
+ * length) and the CRC is good, a snapshot written by another firmware
+ * version or partially written is rejected. The valid slot with the
+ * highest generation is the current one.
+ */
+class StateSnapshot {
+public:
+  static constexpr uint16_t MAGIC = 0x534C;
+  // change when the layout of saveState change.
+  static constexpr uint8_t VERSION = 3;
+  static constexpr uint16_t HEADER_SIZE = 10;
+
+  // capacity needed for a state of stateSize bytes (two slots).
+  static constexpr uint16_t storageSize(uint16_t stateSize) {
+    return 2 * (HEADER_SIZE + stateSize);
+  }
+
+  enum class Kind : uint8_t { FULL = 0, WITHOUT_TIME_DATA = 1 };
+
+  StateSnapshot(SnapshotStorage &storage, uint16_t capacity);
+
+  /**
+   * Write the state of lmic, nothing is written if the current snapshot
+   * hold the same state.
+   * Return false if the state does not fit in a slot (storage unchanged).
+   */
+  bool save(Lmic const &lmic, Kind kind = Kind::FULL);
+  /**
+   * Restore lmic from the snapshot.
+   * Return false (and lmic is unchanged) if there is no valid snapshot.
+   */
+  bool load(Lmic &lmic) const;
+  /**
+   * Restore lmic with Lmic::resume (no init and reset before).
+   * Return false if there is no valid snapshot with time data.
+   */
+  bool resume(Lmic &lmic) const;
+  // Check header and CRC of the slots.
+  bool isValid() const;
+  // Clear the magic of the slots, next load will fail.
+  void invalidate();
+
+  // bytes written in storage by last save, header included.
+  uint16_t lastWriteCount() const { return writeCount; };
+  // length of the state of lmic.
+  static uint16_t stateLength(Lmic const &lmic, Kind kind);
+
+private:
+  SnapshotStorage &storage;
+  uint16_t const capacity;
+  uint16_t writeCount = 0;
+
+  uint16_t slotSize() const { return capacity / 2; };
+  uint16_t readU2(uint16_t offset) const;
+  void writeU2(uint16_t offset, uint16_t value);
+  bool validHeader(uint16_t base, uint16_t &length, Kind &kind) const;
+  bool validSlot(uint16_t base, uint16_t &length, Kind &kind) const;
+  // start of the slot of the current snapshot, false if none.
+  bool currentSlot(uint16_t &base, uint16_t &length, Kind &kind) const;
+  bool validFor(Lmic const &lmic, uint16_t &base, Kind &kind) const;
+  uint16_t payloadCrc(uint16_t base, uint16_t length) const;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "uplinkaggregator.h"
+#include "../hal/print_debug.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// MHDR, FHDR without fopts, port and MIC around the records.
+constexpr uint8_t FRAME_OVERHEAD = 13;
+} // namespace
+
+UplinkAggregator::UplinkAggregator(Lmic &almic, uint8_t const aport,
+                                   OsDeltaTime const amaxAge,
+                                   bool const aconfirmed)
+    : lmic(almic), maxAge(amaxAge), port(aport), confirmed(aconfirmed) {}
+
+bool UplinkAggregator::full(uint8_t const nextLength) const {
+  return recordCount == MAX_RECORDS ||
+         pendingLength() + nextLength > lmic.getMaxTxPayloadLength();
+}
+
+int8_t UplinkAggregator::append(uint8_t const *const data,
+                                uint8_t const length) {
+  if (length > lmic.getMaxTxPayloadLength())
+    return -2;
+
+  if (full(length)) {
+    // send the pending records, the new one is for next frame.
+    if (!flush() || full(length))
+      return -1;
+  }
+
+  if (recordCount == 0)
+    oldest = os_getTime();
+  uint8_t const start = pendingLength();
+  std::memcpy(buffer.begin() + start, data, length);
+  recordEnds[recordCount] = start + length;
+  recordCount++;
+  return 0;
+}
+
+bool UplinkAggregator::poll() {
+  if (recordCount == 0 || !lmic.isReadyForTxData())
+    return false;
+
+  auto const now = os_getTime();
+  // keep packing while the duty cycle block the uplink.
+  if (now < lmic.getTxAvailability(now))
+    return false;
+
+  // flush on size: next record of same length would not fit.
+  uint8_t const lastLength =
+      recordCount > 1 ? recordEnds[recordCount - 1] - recordEnds[recordCount - 2]
+                      : recordEnds[0];
+  if (full(lastLength) || now - oldest >= maxAge) {
+    return flush();
+  }
+  return false;
+}
+
+bool UplinkAggregator::flush() {
+  if (recordCount == 0 || !lmic.isReadyForTxData())
+    return false;
+
+  uint8_t const maxLength = lmic.getMaxTxPayloadLength();
+  // whole records fitting the payload, datarate may have been lowered.
+  uint8_t count = 0;
+  while (count < recordCount && recordEnds[count] <= maxLength) {
+    count++;
+  }
+  if (count == 0) {
+    PRINT_DEBUG(1, F("Record too long for datarate, dropped"));
+    dropped++;
+    removeRecords(1);
+    return false;
+  }
+
+  uint8_t const length = recordEnds[count - 1];
+  auto const rps = lmic.getTxRps();
+  OsDeltaTime separate;
+  uint8_t start = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    separate += Lmic::calcAirTime(rps, FRAME_OVERHEAD + recordEnds[i] - start);
+    start = recordEnds[i];
+  }
+
+  if (lmic.setTxData2(port, buffer.begin(), length, confirmed) != 0)
+    return false;
+
+  auto const packed = Lmic::calcAirTime(rps, FRAME_OVERHEAD + length);
+  saved += separate - packed;
+  frames++;
+  records += count;
+  PRINT_DEBUG(1, F("Aggregated %d records, airtime saved %" PRIi32 " us"),
+              count, (separate - packed).to_us());
+  removeRecords(count);
+  return true;
+}
+
+void UplinkAggregator::removeRecords(uint8_t const count) {
+  uint8_t const removed = recordEnds[count - 1];
+  uint8_t const remaining = pendingLength() - removed;
+  std::memmove(buffer.begin(), buffer.begin() + removed, remaining);
+  for (uint8_t i = count; i < recordCount; i++) {
+    recordEnds[i - count] = recordEnds[i] - removed;
+  }
+  recordCount -= count;
+  // oldest is kept for remaining records: they may be sent a bit earlier.
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef _uplinkaggregator_h_
+#define _uplinkaggregator_h_
+
+#include "lmic.h"
+#include "lorabase.h"
+#include "osticks.h"
+#include <array>
+#include <stdint.h>
+
+/**
+ * Pack application records in one uplink, in front of Lmic::setTxData2.
+ * Records are concatenated, the application must be able to split them
+ * (fixed size or self delimited records).
+ *
+ * poll() give the pending records to the MAC when the duty cycle allows a
+ * transmission and either the next record would not fit the max payload of
+ * the current datarate or the oldest record is older than maxAge.
+ * While the duty cycle block the uplink, records are still packed.
+ * The airtime saved compared to one uplink per record is computed with
+ * Lmic::calcAirTime.
+ */
+class UplinkAggregator {
+public:
+  static constexpr uint8_t MAX_RECORDS = 16;
+
+  UplinkAggregator(Lmic &lmic, uint8_t port, OsDeltaTime maxAge,
+                   bool confirmed = false);
+
+  /**
+   * Add a record, flush the pending records first if it does not fit.
+   * Return 0 if added, -1 if no room (MAC busy), -2 if longer than the max
+   * payload of the current datarate.
+   */
+  int8_t append(uint8_t const *data, uint8_t length);
+  /**
+   * To call in the main loop, flush when needed.
+   * Return true if an uplink was set.
+   */
+  bool poll();
+  /**
+   * Give the pending records to the MAC now.
+   * Return false if nothing to send or MAC busy.
+   */
+  bool flush();
+
+  uint8_t pendingLength() const {
+    return recordCount ? recordEnds[recordCount - 1] : 0;
+  }
+  uint8_t pendingRecords() const { return recordCount; }
+
+  // airtime saved compared to one uplink per record.
+  OsDeltaTime airtimeSaved() const { return saved; }
+  uint32_t framesSent() const { return frames; }
+  uint32_t recordsSent() const { return records; }
+  // records dropped because the datarate was lowered under their size.
+  uint32_t droppedCount() const { return dropped; }
+
+private:
+  Lmic &lmic;
+  OsDeltaTime const maxAge;
+  uint8_t const port;
+  bool const confirmed;
+
+  uint8_t recordCount = 0;
+  // time of first pending record
+  OsTime oldest;
+  // end of each record in buffer
+  std::array<uint8_t, MAX_RECORDS> recordEnds = {};
+  std::array<uint8_t, MAX_LEN_PAYLOAD> buffer = {};
+
+  OsDeltaTime saved;
+  uint32_t frames = 0;
+  uint32_t records = 0;
+  uint32_t dropped = 0;
+
+  bool full(uint8_t nextLength) const;
+  void removeRecords(uint8_t count);
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#include "uplinkqueue.h"
+#include <algorithm>
+
+UplinkQueue::UplinkQueue(UplinkSlot *const slotsBuffer,
+                         uint8_t *const payloadsBuffer,
+                         uint8_t *const orderBuffer, uint8_t const nbSlots,
+                         uint8_t const maxPayload)
+    : slots(slotsBuffer), payloads(payloadsBuffer), order(orderBuffer),
+      capacity(nbSlots), payloadSize(maxPayload) {}
+
+int8_t UplinkQueue::push(uint8_t const port, uint8_t const *const data,
+                         uint8_t const length, bool const confirmed,
+                         uint8_t const priority) {
+  return add(port, data, length, confirmed, priority, false, OsTime());
+}
+
+int8_t UplinkQueue::push(uint8_t const port, uint8_t const *const data,
+                         uint8_t const length, bool const confirmed,
+                         uint8_t const priority, OsTime const expiry) {
+  return add(port, data, length, confirmed, priority, true, expiry);
+}
+
+int8_t UplinkQueue::add(uint8_t const port, uint8_t const *const data,
+                        uint8_t const length, bool const confirmed,
+                        uint8_t const priority, bool const expires,
+                        OsTime const expiry) {
+  if (length > payloadSize)
+    return -2;
+
+  if (full()) {
+    // replace the oldest entry of the lowest priority if lower than new one.
+    uint8_t lowest = 0;
+    for (uint8_t i = 1; i < count; i++) {
+      if (slots[slotAt(i)].priority < slots[slotAt(lowest)].priority) {
+        lowest = i;
+      }
+    }
+    if (slots[slotAt(lowest)].priority >= priority)
+      return -1;
+    removeAt(lowest);
+    dropped++;
+  }
+
+  uint8_t slotIndex = 0;
+  while (slots[slotIndex].used) {
+    slotIndex++;
+  }
+
+  auto &slot = slots[slotIndex];
+  slot.expiry = expiry;
+  slot.port = port;
+  slot.length = length;
+  slot.priority = priority;
+  slot.confirmed = confirmed;
+  slot.expires = expires;
+  slot.used = true;
+  if (data)
+    std::copy(data, data + length, payloads + slotIndex * payloadSize);
+
+  order[(head + count) % capacity] = slotIndex;
+  count++;
+  return 0;
+}
+
+bool UplinkQueue::pop(OsTime const now, uint8_t &port, uint8_t *const data,
+                      uint8_t &length, bool &confirmed) {
+  // drop expired
+  uint8_t position = 0;
+  while (position < count) {
+    auto const &slot = slots[slotAt(position)];
+    if (slot.expires && slot.expiry < now) {
+      removeAt(position);
+      expired++;
+    } else {
+      position++;
+    }
+  }
+
+  if (empty())
+    return false;
+
+  uint8_t best = 0;
+  for (uint8_t i = 1; i < count; i++) {
+    if (slots[slotAt(i)].priority > slots[slotAt(best)].priority) {
+      best = i;
+    }
+  }
+
+  uint8_t const slotIndex = slotAt(best);
+  auto const &slot = slots[slotIndex];
+  port = slot.port;
+  length = slot.length;
+  confirmed = slot.confirmed;
+  auto const payload = payloads + slotIndex * payloadSize;
+  std::copy(payload, payload + slot.length, data);
+  removeAt(best);
+  return true;
+}
+
+void UplinkQueue::clear() {
+  while (!empty()) {
+    removeAt(0);
+  }
+  head = 0;
+}
+
+uint8_t UplinkQueue::slotAt(uint8_t const position) const {
+  return order[(head + position) % capacity];
+}
+
+void UplinkQueue::removeAt(uint8_t const position) {
+  slots[slotAt(position)].used = false;
+  if (position == 0) {
+    head = (head + 1) % capacity;
+  } else {
+    for (uint8_t i = position; i + 1 < count; i++) {
+      order[(head + i) % capacity] = order[(head + i + 1) % capacity];
+    }
+  }
+  count--;
+}
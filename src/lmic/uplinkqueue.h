@@ -0,0 +1,109 @@
+/*******************************************************************************
+
+ *******************************************************************************/
+
+#ifndef _uplinkqueue_h_
+#define _uplinkqueue_h_
+
+#include "lorabase.h"
+#include "osticks.h"
+#include <array>
+#include <stdint.h>
+
+struct UplinkSlot {
+  // time after which the entry is dropped if expires is set
+  OsTime expiry;
+  uint8_t port;
+  uint8_t length;
+  // higher is sent first, same priority are sent in order.
+  uint8_t priority;
+  bool confirmed;
+  bool expires;
+  bool used;
+};
+
+/**
+ * Bounded queue of uplinks, owned by the application and given to the MAC
+ * with Lmic::setUplinkQueue. The MAC take the next entry each time the
+ * duty cycle allows a transmission. Push with Lmic::queueUplink to wake
+ * an idle MAC.
+ * Storage is provided by UplinkQueueBuffer.
+ */
+class UplinkQueue {
+public:
+  /**
+   * Add an uplink.
+   * When the queue is full, the oldest entry of the lowest priority is
+   * replaced if its priority is lower than the new one.
+   * Return 0 if queued, -1 if queue full, -2 if data too long.
+   */
+  int8_t push(uint8_t port, uint8_t const *data, uint8_t length,
+              bool confirmed, uint8_t priority = 0);
+  /**
+   * Same as push, the entry is dropped if not sent before expiry.
+   */
+  int8_t push(uint8_t port, uint8_t const *data, uint8_t length,
+              bool confirmed, uint8_t priority, OsTime expiry);
+
+  /**
+   * Remove the entry to send now, dropping expired ones.
+   * data must have room for payloadSize bytes.
+   * Return false if nothing to send.
+   */
+  bool pop(OsTime now, uint8_t &port, uint8_t *data, uint8_t &length,
+           bool &confirmed);
+
+  uint8_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  bool full() const { return count == capacity; }
+  void clear();
+
+  // entries removed without being sent.
+  uint16_t droppedCount() const { return dropped; }
+  uint16_t expiredCount() const { return expired; }
+
+protected:
+  UplinkQueue(UplinkSlot *slots, uint8_t *payloads, uint8_t *order,
+              uint8_t capacity, uint8_t payloadSize);
+
+private:
+  UplinkSlot *const slots;
+  uint8_t *const payloads;
+  // ring of slot index, oldest first.
+  uint8_t *const order;
+  uint8_t const capacity;
+  uint8_t const payloadSize;
+  uint8_t head = 0;
+  uint8_t count = 0;
+  uint16_t dropped = 0;
+  uint16_t expired = 0;
+
+  int8_t add(uint8_t port, uint8_t const *data, uint8_t length,
+             bool confirmed, uint8_t priority, bool expires, OsTime expiry);
+  uint8_t slotAt(uint8_t position) const;
+  void removeAt(uint8_t position);
+};
+
+template <uint8_t N, uint8_t PAYLOAD_SIZE> struct UplinkQueueStorage {
+  std::array<UplinkSlot, N> slotBuffer = {};
+  std::array<uint8_t, N * PAYLOAD_SIZE> payloadBuffer;
+  std::array<uint8_t, N> orderBuffer;
+};
+
+/**
+ * Uplink queue with storage for N entries of PAYLOAD_SIZE bytes.
+ */
+template <uint8_t N, uint8_t PAYLOAD_SIZE = 51>
+class UplinkQueueBuffer final : private UplinkQueueStorage<N, PAYLOAD_SIZE>,
+                                public UplinkQueue {
+  static_assert(N > 0, "Queue need at least one entry");
+  static_assert(PAYLOAD_SIZE <= MAX_LEN_PAYLOAD, "Payload too long");
+  using Storage = UplinkQueueStorage<N, PAYLOAD_SIZE>;
+
+public:
+  UplinkQueueBuffer()
+      : UplinkQueue(Storage::slotBuffer.begin(), Storage::payloadBuffer.begin(),
+                    Storage::orderBuffer.begin(), N, PAYLOAD_SIZE) {}
+};
+
+#endif
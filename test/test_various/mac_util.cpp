@@ -0,0 +1,67 @@
+#include "mac_util.h"
+
+#ifndef ARDUINO
+
+#include "hal/hal.h"
+#include <algorithm>
+#include <unity.h>
+
+namespace mac_util {
+
+namespace {
+void sleep(OsDeltaTime const toWait) {
+  hal_add_time_in_sleep(std::max(std::min(toWait, OsDeltaTime::from_sec(1)),
+                                 OsDeltaTime::from_ms(1)));
+}
+} // namespace
+
+void start(Lmic &lmic) {
+  os_init();
+  lmic.init();
+  lmic.reset();
+}
+
+void start_session(Lmic &lmic, RadioFake &radio, uint8_t const dr,
+                   AesKey const &nwkSKey, AesKey const &appSKey) {
+  start(lmic);
+  lmic.setSession(0x13, DEVADDR, nwkSKey, appSKey);
+  lmic.setDrTx(dr);
+  radio.popLastSend();
+}
+
+void step(Lmic &lmic) { sleep(lmic.run()); }
+
+RadioFake::Packet wait_send(Lmic &lmic, RadioFake &radio,
+                            OsDeltaTime const timeout) {
+  auto const end = os_getTime() + timeout;
+  auto packet = radio.popLastSend();
+  while (!packet.is_valid() && os_getTime() < end) {
+    auto const toWait = lmic.run();
+    packet = radio.popLastSend();
+    if (!packet.is_valid()) {
+      sleep(toWait);
+    }
+  }
+  return packet;
+}
+
+bool wait_idle(Lmic &lmic, OsDeltaTime const timeout) {
+  auto const end = os_getTime() + timeout;
+  while (!lmic.isReadyForTxData() && os_getTime() < end) {
+    step(lmic);
+  }
+  return lmic.isReadyForTxData();
+}
+
+uint16_t send_one(Lmic &lmic, RadioFake &radio) {
+  uint8_t data[] = {1, 2, 3};
+  lmic.setTxData2(1, data, sizeof(data), false);
+  TEST_ASSERT_TRUE(wait_idle(lmic, OsDeltaTime::from_sec(600)));
+  auto const packet = radio.popLastSend();
+  TEST_ASSERT_TRUE(packet.is_valid());
+  return rlsbf2(&packet.data[6]);
+}
+
+} // namespace mac_util
+
+#endif
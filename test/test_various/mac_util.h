@@ -0,0 +1,37 @@
+#ifndef test_various_mac_util_h
+#define test_various_mac_util_h
+
+#ifndef ARDUINO
+
+#include "lmic/lmic.h"
+#include "lmic/radio_fake.h"
+
+// Run a MAC on the fake radio, time advanced with hal_add_time_in_sleep.
+namespace mac_util {
+
+constexpr devaddr_t DEVADDR = 0x01020304;
+
+// Init and reset the MAC.
+void start(Lmic &lmic);
+// Start with an ABP session sending at datarate dr, packets sent before are
+// dropped.
+void start_session(Lmic &lmic, RadioFake &radio, uint8_t dr,
+                   AesKey const &nwkSKey = AesKey{},
+                   AesKey const &appSKey = AesKey{});
+// Run the MAC once and sleep until its next job (from 1 ms to 1 s).
+void step(Lmic &lmic);
+// Run until the radio send a packet (no sleep after it), invalid packet on
+// timeout.
+RadioFake::Packet wait_send(Lmic &lmic, RadioFake &radio,
+                            OsDeltaTime timeout = OsDeltaTime::from_sec(60));
+// Run until the MAC is ready for tx data, false on timeout.
+bool wait_idle(Lmic &lmic, OsDeltaTime timeout = OsDeltaTime::from_sec(60));
+// Send one unconfirmed uplink, run until the MAC is idle, return the frame
+// counter of the uplink.
+uint16_t send_one(Lmic &lmic, RadioFake &radio);
+
+} // namespace mac_util
+
+#endif
+
+#endif
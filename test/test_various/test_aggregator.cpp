@@ -0,0 +1,167 @@
+#include "test_aggregator.h"
+
+#include <unity.h>
+
+#ifndef ARDUINO
+
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/lmic.us915.h"
+#include "lmic/radio_fake.h"
+#include "lmic/uplinkaggregator.h"
+#include "mac_util.h"
+#include <algorithm>
+
+namespace test_aggregator {
+
+namespace {
+constexpr uint8_t PORT = 9;
+// MHDR, DevAddr, FCtrl, FCnt
+constexpr uint8_t FOPTS = 8;
+#if defined(LMIC_SINGLE_BUFFER)
+// room for FOpts kept in frame.
+constexpr uint8_t MAX_LENGTH = MAX_LEN_IN_FRAME_PAYLOAD;
+#else
+constexpr uint8_t MAX_LENGTH = MAX_LEN_PAYLOAD;
+#endif
+
+// uplinks at DR0 wait the duty cycle.
+constexpr OsDeltaTime SEND_TIMEOUT = OsDeltaTime::from_sec(300);
+
+RadioFake radio;
+LmicEu868 lmic(radio);
+
+uint8_t payload_length(RadioFake::Packet const &packet) {
+  uint8_t const foptsLength = packet.data[5] & 0x0F;
+  return packet.length - FOPTS - foptsLength - 1 - 4;
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_max_payload);
+  RUN_TEST(test_flush_on_age);
+  RUN_TEST(test_flush_on_size);
+  RUN_TEST(test_too_long);
+  RUN_TEST(test_duty_cycle_hold);
+}
+
+void test_max_payload() {
+  mac_util::start_session(lmic, radio, 0);
+  TEST_ASSERT_EQUAL_UINT8(std::min<uint8_t>(51, MAX_LENGTH),
+                          lmic.getMaxTxPayloadLength());
+  lmic.setDrTx(5);
+  TEST_ASSERT_EQUAL_UINT8(
+      std::min<uint8_t>(std::min(242, MAX_LEN_FRAME - 13), MAX_LENGTH),
+      lmic.getMaxTxPayloadLength());
+
+  static RadioFake usRadio;
+  static LmicUs915 usLmic(usRadio);
+  usLmic.init();
+  usLmic.reset();
+  usLmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  usLmic.setDrTx(0);
+  TEST_ASSERT_EQUAL_UINT8(11, usLmic.getMaxTxPayloadLength());
+}
+
+void test_flush_on_age() {
+  mac_util::start_session(lmic, radio, 5);
+  UplinkAggregator aggregator(lmic, PORT, OsDeltaTime::from_sec(10));
+  uint8_t const record[] = {1, 2, 3, 4};
+  for (uint8_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, sizeof(record)));
+  }
+  TEST_ASSERT_EQUAL_UINT8(12, aggregator.pendingLength());
+
+  // too young
+  TEST_ASSERT_FALSE(aggregator.poll());
+  hal_add_time_in_sleep(OsDeltaTime::from_sec(11));
+  TEST_ASSERT_TRUE(aggregator.poll());
+  TEST_ASSERT_EQUAL_UINT8(0, aggregator.pendingRecords());
+
+  auto const packet = mac_util::wait_send(lmic, radio, SEND_TIMEOUT);
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT8(12, payload_length(packet));
+  TEST_ASSERT_EQUAL_UINT8(PORT, packet.data[FOPTS + (packet.data[5] & 0x0F)]);
+
+  auto const rps = lmic.getTxRps();
+  auto const expected = 3 * Lmic::calcAirTime(rps, 13 + 4) -
+                        Lmic::calcAirTime(rps, 13 + 12);
+  TEST_ASSERT_EQUAL_INT32(expected.tick(), aggregator.airtimeSaved().tick());
+  TEST_ASSERT_TRUE(aggregator.airtimeSaved() > OsDeltaTime(0));
+  TEST_ASSERT_EQUAL_UINT32(1, aggregator.framesSent());
+  TEST_ASSERT_EQUAL_UINT32(3, aggregator.recordsSent());
+}
+
+void test_flush_on_size() {
+  mac_util::start_session(lmic, radio, 0);
+  UplinkAggregator aggregator(lmic, PORT, OsDeltaTime::from_sec(600));
+  uint8_t record[20] = {};
+  // 20 bytes with 51 bytes payload, two records fit, not three.
+  uint8_t const length = lmic.getMaxTxPayloadLength() / 2 - 5;
+  record[0] = 1;
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, length));
+  record[0] = 2;
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, length));
+  // next record of same size would not fit.
+  TEST_ASSERT_TRUE(aggregator.poll());
+
+  record[0] = 3;
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, length));
+  record[0] = 4;
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, length));
+  // no room and MAC busy with previous uplink
+  TEST_ASSERT_EQUAL_INT8(-1, aggregator.append(record, length));
+  TEST_ASSERT_EQUAL_UINT8(2, aggregator.pendingRecords());
+
+  auto const packet = mac_util::wait_send(lmic, radio, SEND_TIMEOUT);
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT8(2 * length, payload_length(packet));
+  TEST_ASSERT_EQUAL_UINT32(2, aggregator.recordsSent());
+}
+
+void test_too_long() {
+  mac_util::start_session(lmic, radio, 0);
+  UplinkAggregator aggregator(lmic, PORT, OsDeltaTime::from_sec(10));
+  uint8_t const record[52] = {};
+  TEST_ASSERT_EQUAL_INT8(-2, aggregator.append(record, sizeof(record)));
+  TEST_ASSERT_EQUAL_UINT8(0, aggregator.pendingRecords());
+}
+
+void test_duty_cycle_hold() {
+  mac_util::start_session(lmic, radio, 0);
+  // next uplink blocked for 128 times the airtime whatever the band model.
+  lmic.setDutyRate(7);
+  UplinkAggregator aggregator(lmic, PORT, OsDeltaTime::from_sec(5));
+  uint8_t const record[] = {1, 2};
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, sizeof(record)));
+  TEST_ASSERT_TRUE(aggregator.flush());
+  TEST_ASSERT_TRUE(mac_util::wait_send(lmic, radio, SEND_TIMEOUT).is_valid());
+  TEST_ASSERT_TRUE(mac_util::wait_idle(lmic));
+
+  // SF12 uplink block the next one for a long time.
+  TEST_ASSERT_TRUE(os_getTime() < lmic.getTxAvailability());
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, sizeof(record)));
+  hal_add_time_in_sleep(OsDeltaTime::from_sec(6));
+  // too old but still packed until the duty cycle allows it.
+  TEST_ASSERT_FALSE(aggregator.poll());
+  TEST_ASSERT_EQUAL_INT8(0, aggregator.append(record, sizeof(record)));
+
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(600);
+  while (!aggregator.poll() && os_getTime() < timeout) {
+    mac_util::step(lmic);
+  }
+  auto const packet = mac_util::wait_send(lmic, radio, SEND_TIMEOUT);
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT8(4, payload_length(packet));
+  TEST_ASSERT_EQUAL_UINT32(2, aggregator.framesSent());
+}
+
+} // namespace test_aggregator
+
+#else
+
+namespace test_aggregator {
+void run() {}
+} // namespace test_aggregator
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __test_aggregator_h__
+#define __test_aggregator_h__
+
+namespace test_aggregator {
+void run();
+void test_max_payload();
+void test_flush_on_age();
+void test_flush_on_size();
+void test_too_long();
+void test_duty_cycle_hold();
+} // namespace test_aggregator
+
+#endif
@@ -0,0 +1,68 @@
+#include "test_airtime.h"
+
+#include "lmic/lmic.eu868.h"
+#include "lmic/lmic.us915.h"
+#include <unity.h>
+
+namespace test_airtime {
+
+namespace {
+// usable in constant expressions
+static_assert(Lmic::calcAirTime(rps_t(EU868::rps_DR5), 20) <
+                  OsDeltaTime::from_ms(60),
+              "SF7 20 bytes");
+static_assert(EU868::RESOLVE_TABLE(AIRTIME).at(0, 51) >
+                  OsDeltaTime::from_ms(2000),
+              "SF12 51 bytes");
+
+template <uint8_t NB_DR>
+void check_table(AirtimeTable<NB_DR> const &table, uint8_t const *rpsByDr) {
+  for (uint8_t dr = 0; dr < NB_DR; dr++) {
+    auto const rps = rps_t(rpsByDr[dr]);
+    for (uint16_t length = 0; length < 256; length++) {
+      auto const exact = Lmic::calcAirTime(rps, length);
+      auto const bound = table.get(dr, length);
+      TEST_ASSERT_TRUE(exact <= bound);
+      if ((length % AIRTIME_BUCKET_SIZE) == AIRTIME_BUCKET_SIZE - 1) {
+        TEST_ASSERT_EQUAL_INT32(exact.tick(), bound.tick());
+      }
+    }
+  }
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_known_value);
+  RUN_TEST(test_tables_upper_bound);
+  RUN_TEST(test_table_get);
+}
+
+void test_known_value() {
+  // SF7 125kHz CR 4/5 20 bytes with CRC: 56.6 ms
+  constexpr auto airtime = Lmic::calcAirTime(rps_t(EU868::rps_DR5), 20);
+  TEST_ASSERT_INT32_WITHIN(100, 56576, airtime.to_us());
+  // SF12 125kHz CR 4/5 51 bytes with CRC: 2465.8 ms (divisor rounded)
+  TEST_ASSERT_INT32_WITHIN(
+      1000, 2465792, Lmic::calcAirTime(rps_t(EU868::rps_DR0), 51).to_us());
+}
+
+void test_tables_upper_bound() {
+  uint8_t const eu868[] = {EU868::rps_DR0, EU868::rps_DR1, EU868::rps_DR2,
+                           EU868::rps_DR3, EU868::rps_DR4, EU868::rps_DR5,
+                           EU868::rps_DR6};
+  check_table(EU868::RESOLVE_TABLE(AIRTIME), eu868);
+  uint8_t const us915[] = {US915::rps_DR0, US915::rps_DR1, US915::rps_DR2,
+                           US915::rps_DR3, US915::rps_DR4};
+  check_table(US915::RESOLVE_TABLE(AIRTIME), us915);
+}
+
+void test_table_get() {
+  auto const &table = EU868::RESOLVE_TABLE(AIRTIME);
+  constexpr auto compileTime = EU868::RESOLVE_TABLE(AIRTIME).at(3, 100);
+  TEST_ASSERT_EQUAL_INT32(compileTime.tick(), table.get(3, 100).tick());
+  // bigger bucket, slower datarate, longer airtime
+  TEST_ASSERT_TRUE(table.get(3, 100) < table.get(3, 120));
+  TEST_ASSERT_TRUE(table.get(3, 100) < table.get(2, 100));
+}
+
+} // namespace test_airtime
@@ -0,0 +1,11 @@
+#ifndef __test_airtime_h__
+#define __test_airtime_h__
+
+namespace test_airtime {
+void run();
+void test_known_value();
+void test_tables_upper_bound();
+void test_table_get();
+} // namespace test_airtime
+
+#endif
@@ -0,0 +1,251 @@
+#include "test_codec.h"
+
+#include "codec/deltacodec.h"
+#include <stdio.h>
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+namespace test_codec {
+
+namespace {
+// 16 bits galois LFSR, same series on all platforms.
+uint16_t lfsr = 0xACE1u;
+int8_t noise(uint8_t const amplitude) {
+  uint16_t const lsb = lfsr & 1u;
+  lfsr >>= 1;
+  if (lsb) {
+    lfsr ^= 0xB400u;
+  }
+  return static_cast<int8_t>(lfsr % (2 * amplitude + 1)) - amplitude;
+}
+
+constexpr uint8_t SERIES_LENGTH = 10;
+
+// temperature (0.01 degree), pressure (Pa), humidity (0.1%)
+void sensor_series(int32_t (&series)[SERIES_LENGTH][3]) {
+  int32_t values[3] = {2150, 101325, 455};
+  for (auto &record : series) {
+    values[0] += noise(3);
+    values[1] += noise(10);
+    values[2] += noise(2);
+    for (uint8_t i = 0; i < 3; i++) {
+      record[i] = values[i];
+    }
+  }
+}
+
+// latitude, longitude quantized as rak811_gps (~1e-4 degree), walking.
+void gps_series(int32_t (&series)[SERIES_LENGTH][2]) {
+  int32_t values[2] = {488566, 23522};
+  for (auto &record : series) {
+    values[0] += noise(1);
+    values[1] += noise(1);
+    record[0] = values[0];
+    record[1] = values[1];
+  }
+}
+
+uint32_t micro_seconds() {
+#ifdef ARDUINO
+  return micros();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+template <uint8_t FIELDS>
+void benchmark(char const *name, int32_t const (&series)[SERIES_LENGTH][FIELDS],
+               DeltaDictionary const *dictionary) {
+  DeltaEncoderBuffer<FIELDS> encoder(dictionary);
+  uint8_t buffer[SERIES_LENGTH * FIELDS * VARINT_MAX_LENGTH];
+  constexpr uint16_t LOOPS = 200;
+
+  uint32_t const start = micro_seconds();
+  for (uint16_t loop = 0; loop < LOOPS; loop++) {
+    encoder.begin(buffer, sizeof(buffer));
+    for (auto const &record : series) {
+      encoder.add(record);
+    }
+  }
+  uint32_t const elapsed = micro_seconds() - start;
+
+  // check result
+  DeltaDecoderBuffer<FIELDS> decoder(dictionary);
+  decoder.begin(buffer, encoder.length());
+  int32_t values[FIELDS];
+  for (auto const &record : series) {
+    TEST_ASSERT_TRUE(decoder.next(values));
+    TEST_ASSERT_EQUAL_INT32_ARRAY(record, values, FIELDS);
+  }
+
+  char message[120];
+  unsigned const raw = SERIES_LENGTH * FIELDS * sizeof(int32_t);
+  // on AVR multiply by F_CPU in MHz to get cycles.
+  snprintf(message, sizeof(message),
+           "%s: %u records, %u bytes raw, %u bytes encoded, %u ns/record",
+           name, static_cast<unsigned>(SERIES_LENGTH), raw,
+           static_cast<unsigned>(encoder.length()),
+           static_cast<unsigned>(elapsed * 1000UL / LOOPS / SERIES_LENGTH));
+  TEST_MESSAGE(message);
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_zigzag);
+  RUN_TEST(test_varint);
+  RUN_TEST(test_roundtrip);
+  RUN_TEST(test_no_room);
+  RUN_TEST(test_malformed);
+  RUN_TEST(test_dictionary);
+  RUN_TEST(test_benchmark);
+}
+
+void test_zigzag() {
+  TEST_ASSERT_EQUAL_UINT32(0, zigzag_encode(0));
+  TEST_ASSERT_EQUAL_UINT32(1, zigzag_encode(-1));
+  TEST_ASSERT_EQUAL_UINT32(2, zigzag_encode(1));
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFF, zigzag_encode(INT32_MIN));
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFE, zigzag_encode(INT32_MAX));
+  int32_t const values[] = {0, 1, -1, 63, -64, 1000, INT32_MIN, INT32_MAX};
+  for (auto const value : values) {
+    TEST_ASSERT_EQUAL_INT32(value, zigzag_decode(zigzag_encode(value)));
+  }
+}
+
+void test_varint() {
+  uint8_t buffer[VARINT_MAX_LENGTH];
+  uint32_t value;
+  TEST_ASSERT_EQUAL_UINT8(1, varint_write(buffer, sizeof(buffer), 127));
+  TEST_ASSERT_EQUAL_HEX8(0x7F, buffer[0]);
+  TEST_ASSERT_EQUAL_UINT8(2, varint_write(buffer, sizeof(buffer), 128));
+  TEST_ASSERT_EQUAL_HEX8(0x80, buffer[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, buffer[1]);
+  TEST_ASSERT_EQUAL_UINT8(2, varint_read(buffer, 2, value));
+  TEST_ASSERT_EQUAL_UINT32(128, value);
+
+  TEST_ASSERT_EQUAL_UINT8(5, varint_write(buffer, sizeof(buffer), UINT32_MAX));
+  TEST_ASSERT_EQUAL_UINT8(5, varint_read(buffer, sizeof(buffer), value));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, value);
+
+  // no room
+  TEST_ASSERT_EQUAL_UINT8(0, varint_write(buffer, 4, UINT32_MAX));
+  // truncated
+  TEST_ASSERT_EQUAL_UINT8(0, varint_read(buffer, 4, value));
+}
+
+void test_roundtrip() {
+  int32_t const series[][2] = {
+      {2150, -5}, {2151, -5}, {2149, -7}, {INT32_MIN, INT32_MAX}, {0, 0}};
+  DeltaEncoderBuffer<2> encoder;
+  uint8_t buffer[51];
+  encoder.begin(buffer, sizeof(buffer));
+  for (auto const &record : series) {
+    TEST_ASSERT_TRUE(encoder.add(record));
+  }
+  TEST_ASSERT_EQUAL_UINT8(5, encoder.records());
+  // first record absolute, then one byte by small delta.
+  uint8_t const expected[] = {0xCC, 0x21, 0x09, 0x02, 0x00, 0x03, 0x03};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+
+  DeltaDecoderBuffer<2> decoder;
+  decoder.begin(buffer, encoder.length());
+  int32_t values[2];
+  for (auto const &record : series) {
+    TEST_ASSERT_TRUE(decoder.next(values));
+    TEST_ASSERT_EQUAL_INT32_ARRAY(record, values, 2);
+  }
+  TEST_ASSERT_FALSE(decoder.next(values));
+  TEST_ASSERT_FALSE(decoder.error());
+
+  // next frame decode alone.
+  encoder.begin(buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(encoder.add(series[2]));
+  decoder.begin(buffer, encoder.length());
+  TEST_ASSERT_TRUE(decoder.next(values));
+  TEST_ASSERT_EQUAL_INT32_ARRAY(series[2], values, 2);
+}
+
+void test_no_room() {
+  DeltaEncoderBuffer<2> encoder;
+  uint8_t buffer[4];
+  int32_t const first[] = {1000, 1000};
+  int32_t const second[] = {1001, 1000};
+  encoder.begin(buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(encoder.add(first));
+  TEST_ASSERT_EQUAL_UINT8(4, encoder.length());
+  TEST_ASSERT_FALSE(encoder.add(second));
+  TEST_ASSERT_EQUAL_UINT8(4, encoder.length());
+  TEST_ASSERT_EQUAL_UINT8(1, encoder.records());
+
+  // previous record not changed by the failed add.
+  uint8_t bigger[8];
+  encoder.begin(bigger, sizeof(bigger));
+  TEST_ASSERT_TRUE(encoder.add(first));
+  TEST_ASSERT_TRUE(encoder.add(second));
+  TEST_ASSERT_EQUAL_UINT8(6, encoder.length());
+}
+
+void test_malformed() {
+  DeltaDecoderBuffer<2> decoder;
+  int32_t values[2];
+  // second field missing
+  uint8_t const truncated[] = {0x02};
+  decoder.begin(truncated, sizeof(truncated));
+  TEST_ASSERT_FALSE(decoder.next(values));
+  TEST_ASSERT_TRUE(decoder.error());
+  // varint too long
+  uint8_t const tooLong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0x00};
+  decoder.begin(tooLong, sizeof(tooLong));
+  TEST_ASSERT_FALSE(decoder.next(values));
+  TEST_ASSERT_TRUE(decoder.error());
+}
+
+void test_dictionary() {
+  int32_t const series[][2] = {{0, 0}, {0, 0}, {1, 0}, {0, -1}, {10, 20}};
+  DeltaEncoderBuffer<2> encoder(&GPS_DELTA_DICTIONARY);
+  uint8_t buffer[51];
+  encoder.begin(buffer, sizeof(buffer));
+  for (auto const &record : series) {
+    TEST_ASSERT_TRUE(encoder.add(record));
+  }
+  // one byte by entry found, literal first delta shifted by 9.
+  uint8_t const expected[] = {0x00, 0x00, 0x01, 0x08, 9 + 20, 42};
+  TEST_ASSERT_EQUAL_UINT8(sizeof(expected), encoder.length());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+
+  DeltaDecoderBuffer<2> decoder(&GPS_DELTA_DICTIONARY);
+  decoder.begin(buffer, encoder.length());
+  int32_t values[2];
+  for (auto const &record : series) {
+    TEST_ASSERT_TRUE(decoder.next(values));
+    TEST_ASSERT_EQUAL_INT32_ARRAY(record, values, 2);
+  }
+  TEST_ASSERT_FALSE(decoder.next(values));
+  TEST_ASSERT_FALSE(decoder.error());
+
+  // dictionary of other record size is ignored.
+  DeltaEncoderBuffer<3> encoder3(&GPS_DELTA_DICTIONARY);
+  int32_t const record3[] = {0, 0, 0};
+  encoder3.begin(buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(encoder3.add(record3));
+  TEST_ASSERT_EQUAL_UINT8(3, encoder3.length());
+}
+
+void test_benchmark() {
+  int32_t sensors[SERIES_LENGTH][3];
+  sensor_series(sensors);
+  benchmark("sensors delta", sensors, nullptr);
+  int32_t gps[SERIES_LENGTH][2];
+  gps_series(gps);
+  benchmark("gps delta", gps, nullptr);
+  benchmark("gps dictionary", gps, &GPS_DELTA_DICTIONARY);
+}
+
+} // namespace test_codec
@@ -0,0 +1,15 @@
+#ifndef __test_codec_h__
+#define __test_codec_h__
+
+namespace test_codec {
+void run();
+void test_zigzag();
+void test_varint();
+void test_roundtrip();
+void test_no_room();
+void test_malformed();
+void test_dictionary();
+void test_benchmark();
+} // namespace test_codec
+
+#endif
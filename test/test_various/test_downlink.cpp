@@ -0,0 +1,346 @@
+#include "test_downlink.h"
+
+#include <unity.h>
+
+#ifndef ARDUINO
+
+#include "aes/lmic_aes.h"
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/lorawanpacket.h"
+#include "lmic/radio_fake.h"
+#include <algorithm>
+
+namespace test_downlink {
+
+using namespace lorawan;
+
+namespace {
+constexpr devaddr_t DEVADDR = 0x01020304;
+constexpr AesKey nwkSKey = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+constexpr AesKey appSKey = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+constexpr uint8_t PORT = 5;
+
+RadioFake radio;
+LmicEu868 lmic(radio);
+std::array<uint8_t, 40> clear;
+
+void startSession() {
+  os_init();
+  lmic.init();
+  lmic.reset();
+  lmic.setSession(0x13, DEVADDR, nwkSKey, appSKey);
+  radio.popLastSend();
+}
+
+RadioFake::Packet waitUplink() {
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(300);
+  auto sent = radio.popLastSend();
+  while (!sent.is_valid() && os_getTime() < timeout) {
+    lmic.run();
+    sent = radio.popLastSend();
+    if (!sent.is_valid()) {
+      hal_add_time_in_sleep(OsDeltaTime::from_ms(1));
+    }
+  }
+  TEST_ASSERT_TRUE(sent.is_valid());
+  return sent;
+}
+
+void waitReady() {
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(60);
+  while (!lmic.isReadyForTxData() && os_getTime() < timeout) {
+    lmic.run();
+    hal_add_time_in_sleep(OsDeltaTime::from_ms(1));
+  }
+  TEST_ASSERT_TRUE(lmic.isReadyForTxData());
+}
+
+// answer in RX1 with payload on port (no port if length 0)
+// tamper is applied on the downlink after MIC computation.
+void reply(RadioFake::Packet const &sent, uint8_t const length,
+           uint16_t const fcnt = 0, uint8_t const fctrl = 0,
+           void (*tamper)(RadioFake::Packet &) = nullptr) {
+  RadioFake::Packet packet = sent;
+  packet.time = sent.time + OsDeltaTime::from_sec(1);
+  packet.data[0] = mhdr::ftype_data_down | mhdr::major_v1;
+  wlsbf4(packet.data.begin() + mac_payload::offsets::devAddr, DEVADDR);
+  packet.data[mac_payload::offsets::fctrl] = fctrl;
+  wlsbf2(packet.data.begin() + mac_payload::offsets::fcnt, fcnt);
+  uint8_t pos = mac_payload::offsets::fopts;
+  if (length > 0) {
+    packet.data[pos++] = PORT;
+    std::copy(clear.begin(), clear.begin() + length,
+              packet.data.begin() + pos);
+    Aes aes;
+    aes.setApplicationSessionKey(appSKey);
+    aes.setNetworkSessionKey(nwkSKey);
+    aes.framePayloadEncryption(PORT, DEVADDR, fcnt, PktDir::DOWN,
+                               packet.data.begin() + pos, length);
+    pos += length;
+  }
+  Aes aes;
+  aes.setNetworkSessionKey(nwkSKey);
+  aes.appendMic(DEVADDR, fcnt, PktDir::DOWN, packet.data.begin(),
+                pos + lengths::MIC);
+  packet.length = pos + lengths::MIC;
+  if (tamper) {
+    tamper(packet);
+  }
+  radio.simulateRx(packet);
+}
+
+void send() {
+  uint8_t data = 1;
+  lmic.setTxData2(1, &data, 1, false);
+}
+
+// send an uplink, answer in RX1 with payload on port (no port if length 0)
+void exchange(uint8_t const length, uint16_t const fcnt = 0,
+              void (*tamper)(RadioFake::Packet &) = nullptr) {
+  startSession();
+  send();
+  reply(waitUplink(), length, fcnt, 0, tamper);
+  waitReady();
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_lazy_decrypt);
+  RUN_TEST(test_peek);
+  RUN_TEST(test_const_data);
+  RUN_TEST(test_empty_downlink);
+  RUN_TEST(test_filter_valid);
+  RUN_TEST(test_filter_header);
+  RUN_TEST(test_filter_address);
+  RUN_TEST(test_filter_counter);
+  RUN_TEST(test_filter_counter_gap);
+  RUN_TEST(test_filter_mic);
+  RUN_TEST(test_fast_drain);
+  RUN_TEST(test_fast_drain_cap);
+  RUN_TEST(test_fast_drain_off);
+  RUN_TEST(test_fast_drain_cancel);
+}
+
+void test_lazy_decrypt() {
+  for (uint8_t i = 0; i < clear.size(); i++) {
+    clear[i] = i;
+  }
+  exchange(clear.size());
+
+  auto view = lmic.getDownlink();
+  TEST_ASSERT_EQUAL_UINT8(PORT, view.port());
+  TEST_ASSERT_EQUAL_UINT8(clear.size(), view.length());
+  TEST_ASSERT_FALSE(view.empty());
+  auto const data = view.data();
+  TEST_ASSERT_NOT_NULL(data);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), data, clear.size());
+  // decrypted once
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), view.data(), clear.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), lmic.getData(), clear.size());
+}
+
+void test_peek() {
+  for (uint8_t i = 0; i < clear.size(); i++) {
+    clear[i] = 0xA0 + i;
+  }
+  exchange(clear.size());
+
+  auto view = lmic.getDownlink();
+  auto const header = view.peek(1);
+  TEST_ASSERT_NOT_NULL(header);
+  // first AES block only
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), header, 16);
+  TEST_ASSERT_FALSE(std::equal(clear.begin() + 16, clear.end(), header + 16));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), view.peek(20), 32);
+  TEST_ASSERT_FALSE(std::equal(clear.begin() + 32, clear.end(), header + 32));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), view.data(), clear.size());
+}
+
+void test_const_data() {
+  for (uint8_t i = 0; i < clear.size(); i++) {
+    clear[i] = 0x30 + i;
+  }
+  exchange(clear.size());
+
+  // decrypted on first read, also from a const MAC.
+  Lmic const &reader = lmic;
+  TEST_ASSERT_EQUAL_UINT8(clear.size(), reader.getDataLen());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), reader.getData(), clear.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(clear.begin(), reader.getData(), clear.size());
+}
+
+void test_empty_downlink() {
+  exchange(0);
+  auto view = lmic.getDownlink();
+  TEST_ASSERT_EQUAL_UINT8(0, view.port());
+  TEST_ASSERT_EQUAL_UINT8(0, view.length());
+  TEST_ASSERT_TRUE(view.empty());
+  TEST_ASSERT_TRUE(lmic.getTxRxFlags().test(TxRxStatus::NOPORT));
+}
+
+void test_filter_valid() {
+  lmic.resetDownlinkFilterStats();
+  exchange(4, 100);
+  TEST_ASSERT_EQUAL_UINT8(PORT, lmic.getDownlink().port());
+  auto const &stats = lmic.getDownlinkFilterStats();
+  TEST_ASSERT_EQUAL_UINT16(0, stats.badHeader);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.badLength);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.otherAddress);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.badFOpts);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.badCounter);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.badMic);
+}
+
+void test_filter_header() {
+  lmic.resetDownlinkFilterStats();
+  exchange(4, 0, [](RadioFake::Packet &packet) {
+    packet.data[0] = mhdr::ftype_join_acc | mhdr::major_v1;
+  });
+  TEST_ASSERT_TRUE(lmic.getTxRxFlags().test(TxRxStatus::NOPORT));
+  TEST_ASSERT_EQUAL_UINT16(1, lmic.getDownlinkFilterStats().badHeader);
+  TEST_ASSERT_EQUAL_UINT16(0, lmic.getDownlinkFilterStats().badMic);
+}
+
+void test_filter_address() {
+  lmic.resetDownlinkFilterStats();
+  exchange(4, 0, [](RadioFake::Packet &packet) {
+    packet.data[mac_payload::offsets::devAddr] ^= 0xFF;
+  });
+  TEST_ASSERT_EQUAL_UINT16(1, lmic.getDownlinkFilterStats().otherAddress);
+  TEST_ASSERT_EQUAL_UINT16(0, lmic.getDownlinkFilterStats().badMic);
+}
+
+void test_filter_counter() {
+  lmic.resetDownlinkFilterStats();
+  // valid MIC, but older than expected counter.
+  exchange(4, 0xFFFF);
+  TEST_ASSERT_TRUE(lmic.getTxRxFlags().test(TxRxStatus::NOPORT));
+  TEST_ASSERT_EQUAL_UINT16(1, lmic.getDownlinkFilterStats().badCounter);
+  TEST_ASSERT_EQUAL_UINT16(0, lmic.getDownlinkFilterStats().badMic);
+}
+
+void test_filter_counter_gap() {
+  lmic.resetDownlinkFilterStats();
+  exchange(4, MAX_FCNT_GAP + 1);
+  if (lorawan_v104) {
+    // no max gap in 1.0.4
+    TEST_ASSERT_EQUAL_UINT8(PORT, lmic.getDownlink().port());
+    TEST_ASSERT_EQUAL_UINT16(0, lmic.getDownlinkFilterStats().badCounter);
+    exchange(4, 0x8000);
+  }
+  TEST_ASSERT_TRUE(lmic.getTxRxFlags().test(TxRxStatus::NOPORT));
+  TEST_ASSERT_EQUAL_UINT16(1, lmic.getDownlinkFilterStats().badCounter);
+}
+
+void test_filter_mic() {
+  lmic.resetDownlinkFilterStats();
+  exchange(4, 0, [](RadioFake::Packet &packet) {
+    packet.data[packet.length - 1] ^= 0xFF;
+  });
+  TEST_ASSERT_TRUE(lmic.getTxRxFlags().test(TxRxStatus::NOPORT));
+  TEST_ASSERT_EQUAL_UINT16(1, lmic.getDownlinkFilterStats().badMic);
+  TEST_ASSERT_EQUAL_UINT16(0, lmic.getDownlinkFilterStats().badCounter);
+}
+
+void test_fast_drain() {
+  startSession();
+  lmic.setLinkCheckMode(false);
+  lmic.setDrTx(0);
+  lmic.setFastDrain(4);
+  lmic.resetFastDrainStats();
+  send();
+  auto sent = waitUplink();
+  TEST_ASSERT_EQUAL(SF12, sent.rps.sf);
+  reply(sent, 4, 0, FCT_MORE);
+
+  // poll at the datarate with least airtime.
+  auto const poll = waitUplink();
+  TEST_ASSERT_TRUE(lmic.isFastDraining());
+  TEST_ASSERT_EQUAL(SF7, poll.rps.sf);
+  reply(poll, 6, 1);
+  waitReady();
+  TEST_ASSERT_FALSE(lmic.isFastDraining());
+
+  auto const &stats = lmic.getFastDrainStats();
+  TEST_ASSERT_EQUAL_UINT16(1, stats.drains);
+  TEST_ASSERT_EQUAL_UINT16(1, stats.polls);
+  TEST_ASSERT_EQUAL_UINT16(2, stats.downlinks);
+  TEST_ASSERT_EQUAL_UINT32(10, stats.bytes);
+  // from first to second downlink, about one uplink interval.
+  TEST_ASSERT_INT32_WITHIN(2000, (poll.time - sent.time).to_ms(),
+                           stats.duration.to_ms());
+
+  // back to tx datarate.
+  send();
+  TEST_ASSERT_EQUAL(SF12, waitUplink().rps.sf);
+}
+
+void test_fast_drain_cap() {
+  startSession();
+  lmic.setLinkCheckMode(false);
+  lmic.setDrTx(0);
+  lmic.setFastDrain(1);
+  lmic.resetFastDrainStats();
+  send();
+  reply(waitUplink(), 4, 0, FCT_MORE);
+  auto const poll = waitUplink();
+  TEST_ASSERT_EQUAL(SF7, poll.rps.sf);
+  reply(poll, 4, 1, FCT_MORE);
+
+  // still polling, as usual.
+  auto const next = waitUplink();
+  TEST_ASSERT_FALSE(lmic.isFastDraining());
+  TEST_ASSERT_EQUAL(SF12, next.rps.sf);
+  reply(next, 4, 2);
+  waitReady();
+
+  auto const &stats = lmic.getFastDrainStats();
+  TEST_ASSERT_EQUAL_UINT16(1, stats.drains);
+  TEST_ASSERT_EQUAL_UINT16(1, stats.polls);
+  TEST_ASSERT_EQUAL_UINT16(2, stats.downlinks);
+}
+
+void test_fast_drain_off() {
+  startSession();
+  lmic.setLinkCheckMode(false);
+  lmic.setDrTx(0);
+  lmic.setFastDrain(0);
+  lmic.resetFastDrainStats();
+  send();
+  reply(waitUplink(), 4, 0, FCT_MORE);
+  auto const poll = waitUplink();
+  TEST_ASSERT_FALSE(lmic.isFastDraining());
+  TEST_ASSERT_EQUAL(SF12, poll.rps.sf);
+  TEST_ASSERT_EQUAL_UINT16(0, lmic.getFastDrainStats().downlinks);
+}
+
+void test_fast_drain_cancel() {
+  startSession();
+  lmic.setLinkCheckMode(false);
+  lmic.setDrTx(0);
+  lmic.setFastDrain(4);
+  send();
+  reply(waitUplink(), 4, 0, FCT_MORE);
+  // poll scheduled at the drain datarate, then cancelled.
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(60);
+  while (lmic.getTxRps().sf != SF7 && os_getTime() < timeout) {
+    lmic.run();
+    hal_add_time_in_sleep(OsDeltaTime::from_ms(1));
+  }
+  TEST_ASSERT_TRUE(lmic.isFastDraining());
+  TEST_ASSERT_EQUAL(SF7, lmic.getTxRps().sf);
+  lmic.clrTxData();
+  TEST_ASSERT_FALSE(lmic.isFastDraining());
+  TEST_ASSERT_EQUAL(SF12, lmic.getTxRps().sf);
+}
+
+} // namespace test_downlink
+
+#else
+
+namespace test_downlink {
+void run() {}
+} // namespace test_downlink
+
+#endif
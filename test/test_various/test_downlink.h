@@ -0,0 +1,22 @@
+#ifndef __test_downlink_h__
+#define __test_downlink_h__
+
+namespace test_downlink {
+void run();
+void test_lazy_decrypt();
+void test_peek();
+void test_const_data();
+void test_empty_downlink();
+void test_filter_valid();
+void test_filter_header();
+void test_filter_address();
+void test_filter_counter();
+void test_filter_counter_gap();
+void test_filter_mic();
+void test_fast_drain();
+void test_fast_drain_cap();
+void test_fast_drain_off();
+void test_fast_drain_cancel();
+} // namespace test_downlink
+
+#endif
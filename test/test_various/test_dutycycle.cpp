@@ -0,0 +1,174 @@
+#include "test_dutycycle.h"
+
+#include "lmic/band.eu868.h"
+#include "lmic/dutycycleledger.h"
+#include <unity.h>
+
+namespace test_dutycycle {
+
+namespace {
+constexpr OsTime start(1000);
+constexpr OsDeltaTime airtime = OsDeltaTime::from_ms(1000);
+constexpr OsDeltaTime hour = OsDeltaTime::from_sec(3600);
+
+// Number of transmissions of airtime in duration, sent as soon as allowed.
+template <typename Model>
+uint16_t greedy(Model &model, OsDeltaTime const duration,
+                OsDeltaTime &maxHour) {
+  std::array<OsTime, 512> sent;
+  uint16_t count = 0;
+  auto now = start;
+  maxHour = OsDeltaTime(0);
+  while (now < start + duration && count < sent.size()) {
+    now = model.availability(now);
+    model.add(now, airtime);
+    sent[count++] = now;
+    // airtime in the hour before the end of this transmission
+    uint16_t inHour = 0;
+    for (uint16_t i = 0; i < count; i++) {
+      if (now + airtime - sent[i] <= hour) {
+        inHour++;
+      }
+    }
+    if (maxHour < inHour * airtime) {
+      maxHour = inHour * airtime;
+    }
+    now += airtime;
+  }
+  return count;
+}
+
+// model of BandsEu868 without ledger: blocked 100 * airtime after each.
+struct PerTransmission {
+  OsTime avail = start;
+  OsTime availability(OsTime now) const { return avail < now ? now : avail; }
+  void add(OsTime time, OsDeltaTime duration) { avail = time + 100 * duration; }
+};
+
+struct Ledger {
+  DutyCycleLedger ledger{start};
+  OsTime availability(OsTime now) const {
+    auto const avail = ledger.availability(now, 100);
+    return avail < now ? now : avail;
+  }
+  void add(OsTime time, OsDeltaTime duration) { ledger.add(time, duration); }
+};
+} // namespace
+
+void run() {
+  RUN_TEST(test_burst);
+  RUN_TEST(test_hourly_budget);
+  RUN_TEST(test_wait_oldest);
+  RUN_TEST(test_save_restore);
+  RUN_TEST(test_bands_eu868);
+}
+
+void test_burst() {
+  PerTransmission perTransmission;
+  Ledger ledger;
+  perTransmission.add(start, airtime);
+  ledger.add(start, airtime);
+  auto const retry = start + OsDeltaTime::from_sec(3);
+  // per transmission model block the band for 100 s
+  TEST_ASSERT_EQUAL_UINT32((start + 100 * airtime).tick(),
+                           perTransmission.availability(retry).tick());
+  // the retry is allowed by the hourly budget
+  TEST_ASSERT_EQUAL_UINT32(retry.tick(), ledger.availability(retry).tick());
+  // available since the ledger start, whatever the time of the request.
+  TEST_ASSERT_EQUAL_UINT32(start.tick(),
+                           ledger.ledger.availability(retry, 100).tick());
+  TEST_ASSERT_EQUAL_UINT32(
+      start.tick(),
+      ledger.ledger.availability(retry + OsDeltaTime::from_sec(60), 100)
+          .tick());
+  TEST_ASSERT_EQUAL_INT32(airtime.tick(), ledger.ledger.used(retry).tick());
+}
+
+void test_hourly_budget() {
+  OsDeltaTime maxHour;
+  PerTransmission perTransmission;
+  auto const perTransmissionCount =
+      greedy(perTransmission, 5 * hour, maxHour);
+  TEST_ASSERT_TRUE(maxHour <= OsDeltaTime::from_sec(36));
+
+  Ledger ledger;
+  auto const ledgerCount = greedy(ledger, 5 * hour, maxHour);
+  // never more than 1% of any hour
+  TEST_ASSERT_TRUE(maxHour <= OsDeltaTime::from_sec(36));
+  // near the same long term rate, window is 5 minutes longer than one hour.
+  TEST_ASSERT_TRUE(ledgerCount * 100 >= perTransmissionCount * 90);
+
+  // the whole budget can be used at once.
+  Ledger burst;
+  uint8_t count = 0;
+  auto now = start;
+  while (burst.availability(now) <= now) {
+    burst.add(now, airtime);
+    now += airtime;
+    count++;
+  }
+  TEST_ASSERT_EQUAL_UINT8(36, count);
+}
+
+void test_wait_oldest() {
+  DutyCycleLedger ledger(start);
+  // 20 s in first bucket, 15 s ten minutes later
+  ledger.add(start, OsDeltaTime::from_sec(20));
+  ledger.add(start + OsDeltaTime::from_sec(600), OsDeltaTime::from_sec(15));
+  auto const now = start + OsDeltaTime::from_sec(700);
+  // 35 s used + 15 s margin: wait for first bucket to leave.
+  auto const expected = start + 13 * DutyCycleLedger::BUCKET_DURATION;
+  TEST_ASSERT_EQUAL_UINT32(expected.tick(),
+                           ledger.availability(now, 100).tick());
+  TEST_ASSERT_EQUAL_UINT32(expected.tick(),
+                           ledger.availability(expected, 100).tick());
+  // still the bucket edge later, not the time of the request.
+  TEST_ASSERT_EQUAL_UINT32(
+      expected.tick(),
+      ledger.availability(expected + OsDeltaTime::from_sec(100), 100).tick());
+  TEST_ASSERT_EQUAL_UINT32(expected.tick(),
+                           ledger.availability(start + 2 * hour, 100).tick());
+  TEST_ASSERT_EQUAL_INT32(OsDeltaTime::from_sec(15).tick(),
+                          ledger.used(expected).tick());
+  // all gone after the window.
+  TEST_ASSERT_EQUAL_INT32(0, ledger.used(start + 2 * hour).tick());
+}
+
+void test_save_restore() {
+#if defined(ENABLE_SAVE_RESTORE)
+  DutyCycleLedger ledger(start);
+  ledger.add(start, OsDeltaTime::from_sec(30));
+  uint8_t buffer[DutyCycleLedger::getStateSize()];
+  StoringBuffer store(buffer);
+  ledger.saveState(store);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(buffer), store.length());
+
+  DutyCycleLedger restored(OsTime(0));
+  RetrieveBuffer retrieve(buffer);
+  restored.loadState(retrieve);
+  auto const now = start + OsDeltaTime::from_sec(60);
+  TEST_ASSERT_EQUAL_INT32(ledger.used(now).tick(), restored.used(now).tick());
+  TEST_ASSERT_EQUAL_UINT32(ledger.availability(now, 100).tick(),
+                           restored.availability(now, 100).tick());
+#else
+  TEST_IGNORE();
+#endif
+}
+
+void test_bands_eu868() {
+  BandsEu868 bands;
+  auto const band = bands.getBandForFrequency(868100000);
+  auto const now = os_getTime();
+  bands.updateBandAvailability(band, now, airtime);
+#if defined(LMIC_DUTY_CYCLE_WINDOW)
+  auto const availability = bands.getAvailability(band);
+  TEST_ASSERT_TRUE(availability <= now);
+  TEST_ASSERT_EQUAL_UINT32(availability.tick(),
+                           bands.getAvailability(band).tick());
+#else
+  TEST_ASSERT_EQUAL_UINT32((now + 100 * airtime).tick(),
+                           bands.getAvailability(band).tick());
+#endif
+}
+
+} // namespace test_dutycycle
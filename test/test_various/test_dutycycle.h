@@ -0,0 +1,13 @@
+#ifndef __test_dutycycle_h__
+#define __test_dutycycle_h__
+
+namespace test_dutycycle {
+void run();
+void test_burst();
+void test_hourly_budget();
+void test_wait_oldest();
+void test_save_restore();
+void test_bands_eu868();
+} // namespace test_dutycycle
+
+#endif
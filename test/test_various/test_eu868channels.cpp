@@ -3,13 +3,23 @@
 #include "test_eu868channels.h"
 
 #include "lmic/lmic.eu868.h"
+#include <array>
 #include <set>
 #include <tuple>
 #include <unity.h>
 
 namespace test_eu868channels {
 
-void run() { RUN_TEST(test_default_join_frequency); }
+void run() {
+  RUN_TEST(test_default_join_frequency);
+  RUN_TEST(test_band_frequency);
+  RUN_TEST(test_next_tx_spreading);
+  RUN_TEST(test_next_tx_earliest_band);
+  RUN_TEST(test_next_tx_datarate);
+  RUN_TEST(test_join_hint);
+  RUN_TEST(test_join_hint_margin);
+  RUN_TEST(test_join_hint_cleared);
+}
 
 void test_default_join_frequency() {
 
@@ -66,4 +76,230 @@ void test_default_join_frequency() {
   // all 18 combinations of frequencies and spreading factors are used
   TEST_ASSERT_EQUAL(18, frequenciesAndSpreadingFactors.size());
 }
-} // namespace test_eu868channels
\ No newline at end of file
+
+void test_band_frequency() {
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+
+  // band is kept in low bits, frequency read back unchanged
+  TEST_ASSERT_TRUE(testObj.setupChannel(3, 868850100, 0x3F));
+  testObj.mapChannels(0, 1 << 3);
+  testObj.setDrTx(5);
+  testObj.nextTx(os_getTime());
+  TEST_ASSERT_EQUAL_UINT32(868850100, testObj.getTxParameter().frequency);
+  TEST_ASSERT_EQUAL_UINT32(868850100, testObj.getRx1Parameter().frequency);
+
+  uint32_t frequency = 0;
+  OsTime availability;
+  TEST_ASSERT_TRUE(testObj.getChannelAvailability(3, 5, os_getTime(),
+                                                  frequency, availability));
+  TEST_ASSERT_EQUAL_UINT32(868850100, frequency);
+  TEST_ASSERT_FALSE(testObj.getChannelAvailability(0, 5, os_getTime(),
+                                                   frequency, availability));
+}
+
+void test_next_tx_spreading() {
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  static_cast<RegionalChannelParams &>(testObj)
+      .setRegionalDutyCycleVerification(false);
+  testObj.setupChannel(3, 867100000, 0x3F);
+  testObj.setDrTx(5);
+
+  std::set<uint32_t> frequencies;
+  uint32_t last = 0;
+  for (int i = 0; i < 100; i++) {
+    auto const now = os_getTime();
+    TEST_ASSERT_EQUAL_UINT32(now.tick(), testObj.nextTx(now).tick());
+    auto const frequency = testObj.getTxParameter().frequency;
+    // never twice the same channel when other are available
+    TEST_ASSERT_NOT_EQUAL(last, frequency);
+    frequencies.insert(frequency);
+    last = frequency;
+  }
+  TEST_ASSERT_EQUAL(4, frequencies.size());
+}
+
+void test_next_tx_earliest_band() {
+#if !defined(LMIC_DUTY_CYCLE_WINDOW)
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  // 10% band
+  testObj.setupChannel(3, 869525000, 0x3F);
+  testObj.setDrTx(5);
+  auto const airtime = OsDeltaTime::from_ms(10);
+
+  // block the 1% band
+  testObj.mapChannels(0, 1);
+  auto const start = os_getTime();
+  TEST_ASSERT_EQUAL_UINT32(start.tick(), testObj.nextTx(start).tick());
+  testObj.updateTxTimes(airtime);
+  testObj.mapChannels(0, 0xF);
+
+  // only the 10% band is free
+  TEST_ASSERT_EQUAL_UINT32(start.tick(), testObj.nextTx(start).tick());
+  TEST_ASSERT_EQUAL_UINT32(869525000, testObj.getTxParameter().frequency);
+  testObj.updateTxTimes(airtime);
+
+  // both blocked, 10% band is available first
+  // (band usage is dated with the clock at update).
+  auto const availability = testObj.nextTx(start);
+  TEST_ASSERT_TRUE(start + 10 * airtime <= availability);
+  TEST_ASSERT_TRUE(availability < os_getTime() + 10 * airtime +
+                                      OsDeltaTime::from_ms(1));
+  TEST_ASSERT_EQUAL_UINT32(869525000, testObj.getTxParameter().frequency);
+  TEST_ASSERT_EQUAL_UINT32(availability.tick(),
+                           testObj.getTxAvailability(start).tick());
+#endif
+}
+
+namespace {
+// frequencies selected by nextTx over some uplinks.
+std::set<uint32_t> next_tx_frequencies(Eu868RegionalChannelParams &testObj) {
+  std::set<uint32_t> frequencies;
+  for (int i = 0; i < 50; i++) {
+    testObj.nextTx(os_getTime());
+    frequencies.insert(testObj.getTxParameter().frequency);
+  }
+  return frequencies;
+}
+} // namespace
+
+void test_next_tx_datarate() {
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  static_cast<RegionalChannelParams &>(testObj)
+      .setRegionalDutyCycleVerification(false);
+  // DR0 to DR2 only
+  testObj.setupChannel(3, 867100000, 0x07);
+
+  testObj.setDrTx(5);
+  TEST_ASSERT_EQUAL(0, next_tx_frequencies(testObj).count(867100000));
+  testObj.setDrTx(1);
+  TEST_ASSERT_EQUAL(1, next_tx_frequencies(testObj).count(867100000));
+
+  // reconfigured for all datarates, then disabled.
+  testObj.setupChannel(3, 867100000, 0x3F);
+  testObj.setDrTx(5);
+  TEST_ASSERT_EQUAL(4, next_tx_frequencies(testObj).size());
+  testObj.mapChannels(0, 0x7);
+  TEST_ASSERT_EQUAL(0, next_tx_frequencies(testObj).count(867100000));
+  testObj.mapChannels(0, 0xF);
+
+#if defined(ENABLE_SAVE_RESTORE)
+  std::array<uint8_t, 512> buffer;
+  StoringBuffer store{buffer.begin()};
+  testObj.saveState(store);
+  TEST_ASSERT_EQUAL(Eu868RegionalChannelParams::getStateSize(), store.length());
+  Eu868RegionalChannelParams restored(rand);
+  restored.initDefaultChannels();
+  static_cast<RegionalChannelParams &>(restored)
+      .setRegionalDutyCycleVerification(false);
+  RetrieveBuffer retrieve{buffer.begin()};
+  restored.loadState(retrieve);
+  restored.setDrTx(5);
+  TEST_ASSERT_EQUAL(4, next_tx_frequencies(restored).size());
+#endif
+}
+
+namespace {
+// run join loop until datarate, then accept the join
+uint32_t join_at(Eu868RegionalChannelParams &testObj, dr_t const dr,
+                 int8_t const snr) {
+  testObj.initJoinLoop();
+  while (testObj.getTxDr() != dr) {
+    testObj.nextJoinState();
+  }
+  testObj.joinAccepted(-110, snr);
+  return testObj.getTxParameter().frequency;
+}
+} // namespace
+
+void test_join_hint() {
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  TEST_ASSERT_FALSE(testObj.getJoinHint().isValid());
+
+  // SF10 with 3dB of margin
+  auto const frequency = join_at(testObj, 2, -12);
+  TEST_ASSERT_EQUAL_UINT8(2, testObj.getJoinHint().dr);
+  TEST_ASSERT_EQUAL_INT16(-110, testObj.getJoinHint().rssi);
+
+#if defined(ENABLE_SAVE_RESTORE)
+  std::array<uint8_t, 512> buffer;
+  StoringBuffer store{buffer.begin()};
+  testObj.saveState(store);
+  TEST_ASSERT_EQUAL(Eu868RegionalChannelParams::getStateSize(), store.length());
+  Eu868RegionalChannelParams restored(rand);
+  restored.initDefaultChannels();
+  RetrieveBuffer retrieve{buffer.begin()};
+  restored.loadState(retrieve);
+  TEST_ASSERT_EQUAL_UINT8(2, restored.getJoinHint().dr);
+  TEST_ASSERT_EQUAL_INT16(-110, restored.getJoinHint().rssi);
+  TEST_ASSERT_EQUAL_INT8(-12, restored.getJoinHint().snr);
+#else
+  auto &restored = testObj;
+#endif
+
+  // first attempt on same channel and datarate, then other channel.
+  restored.initJoinLoop();
+  TEST_ASSERT_EQUAL_UINT8(2, restored.getTxDr());
+  TEST_ASSERT_EQUAL_UINT32(frequency, restored.getTxParameter().frequency);
+  restored.nextJoinState();
+  TEST_ASSERT_EQUAL_UINT8(2, restored.getTxDr());
+  TEST_ASSERT_NOT_EQUAL(frequency, restored.getTxParameter().frequency);
+  restored.nextJoinState();
+  TEST_ASSERT_EQUAL_UINT8(1, restored.getTxDr());
+}
+
+void test_join_hint_margin() {
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+
+  // 15dB of margin at SF10: start one datarate faster
+  join_at(testObj, 2, 0);
+  testObj.initJoinLoop();
+  TEST_ASSERT_EQUAL_UINT8(3, testObj.getTxDr());
+
+  // 1dB of margin: one datarate slower
+  join_at(testObj, 2, -14);
+  testObj.initJoinLoop();
+  TEST_ASSERT_EQUAL_UINT8(1, testObj.getTxDr());
+
+  // never above max join datarate
+  join_at(testObj, 5, 10);
+  testObj.initJoinLoop();
+  TEST_ASSERT_EQUAL_UINT8(5, testObj.getTxDr());
+}
+
+void test_join_hint_cleared() {
+  Aes aes;
+  LmicRand rand{aes};
+  Eu868RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  join_at(testObj, 3, -5);
+
+  testObj.initJoinLoop();
+  int attempts = 1;
+  while (testObj.nextJoinState().status) {
+    attempts++;
+  }
+  // two attempts by datarate from DR3
+  TEST_ASSERT_EQUAL(8, attempts);
+  TEST_ASSERT_FALSE(testObj.getJoinHint().isValid());
+  TEST_ASSERT_EQUAL_UINT8(5, testObj.getTxDr());
+}
+
+} // namespace test_eu868channels
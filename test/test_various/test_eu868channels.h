@@ -4,6 +4,13 @@
 namespace test_eu868channels {
 void run();
 void test_default_join_frequency();
+void test_band_frequency();
+void test_next_tx_spreading();
+void test_next_tx_earliest_band();
+void test_next_tx_datarate();
+void test_join_hint();
+void test_join_hint_margin();
+void test_join_hint_cleared();
 } // namespace test_eu868channels
 
 #endif
\ No newline at end of file
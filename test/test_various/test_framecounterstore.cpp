@@ -0,0 +1,179 @@
+#include "test_framecounterstore.h"
+
+#include <unity.h>
+
+#if !defined(ARDUINO)
+
+#include "hal/hal.h"
+#include "lmic/framecounterstore.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/radio_fake.h"
+#include "mac_util.h"
+#include <array>
+
+namespace test_framecounterstore {
+
+namespace {
+using mac_util::DEVADDR;
+
+std::array<uint8_t, 4 * FrameCounterStore::RECORD_SIZE> memory;
+
+// count writes by byte, stop writing after writeLimit writes.
+class CountingStorage final : public SnapshotStorage {
+public:
+  std::array<uint16_t, memory.size()> writes{};
+  uint32_t writeLimit = UINT32_MAX;
+
+  uint8_t read(uint16_t const offset) const final { return memory[offset]; };
+  void write(uint16_t const offset, uint8_t const value) final {
+    if (writeLimit == 0) {
+      return;
+    }
+    writeLimit--;
+    writes[offset]++;
+    memory[offset] = value;
+  };
+};
+
+RadioFake radio;
+LmicEu868 lmic(radio);
+} // namespace
+
+void run() {
+  RUN_TEST(test_batched_writes);
+  RUN_TEST(test_wear_levelling);
+  RUN_TEST(test_other_session);
+  RUN_TEST(test_rejoin_same_address);
+  RUN_TEST(test_power_loss);
+  RUN_TEST(test_torn_write);
+}
+
+void test_batched_writes() {
+  memory.fill(0xFF);
+  CountingStorage storage;
+  FrameCounterStore store{storage, memory.size(), 8};
+
+  mac_util::start_session(lmic, radio, 5);
+  lmic.setFrameCounterStore(&store);
+  for (uint16_t i = 0; i < 20; i++) {
+    TEST_ASSERT_EQUAL_UINT16(i, mac_util::send_one(lmic, radio));
+  }
+  lmic.setFrameCounterStore(nullptr);
+  // reserved at counter 0, 8 and 16
+  TEST_ASSERT_EQUAL_UINT16(3, store.recordWriteCount());
+}
+
+void test_wear_levelling() {
+  memory.fill(0xFF);
+  CountingStorage storage;
+  FrameCounterStore store{storage, memory.size(), 4};
+
+  for (uint32_t up = 1; up <= 4 * 40; up++) {
+    store.update(DEVADDR, up, 0);
+  }
+  TEST_ASSERT_EQUAL_UINT16(40, store.recordWriteCount());
+  // each slot written 10 times
+  for (auto const count : storage.writes) {
+    TEST_ASSERT_EQUAL_UINT16(10, count);
+  }
+
+  // found after a reboot
+  FrameCounterStore rebooted{storage, memory.size(), 4};
+  uint32_t up = 0;
+  uint32_t dn = 0;
+  TEST_ASSERT_TRUE(rebooted.restore(DEVADDR, up, dn));
+  TEST_ASSERT_EQUAL_UINT32(4 * 40, up);
+}
+
+void test_other_session() {
+  memory.fill(0xFF);
+  CountingStorage storage;
+  FrameCounterStore store{storage, memory.size()};
+  uint32_t up = 5;
+  uint32_t dn = 6;
+  // erased storage
+  TEST_ASSERT_FALSE(store.restore(DEVADDR, up, dn));
+
+  store.update(DEVADDR, 100, 3);
+  TEST_ASSERT_FALSE(store.restore(DEVADDR + 1, up, dn));
+  TEST_ASSERT_EQUAL_UINT32(5, up);
+  TEST_ASSERT_EQUAL_UINT32(6, dn);
+
+  // new session (join) start a new block
+  store.update(DEVADDR + 1, 1, 0);
+  TEST_ASSERT_EQUAL_UINT16(2, store.recordWriteCount());
+  TEST_ASSERT_TRUE(store.restore(DEVADDR + 1, up, dn));
+  TEST_ASSERT_EQUAL_UINT32(32, up);
+  TEST_ASSERT_EQUAL_UINT32(0, dn);
+}
+
+void test_rejoin_same_address() {
+  memory.fill(0xFF);
+  CountingStorage storage;
+  FrameCounterStore store{storage, memory.size()};
+  store.update(DEVADDR, 100, 40);
+
+  // join accept give the same devaddr, counters restart from zero.
+  store.startSession(DEVADDR, 0, 0);
+  store.update(DEVADDR, 1, 0);
+  TEST_ASSERT_EQUAL_UINT16(2, store.recordWriteCount());
+
+  FrameCounterStore rebooted{storage, memory.size()};
+  uint32_t up = 0;
+  uint32_t dn = 0;
+  TEST_ASSERT_TRUE(rebooted.restore(DEVADDR, up, dn));
+  TEST_ASSERT_EQUAL_UINT32(31, up);
+  TEST_ASSERT_EQUAL_UINT32(0, dn);
+}
+
+void test_power_loss() {
+  memory.fill(0xFF);
+  CountingStorage storage;
+  FrameCounterStore store{storage, memory.size(), 8};
+
+  mac_util::start_session(lmic, radio, 5);
+  lmic.setFrameCounterStore(&store);
+  uint16_t last = 0;
+  for (uint16_t i = 0; i < 5; i++) {
+    last = mac_util::send_one(lmic, radio);
+  }
+  lmic.setFrameCounterStore(nullptr);
+
+  // power loss, RAM lost
+  FrameCounterStore rebooted{storage, memory.size(), 8};
+  mac_util::start_session(lmic, radio, 5);
+  lmic.setFrameCounterStore(&rebooted);
+  auto const next = mac_util::send_one(lmic, radio);
+  lmic.setFrameCounterStore(nullptr);
+  TEST_ASSERT_TRUE(next > last);
+  TEST_ASSERT_EQUAL_UINT16(8, next);
+}
+
+void test_torn_write() {
+  memory.fill(0xFF);
+  CountingStorage storage;
+  FrameCounterStore store{storage, memory.size(), 8};
+  store.update(DEVADDR, 1, 0);
+  store.update(DEVADDR, 9, 0);
+
+  // power loss in the middle of the third record
+  storage.writeLimit = FrameCounterStore::RECORD_SIZE / 2;
+  store.update(DEVADDR, 17, 0);
+
+  FrameCounterStore rebooted{storage, memory.size(), 8};
+  uint32_t up = 0;
+  uint32_t dn = 0;
+  TEST_ASSERT_TRUE(rebooted.restore(DEVADDR, up, dn));
+  // the frame 16 was not sent, the write was not complete.
+  TEST_ASSERT_EQUAL_UINT32(16, up);
+}
+
+} // namespace test_framecounterstore
+
+#else
+
+namespace test_framecounterstore {
+void run() {}
+} // namespace test_framecounterstore
+
+#endif
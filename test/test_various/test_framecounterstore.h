@@ -0,0 +1,14 @@
+#ifndef __test_framecounterstore_h__
+#define __test_framecounterstore_h__
+
+namespace test_framecounterstore {
+void run();
+void test_batched_writes();
+void test_wear_levelling();
+void test_other_session();
+void test_rejoin_same_address();
+void test_power_loss();
+void test_torn_write();
+} // namespace test_framecounterstore
+
+#endif
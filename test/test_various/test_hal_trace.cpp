@@ -0,0 +1,199 @@
+#include "test_hal_trace.h"
+
+#ifndef ARDUINO
+
+#include "hal/hal.h"
+#include "hal/hal_trace_analyzer.h"
+#include "lmic/lmic.h"
+#include "lmic/radio_emulator_sx126x.h"
+#include "lmic/radio_emulator_sx127x.h"
+#include "lmic/radio_sx1262.h"
+#include "lmic/radio_sx1276.h"
+#include <unity.h>
+#include <vector>
+
+namespace test_hal_trace {
+
+namespace {
+constexpr lmic_pinmap pins = {
+    .nss = 1,
+    .prepare_antenna_tx = nullptr,
+    .rst = 2,
+    .dio = {3, 4},
+};
+
+constexpr uint32_t freq = 868100000;
+constexpr rps_t rps_sf7 = rps_t(SF7, BandWidth::BW125, CodingRate::CR_4_5);
+constexpr uint8_t payload[] = {0x40, 0x01, 0x02, 0x03, 0x04, 0x80,
+                               0x05, 0x00, 0x01, 0xA1, 0xB2, 0xC3};
+
+constexpr TraceRecord op(uint32_t time, TraceOperation operation, bool begin) {
+  return TraceRecord{time, static_cast<uint16_t>(operation),
+                     begin ? TraceEvent::OP_BEGIN : TraceEvent::OP_END, 0};
+}
+
+constexpr TraceRecord spi(uint32_t time, uint16_t bytes) {
+  return TraceRecord{time, bytes, TraceEvent::SPI, 0x01};
+}
+
+TraceSummary const &summary(TraceSummaries const &summaries,
+                            TraceOperation operation) {
+  return summaries[static_cast<uint8_t>(operation)];
+}
+
+#ifdef LMIC_SPI_TRACE
+// Summary of operation, traced alone from an empty ring buffer.
+template <typename Run>
+TraceSummary trace_operation(TraceOperation const operation, Run const &run) {
+  hal_trace_clear();
+  run();
+  std::vector<TraceRecord> records(LMIC_SPI_TRACE_SIZE);
+  auto const count = hal_trace_copy(records.data(), records.size());
+  auto const summaries = hal_trace_summarize(records.data(), count);
+  auto const &traced = summary(summaries, operation);
+  if (hal_trace_dropped() != 0) {
+    // longer than LMIC_SPI_TRACE_SIZE records, begin is overwritten.
+    char message[80];
+    snprintf(message, sizeof(message), "%s: %u records dropped",
+             hal_trace_operation_name(operation),
+             static_cast<unsigned>(hal_trace_dropped()));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(LMIC_SPI_TRACE_SIZE, count);
+    TEST_ASSERT_EQUAL_UINT32(0, traced.calls);
+    return traced;
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, traced.calls);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, traced.transactions);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(traced.transactions, traced.bytes);
+  return traced;
+}
+
+// each operation once, tx bus use checked against the emulator.
+template <typename RadioType>
+void trace_operations(RadioEmulator &emulator, RadioType &radio) {
+  trace_operation(TraceOperation::INIT, [&] { radio.init(); });
+  trace_operation(TraceOperation::INIT_RANDOM, [&] {
+    std::array<uint8_t, 16> randbuf;
+    radio.init_random(randbuf);
+  });
+  emulator.resetSpiStats();
+  auto const tx = trace_operation(TraceOperation::TX, [&] {
+    radio.tx(freq, rps_sf7, 14, payload, sizeof(payload));
+  });
+  TEST_ASSERT_EQUAL_UINT32(emulator.spiStats().transactions, tx.transactions);
+  TEST_ASSERT_EQUAL_UINT32(emulator.spiStats().bytes, tx.bytes);
+  trace_operation(TraceOperation::END_TX, [&] {
+    hal_add_time_in_sleep(Lmic::calcAirTime(rps_sf7, sizeof(payload)));
+    radio.handle_end_tx();
+  });
+  trace_operation(TraceOperation::RX,
+                  [&] { radio.rx(freq, rps_sf7, 8, os_getTime()); });
+  trace_operation(TraceOperation::END_RX, [&] {
+    hal_add_time_in_sleep(9 * Lmic::timeBySymbol(rps_sf7));
+    RxFrameBuffer frame;
+    TEST_ASSERT_EQUAL_UINT8(0, radio.handle_end_rx(frame, true));
+  });
+}
+#endif
+} // namespace
+
+void run() {
+  RUN_TEST(test_summarize);
+  RUN_TEST(test_summarize_nested);
+  RUN_TEST(test_summarize_lost_begin);
+  RUN_TEST(test_trace_sx1276);
+  RUN_TEST(test_trace_sx1262);
+}
+
+void test_summarize() {
+  TraceRecord const records[] = {
+      spi(0, 2), // outside of any operation
+      op(10, TraceOperation::TX, true),
+      spi(11, 2),
+      spi(12, 21),
+      TraceRecord{13, 1, TraceEvent::ANTENNA, 0},
+      op(20, TraceOperation::TX, false),
+      op(30, TraceOperation::TX, true),
+      spi(31, 3),
+      op(35, TraceOperation::TX, false),
+  };
+  auto const summaries =
+      hal_trace_summarize(records, sizeof(records) / sizeof(records[0]));
+  auto const &tx = summary(summaries, TraceOperation::TX);
+  TEST_ASSERT_EQUAL_UINT32(2, tx.calls);
+  TEST_ASSERT_EQUAL_UINT32(3, tx.transactions);
+  TEST_ASSERT_EQUAL_UINT32(26, tx.bytes);
+  TEST_ASSERT_EQUAL_INT32(15, tx.wallTime.tick());
+  TEST_ASSERT_EQUAL_UINT32(0, summary(summaries, TraceOperation::RX).calls);
+}
+
+void test_summarize_nested() {
+  TraceRecord const records[] = {
+      op(0, TraceOperation::INIT, true),
+      spi(1, 2),
+      op(2, TraceOperation::INIT_RANDOM, true),
+      spi(3, 2),
+      spi(4, 2),
+      op(5, TraceOperation::INIT_RANDOM, false),
+      op(6, TraceOperation::INIT, false),
+  };
+  auto const summaries =
+      hal_trace_summarize(records, sizeof(records) / sizeof(records[0]));
+  // transactions are counted only in the innermost operation
+  TEST_ASSERT_EQUAL_UINT32(1,
+                           summary(summaries, TraceOperation::INIT).transactions);
+  TEST_ASSERT_EQUAL_INT32(
+      6, summary(summaries, TraceOperation::INIT).wallTime.tick());
+  TEST_ASSERT_EQUAL_UINT32(
+      2, summary(summaries, TraceOperation::INIT_RANDOM).transactions);
+}
+
+void test_summarize_lost_begin() {
+  // begin of rx overwritten in the ring buffer
+  TraceRecord const records[] = {
+      spi(1, 2),
+      op(2, TraceOperation::RX, false),
+      op(3, TraceOperation::TX, true),
+      spi(4, 5),
+      op(5, TraceOperation::TX, false),
+  };
+  auto const summaries =
+      hal_trace_summarize(records, sizeof(records) / sizeof(records[0]));
+  TEST_ASSERT_EQUAL_UINT32(0, summary(summaries, TraceOperation::RX).calls);
+  TEST_ASSERT_EQUAL_UINT32(1, summary(summaries, TraceOperation::TX).calls);
+  TEST_ASSERT_EQUAL_UINT32(5, summary(summaries, TraceOperation::TX).bytes);
+}
+
+void test_trace_sx1276() {
+#ifdef LMIC_SPI_TRACE
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  trace_operations(emulator, radio);
+  emulator.uninstall();
+#else
+  TEST_IGNORE();
+#endif
+}
+
+void test_trace_sx1262() {
+#ifdef LMIC_SPI_TRACE
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  trace_operations(emulator, radio);
+  emulator.uninstall();
+#else
+  TEST_IGNORE();
+#endif
+}
+
+} // namespace test_hal_trace
+
+#else
+
+namespace test_hal_trace {
+void run() {}
+} // namespace test_hal_trace
+
+#endif
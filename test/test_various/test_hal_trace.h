@@ -0,0 +1,13 @@
+#ifndef __test_hal_trace_h__
+#define __test_hal_trace_h__
+
+namespace test_hal_trace {
+void run();
+void test_summarize();
+void test_summarize_nested();
+void test_summarize_lost_begin();
+void test_trace_sx1276();
+void test_trace_sx1262();
+} // namespace test_hal_trace
+
+#endif
@@ -0,0 +1,88 @@
+#include "test_lmicrand.h"
+
+#include "aes/lmic_aes.h"
+#include "lmic/bufferpack.h"
+#include "lmic/lmicrand.h"
+#include <array>
+#include <unity.h>
+
+namespace test_lmicrand {
+
+#ifndef ARDUINO_ARCH_ESP32
+
+namespace {
+constexpr size_t SEQUENCE_LENGTH = 40;
+
+std::array<uint8_t, SEQUENCE_LENGTH> sequence(LmicRand &rand) {
+  std::array<uint8_t, SEQUENCE_LENGTH> result;
+  for (auto &val : result) {
+    val = rand.uint8();
+  }
+  return result;
+}
+} // namespace
+
+void test_restore_same_sequence() {
+  Aes aes;
+  LmicRand rand(aes);
+  rand.mix(0x12345678);
+  sequence(rand);
+
+  std::array<uint8_t, 16> buffer;
+  StoringBuffer store{buffer.begin()};
+  rand.saveState(store);
+  TEST_ASSERT_EQUAL(16, store.length());
+
+  LmicRand restored1(aes);
+  RetrieveBuffer retrieve1{buffer.begin()};
+  restored1.loadState(retrieve1);
+  LmicRand restored2(aes);
+  RetrieveBuffer retrieve2{buffer.begin()};
+  restored2.loadState(retrieve2);
+
+  auto const seq1 = sequence(restored1);
+  auto const seq2 = sequence(restored2);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(seq1.begin(), seq2.begin(), seq1.size());
+}
+
+void test_restore_not_replay() {
+  Aes aes;
+  LmicRand rand(aes);
+  rand.mix(0xCAFE);
+
+  std::array<uint8_t, 16> buffer;
+  StoringBuffer store{buffer.begin()};
+  rand.saveState(store);
+
+  LmicRand restored(aes);
+  RetrieveBuffer retrieve{buffer.begin()};
+  restored.loadState(retrieve);
+
+  // value given after restore must not be the one given before save.
+  auto const before = sequence(rand);
+  auto const after = sequence(restored);
+  TEST_ASSERT_FALSE(before == after);
+}
+
+void test_mix_change_sequence() {
+  Aes aes;
+  LmicRand rand1(aes);
+  LmicRand rand2(aes);
+  rand1.mix(1);
+  rand2.mix(2);
+  TEST_ASSERT_FALSE(sequence(rand1) == sequence(rand2));
+}
+
+void run() {
+  RUN_TEST(test_restore_same_sequence);
+  RUN_TEST(test_restore_not_replay);
+  RUN_TEST(test_mix_change_sequence);
+}
+
+#else
+
+void run() {}
+
+#endif
+
+} // namespace test_lmicrand
@@ -0,0 +1,11 @@
+#ifndef __test_lmicrand_h__
+#define __test_lmicrand_h__
+
+namespace test_lmicrand {
+void run();
+void test_restore_same_sequence();
+void test_restore_not_replay();
+void test_mix_change_sequence();
+} // namespace test_lmicrand
+
+#endif
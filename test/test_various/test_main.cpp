@@ -5,8 +5,22 @@
 #endif
 
 #include "test_aes.h"
+#include "test_aggregator.h"
+#include "test_airtime.h"
+#include "test_codec.h"
+#include "test_downlink.h"
+#include "test_dutycycle.h"
+#include "test_hal_trace.h"
 #include "test_keyhandler.h"
 #include "test_eu868channels.h"
+#include "test_framecounterstore.h"
+#include "test_us915channels.h"
+#include "test_lmicrand.h"
+#include "test_planner.h"
+#include "test_radio_emulator.h"
+#include "test_snapshot.h"
+#include "test_txdata.h"
+#include "test_uplinkqueue.h"
 
 void setUp(void) {
   // set stuff up here
@@ -21,6 +35,20 @@ int runUnityTests(void) {
   test_keyhandler::run();
   test_aes::run();
   test_eu868channels::run();
+  test_us915channels::run();
+  test_lmicrand::run();
+  test_radio_emulator::run();
+  test_hal_trace::run();
+  test_uplinkqueue::run();
+  test_txdata::run();
+  test_downlink::run();
+  test_aggregator::run();
+  test_codec::run();
+  test_airtime::run();
+  test_planner::run();
+  test_dutycycle::run();
+  test_snapshot::run();
+  test_framecounterstore::run();
   UNITY_END();
   return 0;
 }
@@ -0,0 +1,125 @@
+#include "test_planner.h"
+
+#include <unity.h>
+
+#ifndef ARDUINO
+
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/lmic.us915.h"
+#include "lmic/radio_fake.h"
+#include "mac_util.h"
+
+namespace test_planner {
+
+namespace {
+RadioFake radio;
+LmicEu868 lmic(radio);
+} // namespace
+
+void run() {
+  RUN_TEST(test_options_by_dr);
+  RUN_TEST(test_options_by_channel);
+  RUN_TEST(test_too_long);
+  RUN_TEST(test_duty_cycle);
+  RUN_TEST(test_us915);
+}
+
+void test_options_by_dr() {
+  mac_util::start_session(lmic, radio, 5);
+  TxPlanOption options[8];
+  auto const count = lmic.planTx(10, options, 8);
+  // DR0 to DR5 on default channels
+  TEST_ASSERT_EQUAL_UINT8(6, count);
+  for (uint8_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, options[i].dr);
+    TEST_ASSERT_TRUE(options[i].channel < 3);
+    TEST_ASSERT_TRUE(options[i].txTime <= os_getTime());
+    auto const rps =
+        rps_t(table_get_u1(EU868::RESOLVE_TABLE(_DR2RPS_CRC), i));
+    // 10 bytes of payload and 13 of header
+    TEST_ASSERT_EQUAL_INT32(Lmic::calcAirTime(rps, 23).tick(),
+                            options[i].airtime.tick());
+    TEST_ASSERT_EQUAL_UINT32(options[i].airtime.to_ms() * LMIC_TX_CURRENT_MA,
+                             options[i].charge);
+    if (i > 0) {
+      TEST_ASSERT_TRUE(options[i].airtime < options[i - 1].airtime);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT8(51, options[0].maxPayload);
+
+  // output limited
+  TEST_ASSERT_EQUAL_UINT8(2, lmic.planTx(10, options, 2));
+  TEST_ASSERT_EQUAL_UINT8(1, options[1].dr);
+}
+
+void test_options_by_channel() {
+  mac_util::start_session(lmic, radio, 5);
+  TxPlanOption options[32];
+  auto const count = lmic.planTx(10, options, 32, true);
+  TEST_ASSERT_EQUAL_UINT8(6 * 3, count);
+  TEST_ASSERT_EQUAL_UINT32(EU868::F1, options[0].frequency);
+  TEST_ASSERT_EQUAL_UINT32(EU868::F2, options[1].frequency);
+  TEST_ASSERT_EQUAL_UINT32(EU868::F3, options[2].frequency);
+}
+
+void test_too_long() {
+  mac_util::start_session(lmic, radio, 5);
+  TxPlanOption options[8];
+  // only datarates with max payload over 51 bytes
+  uint8_t const expected = MAX_LEN_FRAME >= 128 ? 3 : 0;
+  TEST_ASSERT_EQUAL_UINT8(expected, lmic.planTx(60, options, 8));
+  if (expected) {
+    TEST_ASSERT_EQUAL_UINT8(3, options[0].dr);
+  }
+}
+
+void test_duty_cycle() {
+  mac_util::start_session(lmic, radio, 5);
+  mac_util::send_one(lmic, radio);
+  auto const now = os_getTime();
+  TxPlanOption options[8];
+  TEST_ASSERT_EQUAL_UINT8(6, lmic.planTx(10, options, 8));
+  // all default channels in the same 1% band
+  for (uint8_t i = 0; i < 6; i++) {
+    TEST_ASSERT_TRUE(now < options[i].txTime);
+    TEST_ASSERT_EQUAL_UINT32(lmic.getTxAvailability().tick(),
+                             options[i].txTime.tick());
+  }
+
+  TxPlanOption option;
+  TEST_ASSERT_FALSE(lmic.planCheapestTx(10, now + OsDeltaTime::from_ms(100),
+                                        option));
+  TEST_ASSERT_TRUE(
+      lmic.planCheapestTx(10, now + OsDeltaTime::from_sec(3600), option));
+  TEST_ASSERT_EQUAL_UINT8(5, option.dr);
+}
+
+void test_us915() {
+  static RadioFake usRadio;
+  static LmicUs915 usLmic(usRadio);
+  usLmic.init();
+  usLmic.reset();
+  usLmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  TxPlanOption options[8];
+  // DR0 max payload 11
+  TEST_ASSERT_EQUAL_UINT8(5, usLmic.planTx(10, options, 8));
+  TEST_ASSERT_EQUAL_UINT8(4, usLmic.planTx(12, options, 8));
+  TEST_ASSERT_EQUAL_UINT8(4, options[3].dr);
+  TEST_ASSERT_EQUAL_UINT8(64, options[3].channel);
+  TEST_ASSERT_EQUAL_UINT32(903000000, options[3].frequency);
+
+  TxPlanOption option;
+  TEST_ASSERT_TRUE(usLmic.planCheapestTx(12, os_getTime(), option));
+  TEST_ASSERT_EQUAL_UINT8(4, option.dr);
+}
+
+} // namespace test_planner
+
+#else
+
+namespace test_planner {
+void run() {}
+} // namespace test_planner
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __test_planner_h__
+#define __test_planner_h__
+
+namespace test_planner {
+void run();
+void test_options_by_dr();
+void test_options_by_channel();
+void test_too_long();
+void test_duty_cycle();
+void test_us915();
+} // namespace test_planner
+
+#endif
@@ -0,0 +1,574 @@
+
+#include "test_radio_emulator.h"
+
+#ifndef ARDUINO
+
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/lmic.h"
+#include "lmic/radio_emulator_sx126x.h"
+#include "lmic/radio_emulator_sx127x.h"
+#include "lmic/radio_sx1262.h"
+#include "lmic/radio_sx1276.h"
+#include <unity.h>
+
+namespace test_radio_emulator {
+
+namespace {
+constexpr lmic_pinmap pins = {
+    .nss = 1,
+    .prepare_antenna_tx = nullptr,
+    .rst = 2,
+    .dio = {3, 4},
+};
+
+constexpr uint32_t freq = 868100000;
+constexpr rps_t rps_sf7 = rps_t(SF7, BandWidth::BW125, CodingRate::CR_4_5);
+constexpr uint8_t payload[] = {0x40, 0x01, 0x02, 0x03, 0x04, 0x80, 0x05,
+                               0x00, 0x01, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5,
+                               0xF6, 0x07, 0x18, 0x29, 0x3A, 0x4B};
+
+// SPI budgets, to detect regression of driver access.
+constexpr uint32_t SX1276_TX_MAX_BYTES = 75;
+// rx include one rx_activity (IRQ flags and modem status).
+constexpr uint32_t SX1276_RX_MAX_BYTES = 85;
+constexpr uint32_t SX1262_TX_MAX_BYTES = 105;
+constexpr uint32_t SX1262_RX_MAX_BYTES = 113;
+
+void advance(OsDeltaTime const delta) { hal_add_time_in_sleep(delta); }
+
+EmulatedPacket downlink(uint8_t sf) {
+  EmulatedPacket packet;
+  packet.freq = freq;
+  packet.sf = sf;
+  packet.length = sizeof(payload);
+  std::copy(payload, payload + sizeof(payload), packet.data.begin());
+  packet.rssi = -80;
+  packet.snr = 28;
+  return packet;
+}
+
+constexpr AesKey key = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+constexpr rps_t rps_sf12 = rps_t(SF12, BandWidth::BW125, CodingRate::CR_4_5);
+
+// Queue an uplink at SF12 with Lmic on the emulated radio, run until it is
+// sent.
+EmulatedPacket lmic_uplink(RadioEmulator &emulator, Lmic &lmic,
+                           bool classCDutyCycle) {
+  os_init();
+  lmic.init();
+  lmic.reset();
+  lmic.setSession(0x13, 0x01020304, key, key);
+  if (classCDutyCycle) {
+    lmic.activateClassC();
+    lmic.setClassCRxDutyCycle(true);
+  }
+  lmic.setDrTx(0);
+  uint8_t data = 1;
+  lmic.setTxData2(1, &data, 1, false);
+
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(10);
+  auto sent = emulator.popLastTx();
+  while (!sent.is_valid() && os_getTime() < timeout) {
+    lmic.run();
+    sent = emulator.popLastTx();
+    advance(OsDeltaTime::from_ms(1));
+  }
+  TEST_ASSERT_TRUE(sent.is_valid());
+  return sent;
+}
+
+// Clock error widening RX1 to 10 symbols and RX2 to 16 symbols at SF12.
+constexpr uint8_t clock_error = MAX_CLOCK_ERROR / 10;
+constexpr uint8_t RX1_SYMS = 10;
+constexpr uint8_t RX2_SYMS = 16;
+
+// Send an uplink, rx1 (if valid) is sent by the gateway at the expected
+// time, run until the end of RX2.
+RxWindowStats lmic_exchange(RadioEmulator &emulator, Radio &radio,
+                            EmulatedPacket rx1) {
+  LmicEu868 lmic(radio);
+  auto const sent = lmic_uplink(emulator, lmic, false);
+  lmic.setClockError(clock_error);
+  emulator.resetRxOnTime();
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(10);
+  if (rx1.is_valid()) {
+    rx1.freq = sent.freq;
+    rx1.sf = sent.sf;
+    emulator.simulateRx(rx1, sent.end + OsDeltaTime::from_sec(1));
+  }
+  while (!lmic.isReadyForTxData() && os_getTime() < timeout) {
+    lmic.run();
+    advance(OsDeltaTime::from_ms(1));
+  }
+  TEST_ASSERT_TRUE(lmic.isReadyForTxData());
+  return lmic.getRxWindowStats();
+}
+
+void check_no_preamble(RadioEmulator const &emulator,
+                       RxWindowStats const &stats) {
+  // RX1 and RX2 closed 4.5 symbols after the expected preamble start: radio
+  // on 5.5 + 8.5 symbols instead of the 10 + 16 symbols of the windows.
+  auto const symbol = Lmic::timeBySymbol(rps_sf12);
+  auto const windows = (RX1_SYMS + RX2_SYMS) * symbol;
+  auto const onTime = emulator.rxOnTime();
+  TEST_ASSERT_EQUAL_UINT16(2, stats.earlyClose);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.noHeader);
+  TEST_ASSERT_TRUE(onTime < 15 * symbol);
+  TEST_ASSERT_TRUE(stats.timeSaved > 11 * symbol);
+  // the time saved is the listening cut from the windows (the radio start
+  // and the polling of the MAC are not on the symbol).
+  auto const margin = OsDeltaTime(symbol.tick() / 4);
+  TEST_ASSERT_TRUE(onTime + stats.timeSaved > windows - margin);
+  TEST_ASSERT_TRUE(onTime + stats.timeSaved < windows + margin);
+}
+
+// Class C sniff at the EU868 RX2 datarate (SF12): listen RXC_SNIFF_SYMS (2)
+// symbols, sleep (PAMBL_SYMS - 2 * RXC_SNIFF_SYMS) symbols less 1 ms wake up.
+OsDeltaTime sniff_sleep_period() {
+  return 4 * Lmic::timeBySymbol(rps_sf12) - OsDeltaTime::from_ms(1);
+}
+
+void print_stats(char const *operation, SpiStats const &stats) {
+  char buffer[80];
+  snprintf(buffer, sizeof(buffer), "%s: %u SPI transactions, %u bytes",
+           operation, static_cast<unsigned>(stats.transactions),
+           static_cast<unsigned>(stats.bytes));
+  TEST_MESSAGE(buffer);
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_time_on_air);
+  RUN_TEST(test_sx1276_tx);
+  RUN_TEST(test_sx1276_rx);
+  RUN_TEST(test_sx1276_rx_timeout);
+  RUN_TEST(test_sx1276_rx_duty_cycle);
+  RUN_TEST(test_sx1276_resume);
+  RUN_TEST(test_sx1276_init_without_seed);
+  RUN_TEST(test_sx1262_tx);
+  RUN_TEST(test_sx1262_rx);
+  RUN_TEST(test_sx1262_rx_timeout);
+  RUN_TEST(test_sx1262_rx_duty_cycle);
+  RUN_TEST(test_sx1262_resume);
+  RUN_TEST(test_sx1276_early_close);
+  RUN_TEST(test_sx1276_early_close_no_header);
+  RUN_TEST(test_sx1276_no_early_close_downlink);
+  RUN_TEST(test_sx1262_early_close);
+  RUN_TEST(test_sx1262_early_close_no_header);
+  RUN_TEST(test_sx1276_class_c_sniff);
+  RUN_TEST(test_sx1262_class_c_sniff);
+}
+
+void test_time_on_air() {
+  // emulator use the datasheet formula, MAC use integer computation
+  // (slightly above for SF10 and more due to rounding of divisor).
+  for (uint8_t sf = SF7; sf <= SF12; sf++) {
+    for (uint8_t len : {1, 13, 51, 115, 222}) {
+      auto const rps = rps_t(static_cast<sf_t>(sf), BandWidth::BW125,
+                             CodingRate::CR_4_5);
+      auto const expected = RadioEmulator::timeOnAir(
+          sf + 6, 125, 5, true, false, sf >= SF11, 8, len);
+      TEST_ASSERT_INT32_WITHIN(expected.tick() / 2048 + 1, expected.tick(),
+                               Lmic::calcAirTime(rps, len).tick());
+    }
+  }
+}
+
+void test_sx1276_tx() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  radio.init();
+  print_stats("SX1276 init", emulator.spiStats());
+
+  emulator.resetSpiStats();
+  radio.tx(freq, rps_sf7, 14, payload, sizeof(payload));
+  TEST_ASSERT_FALSE(radio.io_check());
+  advance(Lmic::calcAirTime(rps_sf7, sizeof(payload)) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(radio.io_check());
+  radio.handle_end_tx();
+  TEST_ASSERT_EQUAL(0, emulator.mode());
+  print_stats("SX1276 tx", emulator.spiStats());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(SX1276_TX_MAX_BYTES,
+                                   emulator.spiStats().bytes);
+
+  auto const packet = emulator.popLastTx();
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT32(freq, packet.freq);
+  TEST_ASSERT_EQUAL(7, packet.sf);
+  TEST_ASSERT_EQUAL(sizeof(payload), packet.length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, packet.data.begin(), sizeof(payload));
+  emulator.uninstall();
+}
+
+void test_sx1276_rx() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  radio.init();
+
+  auto const now = os_getTime();
+  emulator.simulateRx(downlink(7), now);
+  emulator.resetSpiStats();
+  radio.rx(freq, rps_sf7, 8, now);
+  TEST_ASSERT_FALSE(radio.io_check());
+  TEST_ASSERT_TRUE(radio.rx_activity() != RxActivity::HEADER);
+  advance(Lmic::calcAirTime(rps_sf7, sizeof(payload)) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(radio.io_check());
+
+  RxFrameBuffer frame;
+  auto const length = radio.handle_end_rx(frame, true);
+  print_stats("SX1276 rx", emulator.spiStats());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(SX1276_RX_MAX_BYTES,
+                                   emulator.spiStats().bytes);
+  TEST_ASSERT_EQUAL(sizeof(payload), length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, frame.begin(), sizeof(payload));
+  TEST_ASSERT_EQUAL(-80, radio.get_last_packet_rssi());
+  TEST_ASSERT_EQUAL(28, radio.get_last_packet_snr_x4());
+  emulator.uninstall();
+}
+
+void test_sx1276_rx_timeout() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  radio.init();
+
+  // Downlink on another spreading factor is not received.
+  auto const now = os_getTime();
+  emulator.simulateRx(downlink(9), now);
+  radio.rx(freq, rps_sf7, 5, now);
+  TEST_ASSERT_FALSE(radio.io_check());
+  advance(5 * Lmic::timeBySymbol(rps_sf7) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(radio.io_check());
+
+  RxFrameBuffer frame;
+  TEST_ASSERT_EQUAL(0, radio.handle_end_rx(frame, true));
+  emulator.uninstall();
+}
+
+void test_sx1276_rx_duty_cycle() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  radio.init();
+
+  auto const symbol = Lmic::timeBySymbol(rps_sf7);
+  radio.rx_duty_cycle(freq, rps_sf7, 2 * symbol, 3 * symbol);
+  emulator.simulateRx(downlink(7), os_getTime() + 20 * symbol);
+
+  RxFrameBuffer frame;
+  uint8_t length = 0;
+  uint8_t nbCad = 0;
+  for (uint16_t i = 0; i < 1000 && length == 0; i++) {
+    auto const delay = radio.rx_duty_cycle_poll();
+    if (emulator.mode() == 7) {
+      nbCad++;
+    }
+    if (radio.io_check()) {
+      length = radio.handle_end_rx(frame, false);
+    }
+    advance(std::min(delay, symbol));
+  }
+  TEST_ASSERT_GREATER_THAN(1, nbCad);
+  TEST_ASSERT_EQUAL(sizeof(payload), length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, frame.begin(), sizeof(payload));
+  // listen again after the reception
+  TEST_ASSERT_EQUAL(7, emulator.mode());
+  emulator.uninstall();
+}
+
+void test_sx1276_init_without_seed() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  radio.init();
+  auto const initTransactions = emulator.spiStats().transactions;
+
+  LmicEu868 lmic(radio);
+  emulator.resetSpiStats();
+  lmic.init(false);
+  // radio init and one noise read mixed in the pool, not the seed loop.
+  TEST_ASSERT_EQUAL_UINT32(initTransactions + 1,
+                           emulator.spiStats().transactions);
+  emulator.uninstall();
+}
+
+void test_sx1276_resume() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  auto start = os_getTime();
+  radio.init();
+  auto const initTime = os_getTime() - start;
+  auto const initBytes = emulator.spiStats().bytes;
+
+  // MCU deep sleep, radio kept in sleep
+  RadioSx1276 woken{pins};
+  emulator.resetSpiStats();
+  start = os_getTime();
+  TEST_ASSERT_TRUE(woken.resume());
+  TEST_ASSERT_TRUE(os_getTime() - start < initTime);
+  TEST_ASSERT_TRUE(emulator.spiStats().bytes < initBytes);
+  print_stats("SX1276 resume", emulator.spiStats());
+
+  woken.tx(freq, rps_sf7, 14, payload, sizeof(payload));
+  advance(Lmic::calcAirTime(rps_sf7, sizeof(payload)) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(woken.io_check());
+  woken.handle_end_tx();
+  TEST_ASSERT_TRUE(emulator.popLastTx().is_valid());
+
+  // radio power lost, full init
+  emulator.reset();
+  TEST_ASSERT_FALSE(woken.resume());
+  TEST_ASSERT_EQUAL(0, emulator.mode());
+  emulator.uninstall();
+}
+
+void test_sx1262_tx() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  radio.init();
+  print_stats("SX1262 init", emulator.spiStats());
+  TEST_ASSERT_TRUE(emulator.mode() == RadioEmulatorSx126x::Mode::SLEEP);
+
+  emulator.resetSpiStats();
+  radio.tx(freq, rps_sf7, 14, payload, sizeof(payload));
+  TEST_ASSERT_FALSE(radio.io_check());
+  advance(Lmic::calcAirTime(rps_sf7, sizeof(payload)) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(radio.io_check());
+  radio.handle_end_tx();
+  TEST_ASSERT_TRUE(emulator.mode() == RadioEmulatorSx126x::Mode::SLEEP);
+  print_stats("SX1262 tx", emulator.spiStats());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(SX1262_TX_MAX_BYTES,
+                                   emulator.spiStats().bytes);
+
+  auto const packet = emulator.popLastTx();
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT32(freq, packet.freq);
+  TEST_ASSERT_EQUAL(7, packet.sf);
+  TEST_ASSERT_EQUAL(sizeof(payload), packet.length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, packet.data.begin(), sizeof(payload));
+  emulator.uninstall();
+}
+
+void test_sx1262_rx() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  radio.init();
+
+  auto const now = os_getTime();
+  emulator.simulateRx(downlink(7), now);
+  emulator.resetSpiStats();
+  radio.rx(freq, rps_sf7, 8, now);
+  TEST_ASSERT_FALSE(radio.io_check());
+  advance(Lmic::calcAirTime(rps_sf7, sizeof(payload)) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(radio.io_check());
+  TEST_ASSERT_TRUE(radio.rx_activity() == RxActivity::HEADER);
+
+  RxFrameBuffer frame;
+  auto const length = radio.handle_end_rx(frame, true);
+  print_stats("SX1262 rx", emulator.spiStats());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(SX1262_RX_MAX_BYTES,
+                                   emulator.spiStats().bytes);
+  TEST_ASSERT_EQUAL(sizeof(payload), length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, frame.begin(), sizeof(payload));
+  TEST_ASSERT_EQUAL(-80, radio.get_last_packet_rssi());
+  TEST_ASSERT_EQUAL(28, radio.get_last_packet_snr_x4());
+  emulator.uninstall();
+}
+
+void test_sx1262_rx_timeout() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  radio.init();
+
+  auto const now = os_getTime();
+  radio.rx(freq, rps_sf7, 5, now);
+  TEST_ASSERT_FALSE(radio.io_check());
+  TEST_ASSERT_TRUE(radio.rx_activity() == RxActivity::NONE);
+  advance(5 * Lmic::timeBySymbol(rps_sf7) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(radio.io_check());
+
+  RxFrameBuffer frame;
+  TEST_ASSERT_EQUAL(0, radio.handle_end_rx(frame, true));
+  emulator.uninstall();
+}
+
+void test_sx1262_rx_duty_cycle() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  radio.init();
+
+  auto const symbol = Lmic::timeBySymbol(rps_sf7);
+  radio.rx_duty_cycle(freq, rps_sf7, 2 * symbol, 3 * symbol);
+  // periods in steps of 15.625 us.
+  TEST_ASSERT_INT32_WITHIN(16, (2 * symbol).to_us(),
+                           emulator.rxDutyCycleRxPeriod().to_us());
+  TEST_ASSERT_INT32_WITHIN(16, (3 * symbol).to_us(),
+                           emulator.rxDutyCycleSleepPeriod().to_us());
+  TEST_ASSERT_TRUE(emulator.mode() == RadioEmulatorSx126x::Mode::RX);
+  emulator.simulateRx(downlink(7), os_getTime() + 20 * symbol);
+
+  RxFrameBuffer frame;
+  uint8_t length = 0;
+  for (uint16_t i = 0; i < 1000 && length == 0; i++) {
+    if (radio.io_check()) {
+      length = radio.handle_end_rx(frame, false);
+    }
+    advance(symbol);
+  }
+  TEST_ASSERT_EQUAL(sizeof(payload), length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, frame.begin(), sizeof(payload));
+  // duty cycle started again after the reception
+  TEST_ASSERT_TRUE(emulator.mode() == RadioEmulatorSx126x::Mode::RX);
+  TEST_ASSERT_INT32_WITHIN(16, (3 * symbol).to_us(),
+                           emulator.rxDutyCycleSleepPeriod().to_us());
+  emulator.uninstall();
+}
+
+void test_sx1262_resume() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  auto start = os_getTime();
+  radio.init();
+  auto const initTime = os_getTime() - start;
+
+  RadioSx1262 woken{pins, ImageCalibrationBand::band_863_870};
+  emulator.resetSpiStats();
+  start = os_getTime();
+  TEST_ASSERT_TRUE(woken.resume());
+  TEST_ASSERT_TRUE(os_getTime() - start < initTime);
+  TEST_ASSERT_TRUE(emulator.mode() == RadioEmulatorSx126x::Mode::SLEEP);
+  print_stats("SX1262 resume", emulator.spiStats());
+
+  woken.tx(freq, rps_sf7, 14, payload, sizeof(payload));
+  advance(Lmic::calcAirTime(rps_sf7, sizeof(payload)) + OsDeltaTime(1));
+  TEST_ASSERT_TRUE(woken.io_check());
+  woken.handle_end_tx();
+  TEST_ASSERT_TRUE(emulator.popLastTx().is_valid());
+  emulator.uninstall();
+}
+
+void test_sx1276_early_close() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  check_no_preamble(emulator,
+                    lmic_exchange(emulator, radio, EmulatedPacket()));
+  emulator.uninstall();
+}
+
+void test_sx1276_early_close_no_header() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  auto packet = downlink(12);
+  packet.header = false;
+  auto const stats = lmic_exchange(emulator, radio, packet);
+  TEST_ASSERT_EQUAL_UINT16(2, stats.earlyClose);
+  TEST_ASSERT_EQUAL_UINT16(1, stats.noHeader);
+  emulator.uninstall();
+}
+
+void test_sx1276_no_early_close_downlink() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  // RX1 receive the frame (not for this device), RX2 is closed.
+  auto const stats = lmic_exchange(emulator, radio, downlink(12));
+  TEST_ASSERT_EQUAL_UINT16(1, stats.earlyClose);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.noHeader);
+  emulator.uninstall();
+}
+
+void test_sx1262_early_close() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  check_no_preamble(emulator,
+                    lmic_exchange(emulator, radio, EmulatedPacket()));
+  emulator.uninstall();
+}
+
+void test_sx1262_early_close_no_header() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  auto packet = downlink(12);
+  packet.header = false;
+  auto const stats = lmic_exchange(emulator, radio, packet);
+  TEST_ASSERT_EQUAL_UINT16(2, stats.earlyClose);
+  TEST_ASSERT_EQUAL_UINT16(1, stats.noHeader);
+  emulator.uninstall();
+}
+
+void test_sx1276_class_c_sniff() {
+  RadioEmulatorSx127x emulator;
+  emulator.install();
+  RadioSx1276 radio{pins};
+  LmicEu868 lmic(radio);
+  auto const sent = lmic_uplink(emulator, lmic, true);
+
+  // CAD started by the MCU, a CAD (2 symbols) then a sleep, before RX1.
+  std::array<OsTime, 3> cadStarts;
+  uint8_t count = 0;
+  bool inCad = false;
+  while (os_getTime() < sent.end + OsDeltaTime::from_ms(900) &&
+         count < cadStarts.size()) {
+    lmic.run();
+    bool const cad = emulator.mode() == 7;
+    if (cad && !inCad) {
+      cadStarts[count++] = os_getTime();
+    }
+    inCad = cad;
+    advance(OsDeltaTime::from_ms(1));
+  }
+  TEST_ASSERT_EQUAL_UINT8(cadStarts.size(), count);
+  auto const period =
+      2 * Lmic::timeBySymbol(rps_sf12) + sniff_sleep_period();
+  for (uint8_t i = 1; i < count; i++) {
+    auto const delta = cadStarts[i] - cadStarts[i - 1];
+    // polled every ms.
+    TEST_ASSERT_TRUE(period <= delta);
+    TEST_ASSERT_TRUE(delta <= period + OsDeltaTime::from_ms(3));
+  }
+  emulator.uninstall();
+}
+
+void test_sx1262_class_c_sniff() {
+  RadioEmulatorSx126x emulator;
+  emulator.install();
+  RadioSx1262 radio{pins, ImageCalibrationBand::band_863_870};
+  LmicEu868 lmic(radio);
+  auto const sent = lmic_uplink(emulator, lmic, true);
+  while (os_getTime() < sent.end + OsDeltaTime::from_ms(100)) {
+    lmic.run();
+    advance(OsDeltaTime::from_ms(1));
+  }
+
+  // the radio alternate rx and sleep by itself.
+  TEST_ASSERT_TRUE(emulator.mode() == RadioEmulatorSx126x::Mode::RX);
+  TEST_ASSERT_INT32_WITHIN(16, (2 * Lmic::timeBySymbol(rps_sf12)).to_us(),
+                           emulator.rxDutyCycleRxPeriod().to_us());
+  TEST_ASSERT_INT32_WITHIN(16, sniff_sleep_period().to_us(),
+                           emulator.rxDutyCycleSleepPeriod().to_us());
+  emulator.uninstall();
+}
+
+} // namespace test_radio_emulator
+
+#else
+
+namespace test_radio_emulator {
+// Emulator need the generic HAL.
+void run() {}
+} // namespace test_radio_emulator
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef test_radio_emulator_h
+#define test_radio_emulator_h
+
+namespace test_radio_emulator {
+void run();
+void test_time_on_air();
+void test_sx1276_tx();
+void test_sx1276_rx();
+void test_sx1276_rx_timeout();
+void test_sx1276_rx_duty_cycle();
+void test_sx1276_resume();
+void test_sx1276_init_without_seed();
+void test_sx1262_tx();
+void test_sx1262_rx();
+void test_sx1262_rx_timeout();
+void test_sx1262_rx_duty_cycle();
+void test_sx1262_resume();
+void test_sx1276_early_close();
+void test_sx1276_early_close_no_header();
+void test_sx1276_no_early_close_downlink();
+void test_sx1262_early_close();
+void test_sx1262_early_close_no_header();
+void test_sx1276_class_c_sniff();
+void test_sx1262_class_c_sniff();
+} // namespace test_radio_emulator
+
+#endif
@@ -0,0 +1,266 @@
+#include "test_snapshot.h"
+
+#include <unity.h>
+
+#if !defined(ARDUINO) && defined(ENABLE_SAVE_RESTORE)
+
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/lmic.us915.h"
+#include "lmic/radio_fake.h"
+#include "lmic/statesnapshot.h"
+#include "mac_util.h"
+#include <algorithm>
+#include <array>
+
+namespace test_snapshot {
+
+namespace {
+RadioFake radio;
+LmicEu868 lmic(radio);
+RadioFake otherRadio;
+LmicEu868 other(otherRadio);
+
+std::array<uint8_t, StateSnapshot::storageSize(LmicEu868::STATE_SIZE)> memory;
+
+// storage losing power after some writes.
+class CutStorage final : public SnapshotStorage {
+public:
+  CutStorage(uint8_t *const abuffer, uint16_t const awritesLeft)
+      : buffer(abuffer), writesLeft(awritesLeft){};
+
+  uint8_t read(uint16_t const offset) const final { return buffer[offset]; };
+  void write(uint16_t const offset, uint8_t const value) final {
+    if (writesLeft > 0) {
+      buffer[offset] = value;
+      writesLeft--;
+    }
+  };
+
+private:
+  uint8_t *const buffer;
+  uint16_t writesLeft;
+};
+} // namespace
+
+void run() {
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_delta_write);
+  RUN_TEST(test_corrupted);
+  RUN_TEST(test_capacity);
+  RUN_TEST(test_without_time_data);
+  RUN_TEST(test_state_size);
+  RUN_TEST(test_state_array);
+  RUN_TEST(test_resume);
+  RUN_TEST(test_power_loss);
+}
+
+void test_round_trip() {
+  memory.fill(0);
+  SnapshotBuffer storage{memory.begin()};
+  StateSnapshot snapshot{storage, memory.size()};
+  TEST_ASSERT_FALSE(snapshot.isValid());
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  for (uint16_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_UINT16(i, mac_util::send_one(lmic, radio));
+  }
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  TEST_ASSERT_TRUE(snapshot.isValid());
+
+  // after deep sleep
+  mac_util::start(other);
+  TEST_ASSERT_TRUE(snapshot.load(other));
+  TEST_ASSERT_EQUAL_UINT16(3, mac_util::send_one(other, otherRadio));
+}
+
+void test_delta_write() {
+  memory.fill(0);
+  SnapshotBuffer storage{memory.begin()};
+  StateSnapshot snapshot{storage, memory.size()};
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  auto const length = StateSnapshot::stateLength(lmic, StateSnapshot::Kind::FULL);
+  TEST_ASSERT_TRUE(snapshot.lastWriteCount() > 0);
+
+  // nothing changed
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  TEST_ASSERT_EQUAL_UINT16(0, snapshot.lastWriteCount());
+
+  // one uplink: counters, duty cycle and random pool, written in the other
+  // slot, then in the first one.
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  char buffer[80];
+  snprintf(buffer, sizeof(buffer), "snapshot %u bytes, %u written after uplink",
+           static_cast<unsigned>(length),
+           static_cast<unsigned>(snapshot.lastWriteCount()));
+  TEST_MESSAGE(buffer);
+  TEST_ASSERT_TRUE(snapshot.lastWriteCount() > 0);
+  TEST_ASSERT_TRUE(snapshot.lastWriteCount() < length / 4);
+  TEST_ASSERT_TRUE(snapshot.isValid());
+}
+
+void test_corrupted() {
+  memory.fill(0);
+  SnapshotBuffer storage{memory.begin()};
+  StateSnapshot snapshot{storage, memory.size()};
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+
+  memory[StateSnapshot::HEADER_SIZE + 20] ^= 0x10;
+  TEST_ASSERT_FALSE(snapshot.isValid());
+  mac_util::start(other);
+  TEST_ASSERT_FALSE(snapshot.load(other));
+  memory[StateSnapshot::HEADER_SIZE + 20] ^= 0x10;
+  TEST_ASSERT_TRUE(snapshot.isValid());
+
+  // other layout version
+  memory[2]++;
+  TEST_ASSERT_FALSE(snapshot.isValid());
+  memory[2]--;
+
+  snapshot.invalidate();
+  TEST_ASSERT_FALSE(snapshot.isValid());
+  TEST_ASSERT_FALSE(snapshot.load(other));
+}
+
+void test_capacity() {
+  memory.fill(0xAA);
+  SnapshotBuffer storage{memory.begin()};
+  mac_util::start(lmic);
+  auto const length = StateSnapshot::stateLength(lmic, StateSnapshot::Kind::FULL);
+  StateSnapshot snapshot{
+      storage,
+      static_cast<uint16_t>(StateSnapshot::storageSize(length) - 1)};
+  TEST_ASSERT_FALSE(snapshot.save(lmic));
+  // storage untouched
+  TEST_ASSERT_TRUE(std::all_of(memory.begin(), memory.end(),
+                               [](uint8_t v) { return v == 0xAA; }));
+}
+
+void test_without_time_data() {
+  memory.fill(0);
+  SnapshotBuffer storage{memory.begin()};
+  StateSnapshot snapshot{storage, memory.size()};
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic, StateSnapshot::Kind::WITHOUT_TIME_DATA));
+  TEST_ASSERT_TRUE(
+      StateSnapshot::stateLength(lmic, StateSnapshot::Kind::WITHOUT_TIME_DATA) <
+      StateSnapshot::stateLength(lmic, StateSnapshot::Kind::FULL));
+
+  mac_util::start(other);
+  TEST_ASSERT_TRUE(snapshot.load(other));
+  TEST_ASSERT_EQUAL_UINT16(1, mac_util::send_one(other, otherRadio));
+}
+
+void test_state_size() {
+  mac_util::start(lmic);
+  TEST_ASSERT_EQUAL_UINT16(
+      LmicEu868::STATE_SIZE,
+      StateSnapshot::stateLength(lmic, StateSnapshot::Kind::FULL));
+  TEST_ASSERT_EQUAL_UINT16(
+      LmicEu868::STATE_SIZE_WITHOUT_TIME_DATA,
+      StateSnapshot::stateLength(lmic, StateSnapshot::Kind::WITHOUT_TIME_DATA));
+
+  RadioFake usRadio;
+  LmicUs915 us(usRadio);
+  us.init();
+  us.reset();
+  TEST_ASSERT_EQUAL_UINT16(
+      LmicUs915::STATE_SIZE,
+      StateSnapshot::stateLength(us, StateSnapshot::Kind::FULL));
+  TEST_ASSERT_EQUAL_UINT16(
+      LmicUs915::STATE_SIZE_WITHOUT_TIME_DATA,
+      StateSnapshot::stateLength(us, StateSnapshot::Kind::WITHOUT_TIME_DATA));
+}
+
+void test_state_array() {
+  static_assert(sizeof(LmicEu868::State) == LmicEu868::STATE_SIZE,
+                "State is exactly the saved state");
+  LmicEu868::State state;
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  mac_util::send_one(lmic, radio);
+  mac_util::send_one(lmic, radio);
+  lmic.saveState(state);
+
+  mac_util::start(other);
+  other.loadState(state);
+  TEST_ASSERT_EQUAL_UINT16(2, mac_util::send_one(other, otherRadio));
+}
+
+void test_resume() {
+  memory.fill(0);
+  SnapshotBuffer storage{memory.begin()};
+  StateSnapshot snapshot{storage, memory.size()};
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  mac_util::send_one(lmic, radio);
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+
+  // wake up: no init nor reset
+  os_init();
+  TEST_ASSERT_TRUE(snapshot.resume(other));
+  TEST_ASSERT_EQUAL_UINT16(2, mac_util::send_one(other, otherRadio));
+
+  // without time data, cold start is needed
+  TEST_ASSERT_TRUE(snapshot.save(lmic, StateSnapshot::Kind::WITHOUT_TIME_DATA));
+  TEST_ASSERT_FALSE(snapshot.resume(other));
+}
+
+void test_power_loss() {
+  memory.fill(0);
+  SnapshotBuffer storage{memory.begin()};
+  StateSnapshot snapshot{storage, memory.size()};
+
+  mac_util::start(lmic);
+  lmic.setSession(0x13, 0x01020304, AesKey{}, AesKey{});
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  mac_util::send_one(lmic, radio);
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+
+  mac_util::send_one(lmic, radio);
+  auto const backup = memory;
+  TEST_ASSERT_TRUE(snapshot.save(lmic));
+  auto const writes = snapshot.lastWriteCount();
+  TEST_ASSERT_TRUE(writes > 0);
+
+  // power lost after each write: previous state until the save is complete.
+  for (uint16_t cut = 0; cut <= writes; cut++) {
+    memory = backup;
+    CutStorage cutStorage{memory.begin(), cut};
+    StateSnapshot cutSnapshot{cutStorage, memory.size()};
+    cutSnapshot.save(lmic);
+
+    mac_util::start(other);
+    TEST_ASSERT_TRUE(snapshot.load(other));
+    TEST_ASSERT_EQUAL_UINT16(cut < writes ? 2 : 3,
+                             mac_util::send_one(other, otherRadio));
+  }
+}
+
+} // namespace test_snapshot
+
+#else
+
+namespace test_snapshot {
+void run() {}
+} // namespace test_snapshot
+
+#endif
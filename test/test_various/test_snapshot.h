@@ -0,0 +1,17 @@
+#ifndef __test_snapshot_h__
+#define __test_snapshot_h__
+
+namespace test_snapshot {
+void run();
+void test_round_trip();
+void test_delta_write();
+void test_corrupted();
+void test_capacity();
+void test_without_time_data();
+void test_state_size();
+void test_state_array();
+void test_resume();
+void test_power_loss();
+} // namespace test_snapshot
+
+#endif
@@ -0,0 +1,315 @@
+#include "test_txdata.h"
+
+#include <unity.h>
+
+#ifndef ARDUINO
+
+#include "aes/lmic_aes.h"
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/lmic.us915.h"
+#include "lmic/lorawanpacket.h"
+#include "lmic/radio_fake.h"
+#include "lmic/uplinkqueue.h"
+#include "mac_util.h"
+#include <algorithm>
+
+namespace test_txdata {
+
+namespace {
+constexpr uint8_t payload[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77};
+constexpr AesKey nwkSKey = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+constexpr AesKey appSKey = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+RadioFake radio;
+LmicEu868 lmic(radio);
+
+RadioFake::Packet send_copy(bool linkCheck) {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  if (linkCheck) {
+    lmic.askLinkCheck();
+  }
+  uint8_t data[sizeof(payload)];
+  std::copy(payload, payload + sizeof(payload), data);
+  TEST_ASSERT_EQUAL_INT8(0, lmic.setTxData2(3, data, sizeof(payload), false));
+  return mac_util::wait_send(lmic, radio);
+}
+
+RadioFake::Packet send_reserve(bool linkCheck) {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  uint8_t maxLength;
+  auto const buffer = lmic.reserveTxData(maxLength);
+  TEST_ASSERT_NOT_NULL(buffer);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT8(sizeof(payload), maxLength);
+  std::copy(payload, payload + sizeof(payload), buffer);
+  if (linkCheck) {
+    // fopts grow after the reservation
+    lmic.askLinkCheck();
+  }
+  TEST_ASSERT_EQUAL_INT8(0, lmic.commitTxData(3, sizeof(payload), false));
+  return mac_util::wait_send(lmic, radio);
+}
+
+void check_payload(RadioFake::Packet const &packet, uint8_t const *expected,
+                   uint8_t const expectedLength) {
+  TEST_ASSERT_TRUE(packet.is_valid());
+  uint8_t const foptsLength = packet.data[5] & 0x0F;
+  uint8_t const offset = 9 + foptsLength;
+  uint8_t const length = packet.length - offset - 4;
+  TEST_ASSERT_EQUAL_UINT8(expectedLength, length);
+  uint32_t const seqno = packet.data[6] | (packet.data[7] << 8);
+  std::array<uint8_t, MAX_LEN_PAYLOAD> clear;
+  std::copy(packet.data.begin() + offset,
+            packet.data.begin() + offset + length, clear.begin());
+  Aes aes;
+  aes.setApplicationSessionKey(appSKey);
+  aes.framePayloadEncryption(3, 0x01020304, seqno, PktDir::UP, clear.begin(),
+                             length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, clear.begin(), expectedLength);
+}
+
+void check_payload(RadioFake::Packet const &packet) {
+  check_payload(packet, payload, sizeof(payload));
+}
+
+void check_same(RadioFake::Packet const &expected,
+                RadioFake::Packet const &actual) {
+  TEST_ASSERT_TRUE(expected.is_valid());
+  TEST_ASSERT_TRUE(actual.is_valid());
+  TEST_ASSERT_EQUAL_UINT8(expected.length, actual.length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data.begin(), actual.data.begin(),
+                                expected.length);
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_reserve_same_frame);
+  RUN_TEST(test_reserve_fopts_change);
+  RUN_TEST(test_reserve_fopts_overflow);
+  RUN_TEST(test_copy_fopts_overflow);
+  RUN_TEST(test_reserve_busy);
+  RUN_TEST(test_confirmed_retry);
+  RUN_TEST(test_commit_errors);
+#if defined(LMIC_PIPELINED_TX) && !defined(LMIC_SINGLE_BUFFER)
+  RUN_TEST(test_pipelined_frame);
+  RUN_TEST(test_pipelined_fopts_change);
+  RUN_TEST(test_pipelined_queue_replace_poll);
+#endif
+  RUN_TEST(test_ram_report);
+}
+
+void test_reserve_same_frame() {
+  auto const expected = send_copy(false);
+  auto const actual = send_reserve(false);
+  check_same(expected, actual);
+}
+
+void test_reserve_fopts_change() {
+  auto const expected = send_copy(true);
+  auto const actual = send_reserve(true);
+  // LinkCheckReq in fopts
+  TEST_ASSERT_EQUAL_UINT8(1, actual.data[5] & 0x0F);
+  check_same(expected, actual);
+}
+
+void test_reserve_fopts_overflow() {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  uint8_t maxLength;
+  auto const buffer = lmic.reserveTxData(maxLength);
+  TEST_ASSERT_NOT_NULL(buffer);
+  if (maxLength > lmic.getMaxTxPayloadLength()) {
+    // frame limited by the datarate, not the buffer.
+    TEST_IGNORE();
+  }
+  std::array<uint8_t, MAX_LEN_PAYLOAD> data;
+  for (uint8_t i = 0; i < maxLength; i++) {
+    data[i] = i;
+  }
+  std::copy(data.begin(), data.begin() + maxLength, buffer);
+  // fopts grow after the reservation of the whole frame
+  lmic.askLinkCheck();
+  TEST_ASSERT_EQUAL_INT8(0, lmic.commitTxData(3, maxLength, false));
+
+  auto packet = mac_util::wait_send(lmic, radio);
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT8(1, packet.data[5] & 0x0F);
+  if (packet.length == 8 + 1 + 4) {
+    // header, FOpts and MIC only, payload is sent next.
+    packet = mac_util::wait_send(lmic, radio);
+  }
+  check_payload(packet, data.begin(), maxLength);
+}
+
+void test_copy_fopts_overflow() {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  lmic.askLinkCheck();
+  std::array<uint8_t, MAX_LEN_PAYLOAD> data;
+  for (uint8_t i = 0; i < data.size(); i++) {
+    data[i] = i;
+  }
+#if defined(LMIC_SINGLE_BUFFER)
+  // no room left in frame for the FOpts.
+  TEST_ASSERT_EQUAL_INT8(
+      -2,
+      lmic.setTxData2(3, data.begin(), MAX_LEN_IN_FRAME_PAYLOAD + 1, false));
+#endif
+  uint8_t const length = lmic.getMaxTxPayloadLength();
+  TEST_ASSERT_EQUAL_INT8(0, lmic.setTxData2(3, data.begin(), length, false));
+
+  auto packet = mac_util::wait_send(lmic, radio);
+  TEST_ASSERT_TRUE(packet.is_valid());
+  TEST_ASSERT_EQUAL_UINT8(1, packet.data[5] & 0x0F);
+  if (packet.length == 8 + 1 + 4) {
+    // header, FOpts and MIC only, payload is sent next.
+    packet = mac_util::wait_send(lmic, radio);
+  }
+  check_payload(packet, data.begin(), length);
+}
+
+void test_confirmed_retry() {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  uint8_t data[sizeof(payload)];
+  std::copy(payload, payload + sizeof(payload), data);
+  TEST_ASSERT_EQUAL_INT8(0, lmic.setTxData2(3, data, sizeof(payload), true));
+  auto const first = mac_util::wait_send(lmic, radio);
+  // no ack, the frame is sent again
+  auto const retry = mac_util::wait_send(lmic, radio);
+  check_payload(first);
+  check_payload(retry);
+  lmic.clrTxData();
+}
+
+void test_reserve_busy() {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  uint8_t data = 1;
+  lmic.setTxData2(3, &data, 1, false);
+  uint8_t maxLength = 1;
+  TEST_ASSERT_NULL(lmic.reserveTxData(maxLength));
+  TEST_ASSERT_EQUAL_UINT8(0, maxLength);
+  lmic.clrTxData();
+}
+
+void test_commit_errors() {
+  mac_util::start_session(lmic, radio, 5, nwkSKey, appSKey);
+  // no reservation
+  TEST_ASSERT_EQUAL_INT8(-1, lmic.commitTxData(3, 1, false));
+  uint8_t maxLength;
+  TEST_ASSERT_NOT_NULL(lmic.reserveTxData(maxLength));
+  TEST_ASSERT_EQUAL_INT8(-1, lmic.commitTxData(0, 1, false));
+  TEST_ASSERT_EQUAL_INT8(-2, lmic.commitTxData(3, maxLength + 1, false));
+}
+
+// single buffer keep the payload in frame, built at send time.
+#if defined(LMIC_PIPELINED_TX) && !defined(LMIC_SINGLE_BUFFER)
+namespace {
+// run until the rx windows of the last uplink are closed.
+void wait_ready() {
+  auto const timeout = os_getTime() + OsDeltaTime::from_sec(10);
+  while (!lmic.isReadyForTxData() && os_getTime() < timeout) {
+    lmic.run();
+    hal_add_time_in_sleep(OsDeltaTime::from_ms(10));
+  }
+  TEST_ASSERT_TRUE(lmic.isReadyForTxData());
+}
+
+void check_mic(RadioFake::Packet const &packet, uint32_t const seqno) {
+  TEST_ASSERT_EQUAL_UINT16(seqno, packet.data[6] | (packet.data[7] << 8));
+  Aes aes;
+  aes.setNetworkSessionKey(nwkSKey);
+  TEST_ASSERT_TRUE(aes.verifyMic(0x01020304, seqno, PktDir::UP,
+                                 packet.data.begin(), packet.length));
+}
+
+} // namespace
+
+void test_pipelined_frame() {
+  auto const first = send_copy(false);
+  check_mic(first, 0);
+  wait_ready();
+
+  // second uplink wait for duty cycle, built now.
+  uint8_t data[sizeof(payload)];
+  std::copy(payload, payload + sizeof(payload), data);
+  TEST_ASSERT_EQUAL_INT8(0, lmic.setTxData2(3, data, sizeof(payload), false));
+  TEST_ASSERT_TRUE(lmic.isFrameStaged());
+  auto const second = mac_util::wait_send(lmic, radio);
+  TEST_ASSERT_FALSE(lmic.isFrameStaged());
+  check_payload(second);
+  check_mic(second, 1);
+}
+
+void test_pipelined_fopts_change() {
+  send_copy(false);
+  wait_ready();
+  uint8_t data[sizeof(payload)];
+  std::copy(payload, payload + sizeof(payload), data);
+  TEST_ASSERT_EQUAL_INT8(0, lmic.setTxData2(3, data, sizeof(payload), false));
+  TEST_ASSERT_TRUE(lmic.isFrameStaged());
+
+  // rebuilt with the MAC command, same counter.
+  lmic.askLinkCheck();
+  auto const second = mac_util::wait_send(lmic, radio);
+  TEST_ASSERT_EQUAL_UINT8(1, second.data[5] & 0x0F);
+  check_payload(second);
+  check_mic(second, 1);
+  wait_ready();
+
+  // new session, counter restart
+  std::copy(payload, payload + sizeof(payload), data);
+  TEST_ASSERT_EQUAL_INT8(0, lmic.setTxData2(3, data, sizeof(payload), false));
+  TEST_ASSERT_TRUE(lmic.isFrameStaged());
+  lmic.setSession(0x13, 0x01020304, nwkSKey, appSKey);
+  TEST_ASSERT_FALSE(lmic.isFrameStaged());
+  auto const third = mac_util::wait_send(lmic, radio);
+  check_payload(third);
+  check_mic(third, 0);
+}
+
+void test_pipelined_queue_replace_poll() {
+  send_copy(false);
+  wait_ready();
+  lmic.sendAlive();
+  TEST_ASSERT_TRUE(lmic.isFrameStaged());
+
+  // confirmed uplink taken from the queue at send time, not the poll.
+  UplinkQueueBuffer<2, sizeof(payload)> queue;
+  lmic.setUplinkQueue(&queue);
+  TEST_ASSERT_EQUAL_INT8(0,
+                         lmic.queueUplink(3, payload, sizeof(payload), true));
+  auto const second = mac_util::wait_send(lmic, radio);
+  TEST_ASSERT_EQUAL_UINT8(lorawan::mhdr::ftype_data_conf_up |
+                              lorawan::mhdr::major_v1,
+                          second.data[0]);
+  check_payload(second);
+  check_mic(second, 1);
+  TEST_ASSERT_TRUE(queue.empty());
+  lmic.setUplinkQueue(nullptr);
+  lmic.clrTxData();
+}
+#endif
+
+void test_ram_report() {
+  char buffer[100];
+  snprintf(buffer, sizeof(buffer),
+           "%s frame %u rx %u: LmicEu868 %u bytes, LmicUs915 %u bytes",
+#if defined(LMIC_SINGLE_BUFFER)
+           "single buffer",
+#else
+           "default",
+#endif
+           static_cast<unsigned>(MAX_LEN_FRAME),
+           static_cast<unsigned>(sizeof(RxFrameBuffer)),
+           static_cast<unsigned>(sizeof(LmicEu868)),
+           static_cast<unsigned>(sizeof(LmicUs915)));
+  TEST_MESSAGE(buffer);
+}
+
+} // namespace test_txdata
+
+#else
+
+namespace test_txdata {
+void run() {}
+} // namespace test_txdata
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef __test_txdata_h__
+#define __test_txdata_h__
+
+namespace test_txdata {
+void run();
+void test_reserve_same_frame();
+void test_reserve_fopts_change();
+void test_reserve_fopts_overflow();
+void test_copy_fopts_overflow();
+void test_reserve_busy();
+void test_confirmed_retry();
+void test_commit_errors();
+void test_pipelined_frame();
+void test_pipelined_fopts_change();
+void test_pipelined_queue_replace_poll();
+void test_ram_report();
+} // namespace test_txdata
+
+#endif
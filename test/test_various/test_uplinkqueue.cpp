@@ -0,0 +1,182 @@
+#include "test_uplinkqueue.h"
+
+#include "lmic/uplinkqueue.h"
+#include <unity.h>
+
+#ifndef ARDUINO
+#include "hal/hal.h"
+#include "lmic/lmic.eu868.h"
+#include "lmic/radio_fake.h"
+#include "mac_util.h"
+#endif
+
+namespace test_uplinkqueue {
+
+namespace {
+struct Popped {
+  uint8_t port = 0;
+  uint8_t length = 0;
+  bool confirmed = false;
+  std::array<uint8_t, 51> data;
+};
+
+bool pop(UplinkQueue &queue, Popped &result, OsTime now = OsTime(0)) {
+  return queue.pop(now, result.port, result.data.begin(), result.length,
+                   result.confirmed);
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_fifo);
+  RUN_TEST(test_priority);
+  RUN_TEST(test_expiry);
+  RUN_TEST(test_full);
+  RUN_TEST(test_too_long);
+  RUN_TEST(test_lmic_send_queue);
+  RUN_TEST(test_lmic_queue_idle);
+}
+
+void test_fifo() {
+  UplinkQueueBuffer<3, 4> queue;
+  uint8_t const data[] = {1, 2, 3, 4};
+  // wrap several time around the ring
+  for (uint8_t round = 0; round < 3; round++) {
+    TEST_ASSERT_EQUAL_INT8(0, queue.push(10, data, 1, false));
+    TEST_ASSERT_EQUAL_INT8(0, queue.push(11, data + 1, 2, true));
+    TEST_ASSERT_EQUAL_UINT8(2, queue.size());
+
+    Popped result;
+    TEST_ASSERT_TRUE(pop(queue, result));
+    TEST_ASSERT_EQUAL_UINT8(10, result.port);
+    TEST_ASSERT_EQUAL_UINT8(1, result.length);
+    TEST_ASSERT_FALSE(result.confirmed);
+    TEST_ASSERT_EQUAL_UINT8(1, result.data[0]);
+
+    TEST_ASSERT_TRUE(pop(queue, result));
+    TEST_ASSERT_EQUAL_UINT8(11, result.port);
+    TEST_ASSERT_EQUAL_UINT8(2, result.length);
+    TEST_ASSERT_TRUE(result.confirmed);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data + 1, result.data.begin(), 2);
+
+    TEST_ASSERT_FALSE(pop(queue, result));
+    TEST_ASSERT_TRUE(queue.empty());
+  }
+}
+
+void test_priority() {
+  UplinkQueueBuffer<4, 4> queue;
+  queue.push(1, nullptr, 0, false, 0);
+  queue.push(2, nullptr, 0, false, 5);
+  queue.push(3, nullptr, 0, false, 1);
+  queue.push(4, nullptr, 0, false, 5);
+
+  uint8_t const expected[] = {2, 4, 3, 1};
+  for (auto const port : expected) {
+    Popped result;
+    TEST_ASSERT_TRUE(pop(queue, result));
+    TEST_ASSERT_EQUAL_UINT8(port, result.port);
+  }
+}
+
+void test_expiry() {
+  UplinkQueueBuffer<4, 4> queue;
+  queue.push(1, nullptr, 0, false, 3, OsTime(100));
+  queue.push(2, nullptr, 0, false, 0);
+  queue.push(3, nullptr, 0, false, 0, OsTime(300));
+
+  Popped result;
+  TEST_ASSERT_TRUE(pop(queue, result, OsTime(200)));
+  TEST_ASSERT_EQUAL_UINT8(2, result.port);
+  TEST_ASSERT_EQUAL_UINT16(1, queue.expiredCount());
+  TEST_ASSERT_TRUE(pop(queue, result, OsTime(250)));
+  TEST_ASSERT_EQUAL_UINT8(3, result.port);
+  TEST_ASSERT_EQUAL_UINT16(1, queue.expiredCount());
+}
+
+void test_full() {
+  UplinkQueueBuffer<2, 4> queue;
+  TEST_ASSERT_EQUAL_INT8(0, queue.push(1, nullptr, 0, false, 1));
+  TEST_ASSERT_EQUAL_INT8(0, queue.push(2, nullptr, 0, false, 0));
+  TEST_ASSERT_TRUE(queue.full());
+  // same priority as the lowest, refused
+  TEST_ASSERT_EQUAL_INT8(-1, queue.push(3, nullptr, 0, false, 0));
+  // higher priority replace the lowest
+  TEST_ASSERT_EQUAL_INT8(0, queue.push(4, nullptr, 0, false, 2));
+  TEST_ASSERT_EQUAL_UINT16(1, queue.droppedCount());
+
+  Popped result;
+  TEST_ASSERT_TRUE(pop(queue, result));
+  TEST_ASSERT_EQUAL_UINT8(4, result.port);
+  TEST_ASSERT_TRUE(pop(queue, result));
+  TEST_ASSERT_EQUAL_UINT8(1, result.port);
+  TEST_ASSERT_FALSE(pop(queue, result));
+}
+
+void test_too_long() {
+  UplinkQueueBuffer<2, 4> queue;
+  uint8_t const data[5] = {};
+  TEST_ASSERT_EQUAL_INT8(-2, queue.push(1, data, 5, false));
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_lmic_send_queue() {
+#ifndef ARDUINO
+  static RadioFake radio;
+  static LmicEu868 lmic(radio);
+  mac_util::start_session(lmic, radio, 5);
+
+  UplinkQueueBuffer<4, 4> queue;
+  uint8_t const value = 0x42;
+  queue.push(5, &value, 1, false, 0);
+  queue.push(6, &value, 1, false, 2);
+  queue.push(7, &value, 1, false, 1);
+  lmic.setUplinkQueue(&queue);
+
+  // all uplinks sent without the application polling the MAC state.
+  uint8_t const expected[] = {6, 7, 5};
+  for (auto const port : expected) {
+    auto const packet =
+        mac_util::wait_send(lmic, radio, OsDeltaTime::from_sec(120));
+    TEST_ASSERT_TRUE(packet.is_valid());
+    // MHDR, DevAddr, FCtrl, FCnt, FOpts, FPort
+    uint8_t const foptsLength = packet.data[5] & 0x0F;
+    TEST_ASSERT_EQUAL_UINT8(port, packet.data[8 + foptsLength]);
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+  lmic.setUplinkQueue(nullptr);
+#else
+  TEST_IGNORE();
+#endif
+}
+
+void test_lmic_queue_idle() {
+#ifndef ARDUINO
+  static RadioFake radio;
+  static LmicEu868 lmic(radio);
+  mac_util::start_session(lmic, radio, 5);
+
+  uint8_t const value = 0x42;
+  TEST_ASSERT_EQUAL_INT8(-1, lmic.queueUplink(5, &value, 1, false));
+  UplinkQueueBuffer<2, 4> queue;
+  lmic.setUplinkQueue(&queue);
+  // nothing to send, MAC idle with no job.
+  for (uint8_t i = 0; i < 10; i++) {
+    lmic.run();
+    hal_add_time_in_sleep(OsDeltaTime::from_sec(1));
+  }
+  TEST_ASSERT_FALSE(radio.popLastSend().is_valid());
+
+  TEST_ASSERT_EQUAL_INT8(0, lmic.queueUplink(5, &value, 1, false));
+  auto const packet =
+      mac_util::wait_send(lmic, radio, OsDeltaTime::from_sec(120));
+  TEST_ASSERT_TRUE(packet.is_valid());
+  uint8_t const foptsLength = packet.data[5] & 0x0F;
+  TEST_ASSERT_EQUAL_UINT8(5, packet.data[8 + foptsLength]);
+  TEST_ASSERT_TRUE(queue.empty());
+  lmic.setUplinkQueue(nullptr);
+#else
+  TEST_IGNORE();
+#endif
+}
+
+} // namespace test_uplinkqueue
@@ -0,0 +1,15 @@
+#ifndef __test_uplinkqueue_h__
+#define __test_uplinkqueue_h__
+
+namespace test_uplinkqueue {
+void run();
+void test_fifo();
+void test_priority();
+void test_expiry();
+void test_full();
+void test_too_long();
+void test_lmic_send_queue();
+void test_lmic_queue_idle();
+} // namespace test_uplinkqueue
+
+#endif
@@ -0,0 +1,209 @@
+#include "test_us915channels.h"
+
+#include "lmic/lmic.us915.h"
+#include <array>
+#include <set>
+#include <unity.h>
+
+namespace test_us915channels {
+
+namespace {
+uint8_t channel_of(Us915RegionalChannelParams const &params) {
+  for (uint8_t channel = 0; channel < 72; channel++) {
+    if (Us915RegionalChannelParams::channelFrequency(channel) ==
+        params.getTxParameter().frequency) {
+      return channel;
+    }
+  }
+  return 0xFF;
+}
+} // namespace
+
+void run() {
+  RUN_TEST(test_rotation_all_channels);
+  RUN_TEST(test_rotation_sub_band);
+  RUN_TEST(test_500khz_channels);
+  RUN_TEST(test_join_enabled_channels);
+  RUN_TEST(test_join_alternate_sub_bands);
+  RUN_TEST(test_join_remembered_sub_band);
+  RUN_TEST(test_join_sub_band_from_mask);
+}
+
+void test_rotation_all_channels() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  testObj.setDrTx(Us915RegionalChannelParams::SF7);
+
+  // each of the 64 channels once per rotation
+  for (int rotation = 0; rotation < 3; rotation++) {
+    std::set<uint8_t> channels;
+    for (int i = 0; i < 64; i++) {
+      auto const now = os_getTime();
+      TEST_ASSERT_EQUAL_UINT32(now.tick(), testObj.nextTx(now).tick());
+      auto const channel = channel_of(testObj);
+      TEST_ASSERT_TRUE(channel < 64);
+      channels.insert(channel);
+    }
+    TEST_ASSERT_EQUAL(64, channels.size());
+  }
+}
+
+void test_rotation_sub_band() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  testObj.selectSubBand(1);
+  testObj.setDrTx(Us915RegionalChannelParams::SF10);
+
+  uint8_t last = 0xFF;
+  for (int rotation = 0; rotation < 10; rotation++) {
+    std::set<uint8_t> channels;
+    for (int i = 0; i < 8; i++) {
+      testObj.nextTx(os_getTime());
+      auto const channel = channel_of(testObj);
+      TEST_ASSERT_TRUE(channel >= 8 && channel < 16);
+      // not twice in a row, even between rotations
+      TEST_ASSERT_NOT_EQUAL(last, channel);
+      channels.insert(channel);
+      last = channel;
+    }
+    TEST_ASSERT_EQUAL(8, channels.size());
+  }
+}
+
+void test_500khz_channels() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  testObj.selectSubBand(2);
+  testObj.setDrTx(Us915RegionalChannelParams::SF8C);
+
+  // selectSubBand only change 125kHz channels.
+  std::set<uint8_t> channels;
+  for (int i = 0; i < 8; i++) {
+    testObj.nextTx(os_getTime());
+    channels.insert(channel_of(testObj));
+  }
+  TEST_ASSERT_EQUAL(8, channels.size());
+  TEST_ASSERT_EQUAL(64, *channels.begin());
+
+  testObj.mapChannels(4, 1 << 2);
+  for (int i = 0; i < 4; i++) {
+    testObj.nextTx(os_getTime());
+    TEST_ASSERT_EQUAL_UINT8(64 + 2, channel_of(testObj));
+  }
+}
+
+void test_join_enabled_channels() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  testObj.selectSubBand(0);
+  testObj.mapChannels(4, 1);
+  testObj.initJoinLoop();
+
+  std::set<uint8_t> channels;
+  for (int i = 0; i < 40; i++) {
+    testObj.nextJoinState();
+    auto const channel = channel_of(testObj);
+    TEST_ASSERT_TRUE(channel < 8 || channel == 64);
+    channels.insert(channel);
+  }
+  TEST_ASSERT_EQUAL(9, channels.size());
+}
+
+void test_join_alternate_sub_bands() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  testObj.initJoinLoop();
+
+  std::set<uint8_t> bands;
+  for (int i = 0; i < 16; i++) {
+    auto const channel = channel_of(testObj);
+    if (i % 2 == 0) {
+      TEST_ASSERT_TRUE(channel < 64);
+      TEST_ASSERT_EQUAL_UINT8(Us915RegionalChannelParams::SF7,
+                              testObj.getTxDr());
+      bands.insert(channel / 8);
+    } else {
+      // 500kHz channel in the same sub-band
+      TEST_ASSERT_EQUAL_UINT8(Us915RegionalChannelParams::SF8C,
+                              testObj.getTxDr());
+      TEST_ASSERT_TRUE(bands.count(channel - 64) == 1);
+    }
+    auto const state = testObj.nextJoinState();
+    // failure reported after each round
+    TEST_ASSERT_EQUAL(i != 15, state.status);
+  }
+  TEST_ASSERT_EQUAL(8, bands.size());
+  // next round at lower datarate
+  TEST_ASSERT_EQUAL_UINT8(Us915RegionalChannelParams::SF8, testObj.getTxDr());
+}
+
+void test_join_remembered_sub_band() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+  TEST_ASSERT_EQUAL_UINT8(0xFF, testObj.getJoinSubBand());
+  testObj.initJoinLoop();
+
+  // gateway listen on sub-band 5
+  for (int i = 0; i < 64; i++) {
+    testObj.nextJoinState();
+    if (channel_of(testObj) / 8 == 5 &&
+        testObj.getTxDr() == Us915RegionalChannelParams::SF9) {
+      break;
+    }
+  }
+  testObj.joinAccepted(-80, 5);
+  TEST_ASSERT_EQUAL_UINT8(5, testObj.getJoinSubBand());
+
+#if defined(ENABLE_SAVE_RESTORE)
+  std::array<uint8_t, 64> buffer;
+  StoringBuffer store{buffer.begin()};
+  testObj.saveState(store);
+  Us915RegionalChannelParams restored(rand);
+  restored.initDefaultChannels();
+  RetrieveBuffer retrieve{buffer.begin()};
+  restored.loadState(retrieve);
+  TEST_ASSERT_EQUAL_UINT8(5, restored.getJoinSubBand());
+#else
+  auto &restored = testObj;
+#endif
+
+  // first attempts on remembered sub-band and datarate
+  restored.initJoinLoop();
+  TEST_ASSERT_EQUAL_UINT8(5, channel_of(restored) / 8);
+  TEST_ASSERT_EQUAL_UINT8(Us915RegionalChannelParams::SF9, restored.getTxDr());
+  restored.nextJoinState();
+  TEST_ASSERT_EQUAL_UINT8(64 + 5, channel_of(restored));
+}
+
+void test_join_sub_band_from_mask() {
+  Aes aes;
+  LmicRand rand{aes};
+  Us915RegionalChannelParams testObj(rand);
+  testObj.initDefaultChannels();
+
+  // LinkADRReq: all 125kHz off, then sub-band 2 on.
+  testObj.mapChannels(7, 0);
+  TEST_ASSERT_EQUAL_UINT8(0xFF, testObj.getJoinSubBand());
+  testObj.mapChannels(1, 0x00FF);
+  TEST_ASSERT_EQUAL_UINT8(2, testObj.getJoinSubBand());
+
+  // after power loss, default channels but known sub-band
+  testObj.initDefaultChannels();
+  testObj.initJoinLoop();
+  auto const channel = channel_of(testObj);
+  TEST_ASSERT_TRUE(channel >= 16 && channel < 24);
+}
+
+} // namespace test_us915channels
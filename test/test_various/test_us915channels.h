@@ -0,0 +1,15 @@
+#ifndef test_us915channels_h
+#define test_us915channels_h
+
+namespace test_us915channels {
+void run();
+void test_rotation_all_channels();
+void test_rotation_sub_band();
+void test_500khz_channels();
+void test_join_enabled_channels();
+void test_join_alternate_sub_bands();
+void test_join_remembered_sub_band();
+void test_join_sub_band_from_mask();
+} // namespace test_us915channels
+
+#endif